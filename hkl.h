@@ -222,6 +222,7 @@ HKLAPI void hkl_detector_fprintf(FILE *f, const HklDetector *self) HKL_ARG_NONNU
 typedef struct _HklGeometry HklGeometry;
 typedef struct _HklGeometryList HklGeometryList;
 typedef struct _HklGeometryListItem HklGeometryListItem;
+typedef struct _HklGeometryVariants HklGeometryVariants;
 typedef struct _HklSample HklSample; /* forwarded declaration */
 
 /* HklGeometry */
@@ -258,6 +259,26 @@ HKLAPI double hkl_geometry_wavelength_get(const HklGeometry *self,
 HKLAPI int hkl_geometry_wavelength_set(HklGeometry *self, double wavelength,
 				       HklUnitEnum unit_type, GError **error) HKL_ARG_NONNULL(1) HKL_WARN_UNUSED_RESULT;
 
+HKLAPI int hkl_geometry_axis_kinematics_get(const HklGeometry *self, const char *name,
+					    double *velocity, double *acceleration,
+					    HklUnitEnum unit_type,
+					    GError **error) HKL_ARG_NONNULL(1, 2, 3, 4) HKL_WARN_UNUSED_RESULT;
+
+HKLAPI int hkl_geometry_axis_kinematics_set(HklGeometry *self, const char *name,
+					    double velocity, double acceleration,
+					    HklUnitEnum unit_type,
+					    GError **error) HKL_ARG_NONNULL(1, 2) HKL_WARN_UNUSED_RESULT;
+
+typedef enum _HklGeometryMotion
+{
+	HKL_GEOMETRY_MOTION_SIMULTANEOUS, /* all the axes move at the same time */
+	HKL_GEOMETRY_MOTION_SEQUENTIAL, /* the axes move one after the other */
+} HklGeometryMotion;
+
+HKLAPI HklGeometryMotion hkl_geometry_motion_get(const HklGeometry *self) HKL_ARG_NONNULL(1);
+
+HKLAPI void hkl_geometry_motion_set(HklGeometry *self, HklGeometryMotion motion) HKL_ARG_NONNULL(1);
+
 HKLAPI void hkl_geometry_randomize(HklGeometry *self) HKL_ARG_NONNULL(1);
 
 /* TODO after bissecting it seems that this method is slow (to replace) */
@@ -291,6 +312,17 @@ HKLAPI const HklGeometryListItem *hkl_geometry_list_items_next_get(const HklGeom
 
 HKLAPI const HklGeometry *hkl_geometry_list_item_geometry_get(const HklGeometryListItem *self) HKL_ARG_NONNULL(1);
 
+/* HklGeometryVariants */
+
+HKLAPI HklGeometryVariants *hkl_geometry_variants_new(const HklGeometry *geometry,
+						      const HklGeometry *ref) HKL_ARG_NONNULL(1);
+
+HKLAPI void hkl_geometry_variants_free(HklGeometryVariants *self) HKL_ARG_NONNULL(1);
+
+HKLAPI size_t hkl_geometry_variants_n_get(const HklGeometryVariants *self) HKL_ARG_NONNULL(1);
+
+HKLAPI const HklGeometry *hkl_geometry_variants_next(HklGeometryVariants *self) HKL_ARG_NONNULL(1);
+
 /**********/
 /* Sample */
 /**********/
@@ -420,6 +452,16 @@ HKLAPI int hkl_sample_compute_UB_busing_levy(HklSample *self,
 					     const HklSampleReflection *r2,
 					     GError **error) HKL_ARG_NONNULL(1, 2, 3) HKL_WARN_UNUSED_RESULT;
 
+HKLAPI int hkl_sample_compute_UB_least_squares(HklSample *self,
+					       const double *weights, size_t n_weights,
+					       double threshold,
+					       GError **error) HKL_ARG_NONNULL(1) HKL_WARN_UNUSED_RESULT;
+
+HKLAPI int hkl_sample_index_peaks(HklSample *self,
+				  const HklGeometry *const *geometries, size_t n_geometries,
+				  const HklDetector *detector, double tolerance,
+				  GError **error) HKL_ARG_NONNULL(1, 2, 4) HKL_WARN_UNUSED_RESULT;
+
 HKLAPI double hkl_sample_get_reflection_measured_angle(const HklSample *self,
 						       const HklSampleReflection *r1,
 						       const HklSampleReflection *r2) HKL_ARG_NONNULL(1, 2, 3);
@@ -430,6 +472,9 @@ HKLAPI double hkl_sample_get_reflection_theoretical_angle(const HklSample *self,
 
 HKLAPI int hkl_sample_affine(HklSample *self, GError **error) HKL_ARG_NONNULL(1) HKL_WARN_UNUSED_RESULT;
 
+HKLAPI int hkl_sample_affine_covariance(HklSample *self, double covariance[81],
+					GError **error) HKL_ARG_NONNULL(1, 2) HKL_WARN_UNUSED_RESULT;
+
 /* HklSampleReflection */
 
 HKLAPI HklSampleReflection *hkl_sample_reflection_new(const HklGeometry *geometry,
@@ -478,6 +523,34 @@ HKLAPI HklGeometryList *hkl_engine_pseudo_axis_values_set(HklEngine *self,
 							  double values[], size_t n_values,
 							  HklUnitEnum unit_type, GError **error) HKL_ARG_NONNULL(1, 2) HKL_WARN_UNUSED_RESULT;
 
+HKLAPI HklGeometryList **hkl_engine_pseudo_axis_values_set_trajectory(HklEngine *self,
+								     double values[], size_t n_values,
+								     size_t n_points,
+								     HklUnitEnum unit_type,
+								     size_t *n_branches,
+								     GError **error) HKL_ARG_NONNULL(1, 2, 6) HKL_WARN_UNUSED_RESULT;
+
+HKLAPI HklGeometryList **hkl_engine_pseudo_axis_values_set_batch(HklEngine *self,
+								 double values[], size_t n_values,
+								 size_t n_points,
+								 HklUnitEnum unit_type,
+								 unsigned int n_threads,
+								 GError **error) HKL_ARG_NONNULL(1, 2) HKL_WARN_UNUSED_RESULT;
+
+HKLAPI int hkl_engine_pseudo_axis_values_get_batch(HklEngine *self,
+						   const double axes[], size_t n_axes,
+						   size_t n_points,
+						   double values[], size_t n_values,
+						   HklUnitEnum unit_type,
+						   unsigned int n_threads,
+						   GError **error) HKL_ARG_NONNULL(1, 2, 5) HKL_WARN_UNUSED_RESULT;
+
+HKLAPI HklGeometry **hkl_engine_reachable_reflections(HklEngine *self,
+						      double q_max, const char *mode,
+						      double **hkl, size_t *n_reflections,
+						      unsigned int n_threads,
+						      GError **error) HKL_ARG_NONNULL(1, 4, 5) HKL_WARN_UNUSED_RESULT;
+
 HKLAPI const HklParameter *hkl_engine_pseudo_axis_get(const HklEngine *self,
 						      const char *name,
 						      GError **error) HKL_ARG_NONNULL(1, 2) HKL_WARN_UNUSED_RESULT;
@@ -496,6 +569,10 @@ HKLAPI int hkl_engine_initialized_get(const HklEngine *self) HKL_ARG_NONNULL(1);
 HKLAPI int hkl_engine_initialized_set(HklEngine *self, int initialized,
 				      GError **error) HKL_ARG_NONNULL(1) HKL_WARN_UNUSED_RESULT;
 
+HKLAPI void hkl_engine_random_seed_set(HklEngine *self, unsigned int seed) HKL_ARG_NONNULL(1);
+
+HKLAPI void hkl_engine_parallel_starts_set(HklEngine *self, unsigned int n_starts) HKL_ARG_NONNULL(1);
+
 HKLAPI void hkl_engine_fprintf(FILE *f, const HklEngine *self) HKL_ARG_NONNULL(1, 2);
 
 /* mode */
@@ -541,6 +618,8 @@ typedef enum _HklEngineDependencies
 
 HKLAPI unsigned int hkl_engine_dependencies_get(const HklEngine *self) HKL_ARG_NONNULL(1);
 
+HKLAPI int hkl_engine_stale_get(const HklEngine *self) HKL_ARG_NONNULL(1);
+
 
 /* HklEngineList */
 
@@ -555,6 +634,25 @@ HKLAPI int hkl_engine_list_geometry_set(HklEngineList *self, const HklGeometry *
 HKLAPI int hkl_engine_list_select_solution(HklEngineList *self,
 					   const HklGeometryListItem *item) HKL_ARG_NONNULL(1);
 
+HKLAPI size_t hkl_engine_list_solutions_max_get(const HklEngineList *self) HKL_ARG_NONNULL(1);
+
+HKLAPI void hkl_engine_list_solutions_max_set(HklEngineList *self, size_t n) HKL_ARG_NONNULL(1);
+
+typedef enum _HklEngineListRanking
+{
+	HKL_ENGINE_LIST_RANKING_DISTANCE, /* sum of the axes moves */
+	HKL_ENGINE_LIST_RANKING_MOVE_TIME, /* estimated time of the move */
+} HklEngineListRanking;
+
+HKLAPI HklEngineListRanking hkl_engine_list_ranking_get(const HklEngineList *self) HKL_ARG_NONNULL(1);
+
+HKLAPI void hkl_engine_list_ranking_set(HklEngineList *self,
+					HklEngineListRanking ranking) HKL_ARG_NONNULL(1);
+
+HKLAPI int hkl_engine_list_variants_lazy_get(const HklEngineList *self) HKL_ARG_NONNULL(1);
+
+HKLAPI void hkl_engine_list_variants_lazy_set(HklEngineList *self, int lazy) HKL_ARG_NONNULL(1);
+
 HKLAPI HklEngine *hkl_engine_list_engine_get_by_name(HklEngineList *self,
 						     const char *name,
 						     GError **error) HKL_ARG_NONNULL(1, 2) HKL_WARN_UNUSED_RESULT;
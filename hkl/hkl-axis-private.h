@@ -35,10 +35,14 @@ struct _HklAxis {
 	HklParameter parameter;
 	HklVector axis_v;
 	HklQuaternion q; /* internal */
+	double velocity; /* maximum velocity (rad/s), 0 if unknown */
+	double acceleration; /* (rad/s^2), 0 for an infinite acceleration */
 };
 
 extern HklParameter *hkl_parameter_new_axis(const char* name, HklVector const *axis_v, const HklUnit *punit);
 
+extern void hkl_axis_values_set_fast(HklParameter *const axes[], const double values[], size_t n);
+
 G_END_DECLS
 
 #endif /* __HKL_AXIS_PRIVATE_H__ */
@@ -19,10 +19,11 @@
  *
  * Authors: Picca Frédéric-Emmanuel <picca@synchrotron-soleil.fr>
  */
+#define _GNU_SOURCE
 #include <gsl/gsl_nan.h>                // for GSL_NAN
 #include <gsl/gsl_sf_trig.h>            // for gsl_sf_angle_restrict_symm
 #include <gsl/gsl_sys.h>                // for gsl_isnan
-#include <math.h>                       // for M_PI, ceil, fabs, floor
+#include <math.h>                       // for M_PI, ceil, fabs, floor, sincos
 #include <stdio.h>                      // for FILE
 #include <stdlib.h>                     // for NULL, free
 #include "hkl-axis-private.h"           // for HklAxis
@@ -253,3 +254,44 @@ HklParameter *hkl_parameter_new_axis(const char *name, HklVector const *axis_v,
 
 	return &self->parameter;
 }
+
+/**
+ * hkl_axis_values_set_fast: (skip)
+ * @axes: the axes to set
+ * @values: the new values of the axes (radian)
+ * @n: the number of axes
+ *
+ * the fast path of the solvers, the values are written directly in
+ * the rotation axes and only the quaternions of the changed axes are
+ * recomputed. The other parameters are set with their operations.
+ * The geometry of the axes must be updated after.
+ **/
+void hkl_axis_values_set_fast(HklParameter *const axes[], const double values[], size_t n)
+{
+	size_t i;
+
+	for(i=0; i<n; ++i){
+		HklParameter *parameter = axes[i];
+		HklAxis *axis;
+		double c, s;
+
+		if(parameter->_value == values[i])
+			continue;
+
+		if(parameter->ops != &hkl_parameter_operations_axis){
+			hkl_parameter_value_set(parameter, values[i], HKL_UNIT_DEFAULT, NULL);
+			continue;
+		}
+
+		axis = container_of(parameter, HklAxis, parameter);
+		parameter->_value = values[i];
+		parameter->changed = TRUE;
+
+		sincos(values[i] / 2., &s, &c);
+		s /= hkl_vector_norm2(&axis->axis_v);
+		axis->q.data[0] = c;
+		axis->q.data[1] = s * axis->axis_v.data[0];
+		axis->q.data[2] = s * axis->axis_v.data[1];
+		axis->q.data[3] = s * axis->axis_v.data[2];
+	}
+}
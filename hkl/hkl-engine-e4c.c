@@ -48,8 +48,22 @@ static int _bissector_func(const gsl_vector *x, void *params, gsl_vector *f)
 	return  GSL_SUCCESS;
 }
 
+static int _bissector_df(const gsl_vector *x, void *params, gsl_matrix *J)
+{
+	CHECK_NAN(x->data, x->size);
+
+	gsl_matrix_set_zero(J);
+	RUBh_minus_Q_df(x->data, params, J);
+	gsl_matrix_set(J, 3, 0, -2);
+	gsl_matrix_set(J, 3, 3, 1);
+
+	return  GSL_SUCCESS;
+}
+
 static const HklFunction bissector_func = {
 	.function = _bissector_func,
+	.df = _bissector_df,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -57,12 +71,13 @@ static HklMode *bissector(void)
 {
 	static const char* axes[] = {OMEGA, CHI, PHI, TTH};
 	static const HklFunction *functions[] = {&bissector_func};
-	static const HklModeAutoInfo info = {
-		HKL_MODE_AUTO_INFO(__func__, axes, axes, functions),
+	static const HklModeHklAnalyticInfo info = {
+		.auto_info = {HKL_MODE_AUTO_INFO(__func__, axes, axes, functions)},
+		.bissector = OMEGA,
 	};
 
-	return hkl_mode_auto_new(&info,
-				 &hkl_mode_operations,
+	return hkl_mode_auto_new(&info.auto_info,
+				 &hkl_analytic_mode_operations,
 				 TRUE);
 }
 
@@ -71,12 +86,12 @@ static HklMode *constant_omega(void)
 	static const char* axes_r[] = {OMEGA, CHI, PHI, TTH};
 	static const char* axes_w[] = {CHI, PHI, TTH};
 	static const HklFunction *functions[] = {&RUBh_minus_Q_func};
-	static const HklModeAutoInfo info = {
-		HKL_MODE_AUTO_INFO(__func__, axes_r, axes_w, functions),
+	static const HklModeHklAnalyticInfo info = {
+		.auto_info = {HKL_MODE_AUTO_INFO(__func__, axes_r, axes_w, functions)},
 	};
 
-	return hkl_mode_auto_new(&info,
-				 &hkl_mode_operations,
+	return hkl_mode_auto_new(&info.auto_info,
+				 &hkl_analytic_mode_operations,
 				 TRUE);
 }
 
@@ -85,12 +100,12 @@ static HklMode *constant_chi(void)
 	static const char* axes_r[] = {OMEGA, CHI, PHI, TTH};
 	static const char* axes_w[] = {OMEGA, PHI, TTH};
 	static const HklFunction *functions[] = {&RUBh_minus_Q_func};
-	static const HklModeAutoInfo info = {
-		HKL_MODE_AUTO_INFO(__func__, axes_r, axes_w, functions),
+	static const HklModeHklAnalyticInfo info = {
+		.auto_info = {HKL_MODE_AUTO_INFO(__func__, axes_r, axes_w, functions)},
 	};
 
-	return hkl_mode_auto_new(&info,
-				 &hkl_mode_operations,
+	return hkl_mode_auto_new(&info.auto_info,
+				 &hkl_analytic_mode_operations,
 				 TRUE);
 }
 
@@ -99,12 +114,12 @@ static HklMode *constant_phi(void)
 	static const char* axes_r[] = {OMEGA, CHI, PHI, TTH};
 	static const char* axes_w[] = {OMEGA, CHI, TTH};
 	static const HklFunction *functions[] = {&RUBh_minus_Q_func};
-	static const HklModeAutoInfo info = {
-		HKL_MODE_AUTO_INFO(__func__, axes_r, axes_w, functions),
+	static const HklModeHklAnalyticInfo info = {
+		.auto_info = {HKL_MODE_AUTO_INFO(__func__, axes_r, axes_w, functions)},
 	};
 
-	return hkl_mode_auto_new(&info,
-				 &hkl_mode_operations,
+	return hkl_mode_auto_new(&info.auto_info,
+				 &hkl_analytic_mode_operations,
 				 TRUE);
 }
 
@@ -53,8 +53,23 @@ static int _bissector_horizontal_func(const gsl_vector *x, void *params, gsl_vec
 	return  GSL_SUCCESS;
 }
 
+static int _bissector_horizontal_df(const gsl_vector *x, void *params, gsl_matrix *J)
+{
+	CHECK_NAN(x->data, x->size);
+
+	gsl_matrix_set_zero(J);
+	RUBh_minus_Q_df(x->data, params, J);
+	gsl_matrix_set(J, 3, 1, 1);
+	gsl_matrix_set(J, 4, 0, -2);
+	gsl_matrix_set(J, 4, 4, 1);
+
+	return  GSL_SUCCESS;
+}
+
 static const HklFunction bissector_horizontal_func = {
 	.function = _bissector_horizontal_func,
+	.df = _bissector_horizontal_df,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 5,
 };
 
@@ -71,8 +86,22 @@ static int _bissector_vertical_func(const gsl_vector *x, void *params, gsl_vecto
 	return  GSL_SUCCESS;
 }
 
+static int _bissector_vertical_df(const gsl_vector *x, void *params, gsl_matrix *J)
+{
+	CHECK_NAN(x->data, x->size);
+
+	gsl_matrix_set_zero(J);
+	RUBh_minus_Q_df(x->data, params, J);
+	gsl_matrix_set(J, 3, 0, -2);
+	gsl_matrix_set(J, 3, 3, 1);
+
+	return  GSL_SUCCESS;
+}
+
 static const HklFunction bissector_vertical_func = {
 	.function = _bissector_vertical_func,
+	.df = _bissector_vertical_df,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -85,12 +114,13 @@ static HklMode *bissector_vertical(void)
 	static const char* axes_r[] = {MU, OMEGA, CHI, PHI, GAMMA, DELTA};
 	static const char* axes_w[] = {OMEGA, CHI, PHI, DELTA};
 	static const HklFunction *functions[] = {&bissector_vertical_func};
-	static const HklModeAutoInfo info = {
-		HKL_MODE_AUTO_INFO(__func__, axes_r, axes_w, functions),
+	static const HklModeHklAnalyticInfo info = {
+		.auto_info = {HKL_MODE_AUTO_INFO(__func__, axes_r, axes_w, functions)},
+		.bissector = OMEGA,
 	};
 
-	return hkl_mode_auto_new(&info,
-				 &hkl_mode_operations,
+	return hkl_mode_auto_new(&info.auto_info,
+				 &hkl_analytic_mode_operations,
 				 TRUE);
 }
 
@@ -99,12 +129,12 @@ static HklMode *constant_omega_vertical(void)
 	static const char* axes_r[] = {MU, OMEGA, CHI, PHI, GAMMA, DELTA};
 	static const char* axes_w[] = {CHI, PHI, DELTA};
 	static const HklFunction *functions[] = {&RUBh_minus_Q_func};
-	static const HklModeAutoInfo info = {
-		HKL_MODE_AUTO_INFO(__func__, axes_r, axes_w, functions),
+	static const HklModeHklAnalyticInfo info = {
+		.auto_info = {HKL_MODE_AUTO_INFO(__func__, axes_r, axes_w, functions)},
 	};
 
-	return hkl_mode_auto_new(&info,
-				 &hkl_mode_operations,
+	return hkl_mode_auto_new(&info.auto_info,
+				 &hkl_analytic_mode_operations,
 				 TRUE);
 }
 
@@ -113,12 +143,12 @@ static HklMode *constant_chi_vertical(void)
 	static const char* axes_r[] = {MU, OMEGA, CHI, PHI, GAMMA, DELTA};
 	static const char* axes_w[] = {OMEGA, PHI, DELTA};
 	static const HklFunction *functions[] = {&RUBh_minus_Q_func};
-	static const HklModeAutoInfo info = {
-		HKL_MODE_AUTO_INFO(__func__, axes_r, axes_w, functions),
+	static const HklModeHklAnalyticInfo info = {
+		.auto_info = {HKL_MODE_AUTO_INFO(__func__, axes_r, axes_w, functions)},
 	};
 
-	return hkl_mode_auto_new(&info,
-				 &hkl_mode_operations,
+	return hkl_mode_auto_new(&info.auto_info,
+				 &hkl_analytic_mode_operations,
 				 TRUE);
 }
 
@@ -127,12 +157,12 @@ static HklMode *constant_phi_vertical(void)
 	static const char* axes_r[] = {MU, OMEGA, CHI, PHI, GAMMA, DELTA};
 	static const char* axes_w[] = {OMEGA, CHI, DELTA};
 	static const HklFunction *functions[] = {&RUBh_minus_Q_func};
-	static const HklModeAutoInfo info = {
-		HKL_MODE_AUTO_INFO(__func__, axes_r, axes_w, functions),
+	static const HklModeHklAnalyticInfo info = {
+		.auto_info = {HKL_MODE_AUTO_INFO(__func__, axes_r, axes_w, functions)},
 	};
 
-	return hkl_mode_auto_new(&info,
-				 &hkl_mode_operations,
+	return hkl_mode_auto_new(&info.auto_info,
+				 &hkl_analytic_mode_operations,
 				 TRUE);
 }
 
@@ -197,13 +227,16 @@ static HklMode *bissector_horizontal(void)
 {
 	static const char* axes_r[] = {MU, OMEGA, CHI, PHI, GAMMA, DELTA};
 	static const char* axes_w[] = {MU, OMEGA, CHI, PHI, GAMMA};
+	static const char* zeros[] = {OMEGA};
 	static const HklFunction *functions[] = {&bissector_horizontal_func};
-	static const HklModeAutoInfo info = {
-		HKL_MODE_AUTO_INFO(__func__, axes_r, axes_w, functions),
+	static const HklModeHklAnalyticInfo info = {
+		.auto_info = {HKL_MODE_AUTO_INFO(__func__, axes_r, axes_w, functions)},
+		.bissector = MU,
+		.zeros = DARRAY(zeros),
 	};
 
-	return hkl_mode_auto_new(&info,
-				 &hkl_mode_operations,
+	return hkl_mode_auto_new(&info.auto_info,
+				 &hkl_analytic_mode_operations,
 				 TRUE);
 }
 
@@ -257,12 +290,12 @@ static HklMode *constant_mu_horizontal(void)
 	static const char* axes_r[] = {MU, OMEGA, CHI, PHI, GAMMA, DELTA};
 	static const char* axes_w[] = {CHI, PHI, GAMMA};
 	static const HklFunction *functions[] = {&RUBh_minus_Q_func};
-	static const HklModeAutoInfo info = {
-		HKL_MODE_AUTO_INFO(__func__, axes_r, axes_w, functions),
+	static const HklModeHklAnalyticInfo info = {
+		.auto_info = {HKL_MODE_AUTO_INFO(__func__, axes_r, axes_w, functions)},
 	};
 
-	return hkl_mode_auto_new(&info,
-				 &hkl_full_mode_operations,
+	return hkl_mode_auto_new(&info.auto_info,
+				 &hkl_analytic_full_mode_operations,
 				 TRUE);
 }
 
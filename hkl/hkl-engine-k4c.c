@@ -84,6 +84,7 @@ static int _bissector_f1(const gsl_vector *x, void *params, gsl_vector *f)
 
 static const HklFunction bissector_f1 = {
 	.function = _bissector_f1,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -106,6 +107,7 @@ static int _bissector_f2(const gsl_vector *x, void *params, gsl_vector *f)
 
 static const HklFunction bissector_f2 = {
 	.function = _bissector_f2,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -144,6 +146,7 @@ static int _constant_omega_f1(const gsl_vector *x, void *params, gsl_vector *f)
 
 static const HklFunction constant_omega_f1 = {
 	.function = _constant_omega_f1,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -167,6 +170,7 @@ static int _constant_omega_f2(const gsl_vector *x, void *params, gsl_vector *f)
 
 static const HklFunction constant_omega_f2 = {
 	.function = _constant_omega_f2,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -205,6 +209,7 @@ static int _constant_chi_f1(const gsl_vector *x, void *params, gsl_vector *f)
 
 static const HklFunction constant_chi_f1 = {
 	.function = _constant_chi_f1,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -227,6 +232,7 @@ static int _constant_chi_f2(const gsl_vector *x, void *params, gsl_vector *f)
 
 static const HklFunction constant_chi_f2 = {
 	.function = _constant_chi_f2,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -266,6 +272,7 @@ static int _constant_phi_f1(const gsl_vector *x, void *params, gsl_vector *f)
 
 static const HklFunction constant_phi_f1 = {
 	.function = _constant_phi_f1,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -289,6 +296,7 @@ static int _constant_phi_f2(const gsl_vector *x, void *params, gsl_vector *f)
 
 static const HklFunction constant_phi_f2 = {
 	.function = _constant_phi_f2,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
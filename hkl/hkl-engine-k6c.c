@@ -67,6 +67,27 @@ static void hkl_geometry_list_multiply_k6c_real(HklGeometryList *self,
 /* numerical functions */
 /***********************/
 
+/* derivatives of the kappa -> eulerian conversion used by the mode functions */
+/* omega = komega + p(kappa) +- pi/2, phi = kphi + p(kappa) +- pi/2 */
+/* with p(kappa) = atan(tan(kappa/2) * cos(alpha)) */
+static double dp_dkappa(double kappa)
+{
+	const double c = cos(50 * HKL_DEGTORAD);
+	const double ck = cos(kappa/2.);
+	const double sk = sin(kappa/2.);
+
+	return c / (2 * (ck * ck + c * c * sk * sk));
+}
+
+/* chi = 2 * asin(sin(kappa/2) * sin(alpha)) */
+static double dchi_dkappa(double kappa)
+{
+	const double s = sin(50 * HKL_DEGTORAD);
+	const double sk = sin(kappa/2.);
+
+	return cos(kappa/2.) * s / sqrt(1 - sk * sk * s * s);
+}
+
 static int _bissector_h_f1(const gsl_vector *x, void *params, gsl_vector *f)
 {
 	const double mu = x->data[0];
@@ -86,8 +107,26 @@ static int _bissector_h_f1(const gsl_vector *x, void *params, gsl_vector *f)
 	return  GSL_SUCCESS;
 }
 
+static int _bissector_h_df(const gsl_vector *x, void *params, gsl_matrix *J)
+{
+	const double kappa = x->data[2];
+
+	CHECK_NAN(x->data, x->size);
+
+	gsl_matrix_set_zero(J);
+	RUBh_minus_Q_df(x->data, params, J);
+	gsl_matrix_set(J, 3, 1, 1);
+	gsl_matrix_set(J, 3, 2, dp_dkappa(kappa));
+	gsl_matrix_set(J, 4, 0, -2);
+	gsl_matrix_set(J, 4, 4, 1);
+
+	return  GSL_SUCCESS;
+}
+
 static const HklFunction bissector_h_f1 = {
 	.function = _bissector_h_f1,
+	.df = _bissector_h_df,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 5,
 };
 
@@ -113,6 +152,8 @@ static int _bissector_h_f2(const gsl_vector *x, void *params, gsl_vector *f)
 
 static const HklFunction bissector_h_f2 = {
 	.function = _bissector_h_f2,
+	.df = _bissector_h_df,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 5,
 };
 
@@ -132,8 +173,24 @@ static int _constant_kphi_h_f1(const gsl_vector *x, void *params, gsl_vector *f)
 	return  GSL_SUCCESS;
 }
 
+static int _constant_kphi_h_df(const gsl_vector *x, void *params, gsl_matrix *J)
+{
+	const double kappa = x->data[2];
+
+	CHECK_NAN(x->data, x->size);
+
+	gsl_matrix_set_zero(J);
+	RUBh_minus_Q_df(x->data, params, J);
+	gsl_matrix_set(J, 3, 1, 1);
+	gsl_matrix_set(J, 3, 2, dp_dkappa(kappa));
+
+	return  GSL_SUCCESS;
+}
+
 static const HklFunction constant_kphi_h_f1 = {
 	.function = _constant_kphi_h_f1,
+	.df = _constant_kphi_h_df,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -155,6 +212,8 @@ static int _constant_kphi_h_f2(const gsl_vector *x, void *params, gsl_vector *f)
 
 static const HklFunction constant_kphi_h_f2 = {
 	.function = _constant_kphi_h_f2,
+	.df = _constant_kphi_h_df,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -178,8 +237,26 @@ static int _constant_phi_h_f1(const gsl_vector *x, void *params, gsl_vector *f)
 	return  GSL_SUCCESS;
 }
 
+static int _constant_phi_h_df(const gsl_vector *x, void *params, gsl_matrix *J)
+{
+	const double kappa = x->data[2];
+
+	CHECK_NAN(x->data, x->size);
+
+	gsl_matrix_set_zero(J);
+	RUBh_minus_Q_df(x->data, params, J);
+	gsl_matrix_set(J, 3, 1, 1);
+	gsl_matrix_set(J, 3, 2, dp_dkappa(kappa));
+	gsl_matrix_set(J, 4, 2, dp_dkappa(kappa));
+	gsl_matrix_set(J, 4, 3, 1);
+
+	return  GSL_SUCCESS;
+}
+
 static const HklFunction constant_phi_h_f1 = {
 	.function = _constant_phi_h_f1,
+	.df = _constant_phi_h_df,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 5,
 };
 
@@ -205,6 +282,8 @@ static int _constant_phi_h_f2(const gsl_vector *x, void *params, gsl_vector *f)
 
 static const HklFunction constant_phi_h_f2 = {
 	.function = _constant_phi_h_f2,
+	.df = _constant_phi_h_df,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 5,
 };
 
@@ -225,8 +304,25 @@ static int _bissector_v(const gsl_vector *x, void *params, gsl_vector *f)
 	return  GSL_SUCCESS;
 }
 
+static int _bissector_v_df(const gsl_vector *x, void *params, gsl_matrix *J)
+{
+	const double kappa = x->data[1];
+
+	CHECK_NAN(x->data, x->size);
+
+	gsl_matrix_set_zero(J);
+	RUBh_minus_Q_df(x->data, params, J);
+	gsl_matrix_set(J, 3, 0, -2);
+	gsl_matrix_set(J, 3, 1, -2 * dp_dkappa(kappa));
+	gsl_matrix_set(J, 3, 3, 1);
+
+	return  GSL_SUCCESS;
+}
+
 static const HklFunction bissector_v = {
 	.function = _bissector_v,
+	.df = _bissector_v_df,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -248,8 +344,24 @@ static int _constant_omega_v(const gsl_vector *x, void *params, gsl_vector *f)
 	return  GSL_SUCCESS;
 }
 
+static int _constant_omega_v_df(const gsl_vector *x, void *params, gsl_matrix *J)
+{
+	const double kappa = x->data[1];
+
+	CHECK_NAN(x->data, x->size);
+
+	gsl_matrix_set_zero(J);
+	RUBh_minus_Q_df(x->data, params, J);
+	gsl_matrix_set(J, 3, 0, -1);
+	gsl_matrix_set(J, 3, 1, -dp_dkappa(kappa));
+
+	return  GSL_SUCCESS;
+}
+
 static const HklFunction constant_omega_v = {
 	.function = _constant_omega_v,
+	.df = _constant_omega_v_df,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -270,8 +382,23 @@ static int _constant_chi_v(const gsl_vector *x, void *params, gsl_vector *f)
 	return  GSL_SUCCESS;
 }
 
+static int _constant_chi_v_df(const gsl_vector *x, void *params, gsl_matrix *J)
+{
+	const double kappa = x->data[1];
+
+	CHECK_NAN(x->data, x->size);
+
+	gsl_matrix_set_zero(J);
+	RUBh_minus_Q_df(x->data, params, J);
+	gsl_matrix_set(J, 3, 1, -dchi_dkappa(kappa));
+
+	return  GSL_SUCCESS;
+}
+
 static const HklFunction constant_chi_v = {
 	.function = _constant_chi_v,
+	.df = _constant_chi_v_df,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -293,8 +420,24 @@ static int _constant_phi_v(const gsl_vector *x, void *params, gsl_vector *f)
 	return  GSL_SUCCESS;
 }
 
+static int _constant_phi_v_df(const gsl_vector *x, void *params, gsl_matrix *J)
+{
+	const double kappa = x->data[1];
+
+	CHECK_NAN(x->data, x->size);
+
+	gsl_matrix_set_zero(J);
+	RUBh_minus_Q_df(x->data, params, J);
+	gsl_matrix_set(J, 3, 1, -dp_dkappa(kappa));
+	gsl_matrix_set(J, 3, 2, -1);
+
+	return  GSL_SUCCESS;
+}
+
 static const HklFunction constant_phi_v = {
 	.function = _constant_phi_v,
+	.df = _constant_phi_v_df,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -316,6 +459,7 @@ static int _double_diffraction_h(const gsl_vector *x, void *params, gsl_vector *
 
 static const HklFunction double_diffraction_h = {
 	.function = _double_diffraction_h,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 5,
 };
 
@@ -373,6 +517,7 @@ static int _constant_incidence_func(const gsl_vector *x, void *params, gsl_vecto
 
 static const HklFunction constant_incidence_func = {
 	.function = _constant_incidence_func,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 5,
 };
 
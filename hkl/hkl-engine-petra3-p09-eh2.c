@@ -79,6 +79,7 @@ static int _reflectivity(const gsl_vector *x, void *params, gsl_vector *f)
 
 static const HklFunction reflectivity = {
 	.function = _reflectivity,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -114,6 +115,7 @@ static int _bissector_horizontal(const gsl_vector *x, void *params, gsl_vector *
 
 static const HklFunction bissector_horizontal = {
 	.function = _bissector_horizontal,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -56,6 +56,7 @@ static int _reflectivity_func(const gsl_vector *x, void *params, gsl_vector *f)
 
 static const HklFunction reflectivity_func = {
 	.function = _reflectivity_func,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -229,7 +230,6 @@ static int slits_func(const gsl_vector *x, void *params, gsl_vector *f)
 
 static int fit_slits_orientation(HklSlitsFit *params)
 {
-	size_t i;
 	gsl_multiroot_fsolver_type const *T;
 	gsl_multiroot_fsolver *s;
 	gsl_multiroot_function f;
@@ -238,6 +238,7 @@ static int fit_slits_orientation(HklSlitsFit *params)
 	int status;
 	int res = FALSE;
 	int iter;
+	unsigned int n_restarts = 0;
 
 	/* now solve the system */
 	/* Initialize method  */
@@ -260,9 +261,10 @@ static int fit_slits_orientation(HklSlitsFit *params)
 		++iter;
 		status = gsl_multiroot_fsolver_iterate(s);
 		if (status || iter % 100 == 0) {
-			/* Restart from another point. */
-			for(i=0; i<params->len; ++i)
-				x_data[i] = (double)rand() / RAND_MAX * 180. / M_PI;
+			/* Restart from another point, there is no engine
+			 * here so the sequence is not shifted. */
+			hkl_parameter_restart_point(&params->axis, params->len,
+						    ++n_restarts, NULL, x_data);
 			gsl_multiroot_fsolver_set(s, &f, x);
 			gsl_multiroot_fsolver_iterate(s);
 		}
@@ -270,6 +272,8 @@ static int fit_slits_orientation(HklSlitsFit *params)
 	} while (status == GSL_CONTINUE && iter < 1000);
 
 #ifdef DEBUG
+	size_t i;
+
 	fprintf(stdout, "\n  fitting the detector position using thoses axes :");
 	for(i=0; i<params->len; ++i)
 		fprintf(stdout, " \"%s\"", params->axis->name);
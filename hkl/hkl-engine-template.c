@@ -111,6 +111,7 @@ static int _bissector_vertical_func(const gsl_vector *x, void *params, gsl_vecto
  * HklMode. */
 static const HklFunction bissector_vertical_func = {
 	.function = _bissector_vertical_func,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -64,6 +64,7 @@ static int _reflectivity_func(const gsl_vector *x, void *params, gsl_vector *f)
 
 static const HklFunction reflectivity_func = {
 	.function = _reflectivity_func,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
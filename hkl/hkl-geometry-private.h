@@ -42,7 +42,7 @@ typedef void (* HklGeometryListMultiplyFunction) (HklGeometryList *self,
 typedef darray(HklHolder *) darray_holder;
 
 struct HklHolderConfig {
-	int gc;
+	gint gc; /* atomic, copies are shared between threads */
 	size_t *idx;
 	size_t len;
 };
@@ -51,6 +51,7 @@ struct _HklHolder {
 	struct HklHolderConfig *config;
 	HklGeometry *geometry;
 	HklQuaternion q;
+	HklQuaternion *qs; /* qs[i] = rotation of the i+1 first axes */
 };
 
 struct _HklGeometry
@@ -59,6 +60,10 @@ struct _HklGeometry
 	HklSource source;
 	darray_parameter axes;
 	darray_holder holders;
+	int compact; /* the axes and the holders are allocated with the geometry */
+	int gen_axes; /* changed with the axes values, shared by the copies */
+	int gen_source; /* changed with the source, shared by the copies */
+	HklGeometryMotion motion;
 };
 
 #define HKL_GEOMETRY_ERROR hkl_geometry_error_quark ()
@@ -73,17 +78,48 @@ typedef enum {
 	HKL_GEOMETRY_ERROR_AXIS_SET, /* can not set the axis */
 } HklGeometryError;
 
+/*
+ * The items of a list and their compact geometries are allocated one
+ * after the other in chunks of fixed size slots which never move, so
+ * the items stay valid while the list grows. The removed slots are
+ * only recycled by hkl_geometry_list_reset.
+ */
+struct HklGeometryListChunk;
+
 struct _HklGeometryList
 {
 	HklGeometryListMultiplyFunction multiply;
 	struct list_head items;
 	size_t n_items;
+	size_t n_items_max; /* kept by hkl_geometry_list_sort, 0 for all */
+	int variants_lazy; /* multiply_from_range does not add the variants */
+	HklEngineListRanking ranking; /* of hkl_geometry_list_sort */
+	HklGeometryListItem **buckets; /* the items hashed by their quantized axes values */
+	size_t n_buckets;
+	int hash_valid; /* all the items are in the buckets */
+	size_t slot; /* size of an item with its geometry, 0 until the first one */
+	struct HklGeometryListChunk *chunks;
+};
+
+struct _HklGeometryVariants
+{
+	HklGeometry *geometry; /* the current variant */
+	size_t n_axes;
+	double *starts; /* smallest value in range of each axis */
+	size_t *lens; /* number of values of each axis */
+	double *values;
+	size_t n; /* number of variants */
+	size_t next; /* index of the next variant */
+	size_t *order; /* closest first variants, NULL for the natural order */
 };
 
 struct _HklGeometryListItem
 {
 	struct list_node list;
 	HklGeometry *geometry;
+	int arena; /* allocated in the chunks of its list */
+	size_t key; /* hash of the quantized axes values */
+	HklGeometryListItem *hash_next;
 };
 
 /*************/
@@ -96,6 +132,10 @@ extern HklParameter *hkl_holder_add_rotation_axis(HklHolder *self,
 extern HklParameter *hkl_holder_add_rotation_axis_with_punit(HklHolder *self,
 							     char const *name, double x, double y, double z,
 							     const HklUnit *punit);
+
+extern int hkl_holder_axis_v_lab(const HklHolder *self, const HklParameter *axis,
+				 HklVector *axis_v);
+
 /***************/
 /* HklGeometry */
 /***************/
@@ -105,6 +145,8 @@ extern HklGeometry *hkl_geometry_new(const HklFactory *factory);
 extern int hkl_geometry_init_geometry(HklGeometry *self,
 				      const HklGeometry *src);
 
+extern HklGeometry *hkl_geometry_new_copy_unshared(const HklGeometry *src);
+
 extern HklHolder *hkl_geometry_add_holder(HklGeometry *self);
 
 extern void hkl_geometry_update(HklGeometry *self);
@@ -125,6 +167,9 @@ extern double hkl_geometry_distance_orthodromic(const HklGeometry *self,
 extern int hkl_geometry_closest_from_geometry_with_range(HklGeometry *self,
 							 const HklGeometry *ref);
 
+extern double hkl_geometry_move_time(const HklGeometry *self,
+				     const HklGeometry *ref);
+
 extern int hkl_geometry_is_valid(const HklGeometry *self);
 
 extern int hkl_geometry_is_valid_range(const HklGeometry *self);
@@ -139,6 +184,8 @@ extern HklGeometryList *hkl_geometry_list_new_copy(const HklGeometryList *self);
 
 extern void hkl_geometry_list_add(HklGeometryList *self, HklGeometry *geometry);
 
+extern void hkl_geometry_list_append(HklGeometryList *self, const HklGeometry *geometry);
+
 extern void hkl_geometry_list_reset(HklGeometryList *self);
 
 extern void hkl_geometry_list_sort(HklGeometryList *self, HklGeometry *ref);
@@ -147,7 +194,8 @@ extern void hkl_geometry_list_fprintf(FILE *f, const HklGeometryList *self);
 
 extern void hkl_geometry_list_multiply(HklGeometryList *self);
 
-extern void hkl_geometry_list_multiply_from_range(HklGeometryList *self);
+extern void hkl_geometry_list_multiply_from_range(HklGeometryList *self,
+						  const HklGeometry *ref);
 
 extern void hkl_geometry_list_remove_invalid(HklGeometryList *self);
 
@@ -20,13 +20,13 @@
  * Authors: Picca Frédéric-Emmanuel <picca@synchrotron-soleil.fr>
  */
 #include <alloca.h>                     // for alloca
-#include <gsl/gsl_sf_trig.h>            // for gsl_sf_angle_restrict_symm
+#include <gsl/gsl_sf_trig.h>            // for gsl_sf_angle_restrict_symm, etc
 #include <gsl/gsl_sys.h>                // for gsl_isnan
 #include <math.h>                       // for fabs, M_PI
 #include <stdarg.h>                     // for va_arg, va_end, va_list, etc
 #include <stddef.h>                     // for size_t
 #include <stdio.h>                      // for fprintf, FILE, stderr
-#include <stdlib.h>                     // for free, exit, realloc
+#include <stdlib.h>                     // for free, exit, realloc, qsort
 #include <string.h>                     // for NULL, strcmp, memcpy
 #include <sys/types.h>                  // for uint
 #include "hkl-factory-private.h"
@@ -44,6 +44,62 @@
 #include "hkl/ccan/container_of/container_of.h"  // for container_of
 #include "hkl/ccan/darray/darray.h"     // for darray_foreach, darray_item, etc
 
+/* the generations of the axes and of the sources of all the geometries */
+static volatile gint hkl_geometry_gen;
+
+static int hkl_geometry_gen_next(void)
+{
+	return g_atomic_int_add(&hkl_geometry_gen, 1) + 1;
+}
+
+/*
+ * A copy of a geometry is allocated in one block: the HklGeometry,
+ * its axes, its holders, their partial rotations, then the arrays of
+ * pointers of the axes and holders darrays. Those darrays are views on the block and must not
+ * grow, so the axes and holders of a compact geometry are moved in
+ * their own allocations before adding one.
+ */
+static size_t hkl_geometry_compact_size(size_t n_axes, size_t n_holders,
+					size_t n_qs)
+{
+	return sizeof(HklGeometry)
+		+ n_axes * (sizeof(HklAxis) + sizeof(HklParameter *))
+		+ n_holders * (sizeof(HklHolder) + sizeof(HklHolder *))
+		+ n_qs * sizeof(HklQuaternion);
+}
+
+static void hkl_geometry_expand(HklGeometry *self)
+{
+	darray_parameter axes;
+	darray_holder holders;
+	HklParameter **axis;
+	HklHolder **holder;
+
+	if(!self->compact)
+		return;
+
+	darray_init(axes);
+	darray_foreach(axis, self->axes){
+		darray_append(axes, hkl_parameter_new_copy(*axis));
+	}
+
+	/* the holders configurations references are moved */
+	darray_init(holders);
+	darray_foreach(holder, self->holders){
+		HklHolder *dup = HKL_MALLOC(HklHolder);
+		const size_t len = (*holder)->config->len;
+
+		*dup = **holder;
+		dup->qs = malloc(len * sizeof(*dup->qs));
+		memcpy(dup->qs, (*holder)->qs, len * sizeof(*dup->qs));
+		darray_append(holders, dup);
+	}
+
+	self->axes = axes;
+	self->holders = holders;
+	self->compact = FALSE;
+}
+
 /*
  * Try to add a axis to the axes list,
  * if a identical axis is present in the list return it
@@ -76,6 +132,7 @@ static size_t hkl_geometry_add_rotation(HklGeometry *self,
 	}
 
 	/* no so create and add it to the list */
+	hkl_geometry_expand(self);
 	darray_append(self->axes, hkl_parameter_new_axis(name, axis_v, punit));
 
 	return darray_size(self->axes) - 1;
@@ -103,7 +160,7 @@ static struct HklHolderConfig *hkl_holder_config_ref(struct HklHolderConfig *sel
 	if(!self)
 		return NULL;
 
-	self->gc++;
+	g_atomic_int_inc(&self->gc);
 
 	return self;
 }
@@ -113,7 +170,7 @@ static void hkl_holder_config_unref(struct HklHolderConfig *self)
 	if(!self)
 		return;
 
-	if(--self->gc)
+	if(!g_atomic_int_dec_and_test(&self->gc))
 		return;
 
 	free(self->idx);
@@ -132,17 +189,7 @@ static HklHolder *hkl_holder_new(HklGeometry *geometry)
 	self->config = hkl_holder_config_new();
 	self->geometry = geometry;
 	self->q = q0;
-
-	return self;
-}
-
-static HklHolder *hkl_holder_new_copy(HklHolder *src, HklGeometry *geometry)
-{
-	HklHolder *self = HKL_MALLOC(HklHolder);
-
-	self->config = hkl_holder_config_ref(src->config);
-	self->geometry = geometry;
-	self->q = src->q;
+	self->qs = NULL;
 
 	return self;
 }
@@ -150,20 +197,36 @@ static HklHolder *hkl_holder_new_copy(HklHolder *src, HklGeometry *geometry)
 static void hkl_holder_free(HklHolder *self)
 {
 	hkl_holder_config_unref(self->config);
+	free(self->qs);
 	free(self);
 }
 
+/*
+ * only the rotations from the first changed axis of the holder are
+ * recomputed, the ones of the axes mounted before it are kept.
+ */
 static void hkl_holder_update(HklHolder *self)
 {
 	static HklQuaternion q0 = {{1, 0, 0, 0}};
+	const size_t len = self->config->len;
+	HklQuaternion q;
 	size_t i;
 
-	self->q = q0;
-	for(i=0; i<self->config->len; ++i)
-		hkl_quaternion_times_quaternion(&self->q,
+	for(i=0; i<len; ++i)
+		if(darray_item(self->geometry->axes, self->config->idx[i])->changed)
+			break;
+	if(i == len)
+		return;
+
+	q = i ? self->qs[i - 1] : q0;
+	for(; i<len; ++i){
+		hkl_quaternion_times_quaternion(&q,
 						&container_of(darray_item(self->geometry->axes,
 									  self->config->idx[i]),
 							      HklAxis, parameter)->q);
+		self->qs[i] = q;
+	}
+	self->q = q;
 }
 
 HklParameter *hkl_holder_add_rotation_axis(HklHolder *self,
@@ -184,6 +247,15 @@ HklParameter *hkl_holder_add_rotation_axis_with_punit(HklHolder *self,
 	axis_v.data[1] = y;
 	axis_v.data[2] = z;
 
+	/* the holders of a compact geometry move when it is expanded */
+	if(self->geometry->compact){
+		HklGeometry *geometry = self->geometry;
+
+		for(i=0; darray_item(geometry->holders, i) != self; ++i);
+		hkl_geometry_expand(geometry);
+		self = darray_item(geometry->holders, i);
+	}
+
 	idx = hkl_geometry_add_rotation(self->geometry, name, &axis_v, punit);
 
 	/* check that the axis is not already in the holder */
@@ -194,10 +266,46 @@ HklParameter *hkl_holder_add_rotation_axis_with_punit(HklHolder *self,
 	axis = darray_item(self->geometry->axes, idx);
 	self->config->idx = realloc(self->config->idx, sizeof(*self->config->idx) * (self->config->len + 1));
 	self->config->idx[self->config->len++] = idx;
+	self->qs = realloc(self->qs, sizeof(*self->qs) * self->config->len);
+
+	/* the partial rotations of the holder from this axis are unknown */
+	axis->changed = TRUE;
 
 	return axis;
 }
 
+/*
+ * compute the direction of one of the holder rotation axis in the
+ * laboratory frame (the normalized axis_v rotated by all the axes
+ * mounted before it). This is the vector needed to derivate the holder rotation
+ * relatively to this axis: d(R.v)/dx = axis_v_lab ^ R.v
+ *
+ * return FALSE if the axis is not part of the holder.
+ */
+int hkl_holder_axis_v_lab(const HklHolder *self, const HklParameter *axis,
+			  HklVector *axis_v)
+{
+	static HklQuaternion q0 = {{1, 0, 0, 0}};
+	HklQuaternion q = q0;
+	size_t i;
+
+	for(i=0; i<self->config->len; ++i){
+		HklAxis *tmp = container_of(darray_item(self->geometry->axes,
+							self->config->idx[i]),
+					    HklAxis, parameter);
+
+		if(&tmp->parameter == axis){
+			*axis_v = tmp->axis_v;
+			hkl_vector_normalize(axis_v);
+			hkl_vector_rotated_quaternion(axis_v, &q);
+			return TRUE;
+		}
+		hkl_quaternion_times_quaternion(&q, &tmp->q);
+	}
+
+	return FALSE;
+}
+
 /***************/
 /* HklGeometry */
 /***************/
@@ -219,10 +327,116 @@ HklGeometry *hkl_geometry_new(const HklFactory *factory)
 	hkl_source_init(&g->source, 1.54, 1, 0, 0);
 	darray_init(g->axes);
 	darray_init(g->holders);
+	g->gen_axes = hkl_geometry_gen_next();
+	g->gen_source = hkl_geometry_gen_next();
+	g->motion = HKL_GEOMETRY_MOTION_SIMULTANEOUS;
 
 	return g;
 }
 
+static size_t hkl_geometry_compact_size_get(const HklGeometry *src)
+{
+	size_t n_qs = 0;
+	HklHolder **holder;
+
+	darray_foreach(holder, src->holders){
+		n_qs += (*holder)->config->len;
+	}
+
+	return hkl_geometry_compact_size(darray_size(src->axes),
+					 darray_size(src->holders),
+					 n_qs);
+}
+
+/*
+ * lay a copy of src in the block of hkl_geometry_compact_size_get(src)
+ * bytes. The copy of a compact geometry is a memcpy of its block,
+ * then only the pointers into the block are fixed.
+ */
+static HklGeometry *hkl_geometry_init_compact(void *block, const HklGeometry *src)
+{
+	HklGeometry *self = block;
+	size_t i;
+	const size_t n_axes = darray_size(src->axes);
+	const size_t n_holders = darray_size(src->holders);
+	HklAxis *axes = (HklAxis *)(self + 1);
+	HklHolder *holders = (HklHolder *)(axes + n_axes);
+	HklQuaternion *qs = (HklQuaternion *)(holders + n_holders);
+	HklParameter **axes_p;
+	HklHolder **holders_p;
+
+	if(src->compact){
+		memcpy(self, src, hkl_geometry_compact_size_get(src));
+		for(i=0; i<n_holders; ++i){
+			holders[i].qs = qs;
+			qs += holders[i].config->len;
+		}
+	}else{
+		self->factory = src->factory;
+		self->source = src->source;
+		self->gen_axes = src->gen_axes;
+		self->gen_source = src->gen_source;
+		self->motion = src->motion;
+
+		for(i=0; i<n_axes; ++i)
+			axes[i] = *container_of(darray_item(src->axes, i), HklAxis, parameter);
+
+		for(i=0; i<n_holders; ++i){
+			const HklHolder *holder = darray_item(src->holders, i);
+			const size_t len = holder->config->len;
+
+			holders[i].config = holder->config;
+			holders[i].q = holder->q;
+			holders[i].qs = qs;
+			memcpy(qs, holder->qs, len * sizeof(*qs));
+			qs += len;
+		}
+		self->compact = TRUE;
+	}
+
+	axes_p = (HklParameter **)qs;
+	holders_p = (HklHolder **)(axes_p + n_axes);
+
+	for(i=0; i<n_axes; ++i)
+		axes_p[i] = &axes[i].parameter;
+	self->axes.item = axes_p;
+	self->axes.size = self->axes.alloc = n_axes;
+
+	for(i=0; i<n_holders; ++i){
+		hkl_holder_config_ref(holders[i].config);
+		holders[i].geometry = self;
+		holders_p[i] = &holders[i];
+	}
+	self->holders.item = holders_p;
+	self->holders.size = self->holders.alloc = n_holders;
+
+	return self;
+}
+
+/* release what the geometry owns but not its own memory */
+static void hkl_geometry_release(HklGeometry *self)
+{
+	HklParameter **axis;
+	HklHolder **holder;
+
+	if(self->compact){
+		darray_foreach(holder, self->holders){
+			hkl_holder_config_unref((*holder)->config);
+		}
+		return;
+	}
+
+	darray_foreach(axis, self->axes){
+		hkl_parameter_free(*axis);
+	}
+	darray_free(self->axes);
+
+	darray_foreach(holder, self->holders){
+		hkl_holder_free(*holder);
+	}
+	darray_free(self->holders);
+}
+
 /**
  * hkl_geometry_new_copy: (skip)
  * @self:
@@ -233,29 +447,44 @@ HklGeometry *hkl_geometry_new(const HklFactory *factory)
  **/
 HklGeometry *hkl_geometry_new_copy(const HklGeometry *src)
 {
-	HklGeometry *self = NULL;
-	HklParameter **axis;
-	HklHolder **holder;
-
 	if(!src)
-		return self;
+		return NULL;
 
-	self = HKL_MALLOC(HklGeometry);
+	return hkl_geometry_init_compact(_hkl_malloc(hkl_geometry_compact_size_get(src),
+						     "Can not allocate memory for an HklGeometry"),
+					 src);
+}
 
-	self->factory = src->factory;
-	self->source = src->source;
+/**
+ * hkl_geometry_new_copy_unshared: (skip)
+ * @src: the geometry to copy
+ *
+ * copy constructor which gives the copy its own holders
+ * configurations instead of sharing the ones of @src. The copies
+ * of the returned geometry share these private configurations, so a
+ * worker thread can copy it without touching the configurations of
+ * the caller.
+ *
+ * Returns: the new geometry
+ **/
+HklGeometry *hkl_geometry_new_copy_unshared(const HklGeometry *src)
+{
+	HklGeometry *self;
+	HklHolder **holder;
 
-	/* copy the axes */
-	darray_init(self->axes);
-	darray_foreach(axis, src->axes){
-		darray_append(self->axes, hkl_parameter_new_copy(*axis));
-	}
+	self = hkl_geometry_new_copy(src);
+	if(!self)
+		return NULL;
 
-	/* copy the holders */
-	darray_init(self->holders);
-	darray_foreach(holder, src->holders){
-		darray_append(self->holders,
-			      hkl_holder_new_copy(*holder, self));
+	darray_foreach(holder, self->holders){
+		struct HklHolderConfig *config = hkl_holder_config_new();
+		const size_t len = (*holder)->config->len;
+
+		config->idx = malloc(len * sizeof(*config->idx));
+		memcpy(config->idx, (*holder)->config->idx, len * sizeof(*config->idx));
+		config->len = len;
+		hkl_holder_config_unref((*holder)->config);
+		(*holder)->config = config;
 	}
 
 	return self;
@@ -269,19 +498,7 @@ HklGeometry *hkl_geometry_new_copy(const HklGeometry *src)
  **/
 void hkl_geometry_free(HklGeometry *self)
 {
-	HklParameter **axis;
-	HklHolder **holder;
-
-	darray_foreach(axis, self->axes){
-		hkl_parameter_free(*axis);
-	}
-	darray_free(self->axes);
-
-	darray_foreach(holder, self->holders){
-		hkl_holder_free(*holder);
-	}
-	darray_free(self->holders);
-
+	hkl_geometry_release(self);
 	free(self);
 }
 
@@ -300,12 +517,19 @@ int hkl_geometry_set(HklGeometry *self, const HklGeometry *src)
 
 	hkl_error(self->factory == src->factory);
 
+	if(!hkl_source_cmp(&self->source, &src->source))
+		self->gen_source = hkl_geometry_gen_next();
 	self->source = src->source;
+	self->motion = src->motion;
 
 	/* copy the axes configuration and mark it as dirty */
-	for(i=0; i<darray_size(self->axes); ++i)
-		hkl_parameter_init_copy(darray_item(self->axes, i),
-					darray_item(src->axes, i), NULL);
+	for(i=0; i<darray_size(self->axes); ++i){
+		HklParameter *axis = darray_item(self->axes, i);
+
+		if(axis->_value != darray_item(src->axes, i)->_value)
+			self->gen_axes = hkl_geometry_gen_next();
+		hkl_parameter_init_copy(axis, darray_item(src->axes, i), NULL);
+	}
 
 	for(i=0; i<darray_size(src->holders); ++i)
 		darray_item(self->holders, i)->q = darray_item(src->holders, i)->q;
@@ -338,14 +562,13 @@ const HklParameter *hkl_geometry_axis_get(const HklGeometry *self,
 					  const char *name,
 					  GError **error)
 {
-	HklParameter **axis;
+	int idx;
 
 	hkl_error (error == NULL || *error == NULL);
 
-	darray_foreach(axis, self->axes){
-		if (!strcmp((*axis)->name, name))
-			return *axis;
-	}
+	idx = hkl_geometry_get_axis_idx_by_name(self, name);
+	if(idx >= 0)
+		return darray_item(self->axes, idx);
 
 	g_set_error(error,
 		    HKL_GEOMETRY_ERROR,
@@ -432,11 +655,132 @@ int hkl_geometry_wavelength_set(HklGeometry *self, double wavelength,
 	/* for now there is no unit convertion but the unit_type is
 	 * there */
 
+	if(self->source.wave_length != wavelength)
+		self->gen_source = hkl_geometry_gen_next();
 	self->source.wave_length = wavelength;
 
 	return TRUE;
 }
 
+/**
+ * hkl_geometry_axis_kinematics_get:
+ * @self: the this ptr
+ * @name: the name of the axis
+ * @velocity: (out caller-allocates): the maximum velocity of the axis
+ * @acceleration: (out caller-allocates): the acceleration of the axis
+ * @unit_type: the unit type (default or user) of the returned values
+ * @error: return location for a GError, or NULL
+ *
+ * get the kinematic parameters of an axis, per second and per
+ * second square. 0 means unknown.
+ *
+ * Returns: TRUE on success, FALSE if an error occurred
+ **/
+int hkl_geometry_axis_kinematics_get(const HklGeometry *self, const char *name,
+				     double *velocity, double *acceleration,
+				     HklUnitEnum unit_type,
+				     GError **error)
+{
+	const HklParameter *parameter;
+	const HklAxis *axis;
+	double factor = 1.;
+
+	hkl_error (error == NULL || *error == NULL);
+
+	parameter = hkl_geometry_axis_get(self, name, error);
+	if(!parameter)
+		return FALSE;
+
+	axis = container_of(parameter, HklAxis, parameter);
+	if(unit_type == HKL_UNIT_USER)
+		factor = hkl_unit_factor(parameter->unit, parameter->punit);
+	*velocity = axis->velocity * factor;
+	*acceleration = axis->acceleration * factor;
+
+	return TRUE;
+}
+
+/**
+ * hkl_geometry_axis_kinematics_set:
+ * @self: the this ptr
+ * @name: the name of the axis
+ * @velocity: the maximum velocity of the axis, 0 if unknown
+ * @acceleration: the acceleration of the axis, 0 if infinite
+ * @unit_type: the unit type (default or user) of the values
+ * @error: return location for a GError, or NULL
+ *
+ * set the kinematic parameters of an axis, per second and per second
+ * square. They are used to estimate the move time of the solutions
+ * (see hkl_engine_list_ranking_set). An axis of unknown velocity
+ * moves at 1 radian per second.
+ *
+ * Returns: TRUE on success, FALSE if an error occurred
+ **/
+int hkl_geometry_axis_kinematics_set(HklGeometry *self, const char *name,
+				     double velocity, double acceleration,
+				     HklUnitEnum unit_type,
+				     GError **error)
+{
+	int idx;
+	HklParameter *parameter;
+	HklAxis *axis;
+	double factor = 1.;
+
+	hkl_error (error == NULL || *error == NULL);
+
+	idx = hkl_geometry_get_axis_idx_by_name(self, name);
+	if(idx < 0){
+		g_set_error(error,
+			    HKL_GEOMETRY_ERROR,
+			    HKL_GEOMETRY_ERROR_AXIS_SET,
+			    "this geometry does not contain this axis \"%s\"",
+			    name);
+		return FALSE;
+	}
+
+	if(velocity < 0 || acceleration < 0){
+		g_set_error(error,
+			    HKL_GEOMETRY_ERROR,
+			    HKL_GEOMETRY_ERROR_AXIS_SET,
+			    "the velocity and the acceleration of the axis \"%s\" can not be negative",
+			    name);
+		return FALSE;
+	}
+
+	parameter = darray_item(self->axes, idx);
+	axis = container_of(parameter, HklAxis, parameter);
+	if(unit_type == HKL_UNIT_USER)
+		factor = hkl_unit_factor(parameter->unit, parameter->punit);
+	axis->velocity = velocity / factor;
+	axis->acceleration = acceleration / factor;
+
+	return TRUE;
+}
+
+/**
+ * hkl_geometry_motion_get:
+ * @self: the this ptr
+ *
+ * Returns: how the axes of the geometry move.
+ **/
+HklGeometryMotion hkl_geometry_motion_get(const HklGeometry *self)
+{
+	return self->motion;
+}
+
+/**
+ * hkl_geometry_motion_set:
+ * @self: the this ptr
+ * @motion: the #HklGeometryMotion
+ *
+ * set if the axes of the geometry move all at the same time or one
+ * after the other.
+ **/
+void hkl_geometry_motion_set(HklGeometry *self, HklGeometryMotion motion)
+{
+	self->motion = motion;
+}
+
 /**
  * hkl_geometry_init_geometry: (skip)
  * @self: the this ptr
@@ -462,6 +806,8 @@ int hkl_geometry_init_geometry(HklGeometry *self, const HklGeometry *src)
 HklHolder *hkl_geometry_add_holder(HklGeometry *self)
 {
 	HklHolder *holder = hkl_holder_new(self);
+
+	hkl_geometry_expand(self);
 	darray_append(self->holders, holder);
 
 	return holder;
@@ -495,6 +841,8 @@ void hkl_geometry_update(HklGeometry *self)
 		darray_foreach(axis, self->axes){
 			(*axis)->changed = FALSE;
 		}
+
+		self->gen_axes = hkl_geometry_gen_next();
 	}
 }
 
@@ -514,17 +862,21 @@ const char *hkl_geometry_name_get(const HklGeometry *self)
  **/
 int hkl_geometry_get_axis_idx_by_name(const HklGeometry *self, const char *name)
 {
-	uint i = 0;
-	HklParameter **axis;
+	size_t i;
 
 	if (!self || !name)
 		return -1;
 
-	darray_foreach(axis, self->axes){
-		if (!strcmp((*axis)->name, name))
+	/* the axes names are the static strings also used by the
+	 * factories and the modes, most of the time the pointers are
+	 * identical and there is no need to compare the strings */
+	for(i=0; i<darray_size(self->axes); ++i)
+		if (darray_item(self->axes, i)->name == name)
+			return i;
+
+	for(i=0; i<darray_size(self->axes); ++i)
+		if (!strcmp(darray_item(self->axes, i)->name, name))
 			return i;
-		++i;
-	}
 
 	return -1;
 }
@@ -540,13 +892,9 @@ int hkl_geometry_get_axis_idx_by_name(const HklGeometry *self, const char *name)
  **/
 HklParameter *hkl_geometry_get_axis_by_name(HklGeometry *self, const char *name)
 {
-	HklParameter **axis;
+	int idx = hkl_geometry_get_axis_idx_by_name(self, name);
 
-	darray_foreach(axis, self->axes){
-		if (!strcmp((*axis)->name, name))
-			return (*axis);
-	}
-	return NULL;
+	return idx < 0 ? NULL : darray_item(self->axes, idx);
 }
 
 /**
@@ -722,6 +1070,53 @@ double hkl_geometry_distance_orthodromic(const HklGeometry *self,
 	return distance;
 }
 
+/* trapezoidal velocity profile */
+static double hkl_axis_move_time(const HklAxis *self, double distance)
+{
+	const double v = self->velocity > 0 ? self->velocity : 1.;
+	const double a = self->acceleration;
+
+	if(a <= 0)
+		return distance / v;
+	if(distance >= v * v / a)
+		return distance / v + v / a;
+	return 2 * sqrt(distance / a);
+}
+
+/**
+ * hkl_geometry_move_time: (skip)
+ * @self: the this ptr
+ * @ref: the #HklGeometry to move from
+ *
+ * estimate the time to move the axes from @ref to @self, with the
+ * axes kinematics and the motion of @self.
+ *
+ * Returns: the time in second.
+ **/
+double hkl_geometry_move_time(const HklGeometry *self,
+			      const HklGeometry *ref)
+{
+	size_t i;
+	double time = 0.;
+
+	if (!self || !ref)
+		return 0.;
+
+	for(i=0; i<darray_size(self->axes); ++i){
+		const HklParameter *axis = darray_item(self->axes, i);
+		const double distance = fabs(darray_item(ref->axes, i)->_value - axis->_value);
+		const double t = hkl_axis_move_time(container_of(axis, HklAxis, parameter),
+						    distance);
+
+		if(self->motion == HKL_GEOMETRY_MOTION_SEQUENTIAL)
+			time += t;
+		else if(t > time)
+			time = t;
+	}
+
+	return time;
+}
+
 /**
  * hkl_geometry_is_valid: (skip)
  * @self:
@@ -854,6 +1249,201 @@ void hkl_geometry_fprintf(FILE *file, const HklGeometry *self)
 /* HklGeometryList */
 /*******************/
 
+#define HKL_GEOMETRY_LIST_CHUNK_MIN 8
+
+/* followed by alloc slots */
+struct HklGeometryListChunk {
+	struct HklGeometryListChunk *next;
+	size_t len;
+	size_t alloc;
+};
+
+/*
+ * return a free slot of the list arena, n is a hint of the number of
+ * slots needed when a new chunk must be allocated.
+ */
+static void *hkl_geometry_list_slot_new(HklGeometryList *self, size_t n)
+{
+	struct HklGeometryListChunk *chunk;
+	struct HklGeometryListChunk **last = &self->chunks;
+	size_t alloc = 0;
+
+	for(chunk=self->chunks; chunk; chunk=chunk->next){
+		if(chunk->len < chunk->alloc)
+			return (char *)(chunk + 1) + chunk->len++ * self->slot;
+		alloc = chunk->alloc;
+		last = &chunk->next;
+	}
+
+	if(n < 2 * alloc)
+		n = 2 * alloc;
+	if(n < HKL_GEOMETRY_LIST_CHUNK_MIN)
+		n = HKL_GEOMETRY_LIST_CHUNK_MIN;
+
+	chunk = _hkl_malloc(sizeof(*chunk) + n * self->slot,
+			    "Can not allocate memory for an HklGeometryList");
+	chunk->next = NULL;
+	chunk->len = 1;
+	chunk->alloc = n;
+	*last = chunk;
+
+	return chunk + 1;
+}
+
+static HklGeometryListItem *hkl_geometry_list_item_new_in(HklGeometryList *self,
+							  const HklGeometry *geometry,
+							  size_t n)
+{
+	HklGeometryListItem *item;
+	const size_t slot = sizeof(*item) + hkl_geometry_compact_size_get(geometry);
+
+	if(!self->slot)
+		self->slot = slot;
+
+	/* the geometries of another shape do not fit in the slots */
+	if(slot != self->slot)
+		return hkl_geometry_list_item_new(geometry);
+
+	item = hkl_geometry_list_slot_new(self, n);
+	item->geometry = hkl_geometry_init_compact(item + 1, geometry);
+	item->arena = TRUE;
+
+	return item;
+}
+
+static void hkl_geometry_list_item_release(HklGeometryListItem *item)
+{
+	if(item->arena)
+		hkl_geometry_release(item->geometry);
+	else
+		hkl_geometry_list_item_free(item);
+}
+
+/*
+ * The geometries equal to less than HKL_EPSILON (orthodromic distance)
+ * are found with a hash of their axes values quantized in
+ * HKL_GEOMETRY_LIST_HASH_CELLS cells per turn. A geometry has the
+ * cells of its duplicates, except for the axes values closer than
+ * HKL_EPSILON to a cell boundary, the neighbour cell is then also
+ * looked up.
+ */
+#define HKL_GEOMETRY_LIST_HASH_CELLS (1 << 16)
+#define HKL_GEOMETRY_LIST_HASH_MIN 64
+
+static size_t hkl_geometry_list_hash_cells(const HklGeometry *geometry,
+					   unsigned int cells[], int shifts[])
+{
+	const double h = 2 * M_PI / HKL_GEOMETRY_LIST_HASH_CELLS;
+	size_t i;
+
+	for(i=0; i<darray_size(geometry->axes); ++i){
+		const double x = gsl_sf_angle_restrict_pos(darray_item(geometry->axes, i)->_value) / h;
+		const double frac = x - floor(x);
+
+		cells[i] = (unsigned int)floor(x) % HKL_GEOMETRY_LIST_HASH_CELLS;
+		if(shifts){
+			shifts[i] = 0;
+			if(frac * h < HKL_EPSILON)
+				shifts[i] = -1;
+			else if((1. - frac) * h < HKL_EPSILON)
+				shifts[i] = 1;
+		}
+	}
+
+	return i;
+}
+
+static size_t hkl_geometry_list_hash_key(const unsigned int cells[], size_t n)
+{
+	size_t i;
+	size_t key = 5381;
+
+	for(i=0; i<n; ++i)
+		key = (key * 33) ^ cells[i];
+
+	return key;
+}
+
+static void hkl_geometry_list_hash_insert(HklGeometryList *self,
+					  HklGeometryListItem *item)
+{
+	const size_t n = darray_size(item->geometry->axes);
+	unsigned int *cells = alloca(n * sizeof(*cells));
+	HklGeometryListItem **bucket;
+
+	hkl_geometry_list_hash_cells(item->geometry, cells, NULL);
+	item->key = hkl_geometry_list_hash_key(cells, n);
+	bucket = &self->buckets[item->key & (self->n_buckets - 1)];
+	item->hash_next = *bucket;
+	*bucket = item;
+}
+
+static void hkl_geometry_list_hash_rebuild(HklGeometryList *self)
+{
+	HklGeometryListItem *item;
+	size_t n_buckets = HKL_GEOMETRY_LIST_HASH_MIN;
+
+	while(n_buckets <= 2 * self->n_items)
+		n_buckets *= 2;
+
+	if(n_buckets != self->n_buckets){
+		free(self->buckets);
+		self->buckets = malloc(n_buckets * sizeof(*self->buckets));
+		self->n_buckets = n_buckets;
+	}
+	memset(self->buckets, 0, n_buckets * sizeof(*self->buckets));
+
+	list_for_each(&self->items, item, list){
+		hkl_geometry_list_hash_insert(self, item);
+	}
+	self->hash_valid = TRUE;
+}
+
+static const HklGeometryListItem *hkl_geometry_list_hash_find_r(const HklGeometryList *self,
+								const HklGeometry *geometry,
+								unsigned int cells[],
+								const int shifts[],
+								size_t n, size_t i)
+{
+	const HklGeometryListItem *found;
+
+	if(i == n){
+		const size_t key = hkl_geometry_list_hash_key(cells, n);
+
+		for(found = self->buckets[key & (self->n_buckets - 1)];
+		    found;
+		    found = found->hash_next)
+			if(found->key == key
+			   && hkl_geometry_distance_orthodromic(geometry,
+								found->geometry) < HKL_EPSILON)
+				return found;
+		return NULL;
+	}
+
+	found = hkl_geometry_list_hash_find_r(self, geometry, cells, shifts, n, i + 1);
+	if(!found && shifts[i]){
+		const unsigned int cell = cells[i];
+
+		cells[i] = (cell + HKL_GEOMETRY_LIST_HASH_CELLS + shifts[i]) % HKL_GEOMETRY_LIST_HASH_CELLS;
+		found = hkl_geometry_list_hash_find_r(self, geometry, cells, shifts, n, i + 1);
+		cells[i] = cell;
+	}
+
+	return found;
+}
+
+static const HklGeometryListItem *hkl_geometry_list_hash_find(const HklGeometryList *self,
+							      const HklGeometry *geometry)
+{
+	const size_t n = darray_size(geometry->axes);
+	unsigned int *cells = alloca(n * sizeof(*cells));
+	int *shifts = alloca(n * sizeof(*shifts));
+
+	hkl_geometry_list_hash_cells(geometry, cells, shifts);
+
+	return hkl_geometry_list_hash_find_r(self, geometry, cells, shifts, n, 0);
+}
+
 /**
  * hkl_geometry_list_new: (skip)
  *
@@ -870,6 +1460,14 @@ HklGeometryList *hkl_geometry_list_new(void)
 	list_head_init(&self->items);
 	self->n_items = 0;
 	self->multiply = NULL;
+	self->n_items_max = 0;
+	self->variants_lazy = FALSE;
+	self->ranking = HKL_ENGINE_LIST_RANKING_DISTANCE;
+	self->buckets = NULL;
+	self->n_buckets = 0;
+	self->hash_valid = FALSE;
+	self->slot = 0;
+	self->chunks = NULL;
 
 	return self;
 }
@@ -890,15 +1488,18 @@ HklGeometryList *hkl_geometry_list_new_copy(const HklGeometryList *self)
 	if (!self)
 		return NULL;
 
-	dup = HKL_MALLOC(HklGeometryList);
+	dup = hkl_geometry_list_new();
 
-	list_head_init(&dup->items);
-	/* now copy the item arrays */
+	/* now copy the items, all in one chunk */
 	list_for_each(&self->items, item, list){
 		list_add_tail(&dup->items,
-			      &hkl_geometry_list_item_new_copy(item)->list);
+			      &hkl_geometry_list_item_new_in(dup, item->geometry,
+							     self->n_items)->list);
 	}
 	dup->n_items = self->n_items;
+	dup->n_items_max = self->n_items_max;
+	dup->variants_lazy = self->variants_lazy;
+	dup->ranking = self->ranking;
 	dup->multiply = self->multiply;
 
 	return dup;
@@ -912,7 +1513,15 @@ HklGeometryList *hkl_geometry_list_new_copy(const HklGeometryList *self)
  **/
 void hkl_geometry_list_free(HklGeometryList *self)
 {
+	struct HklGeometryListChunk *chunk;
+	struct HklGeometryListChunk *next;
+
 	hkl_geometry_list_reset(self);
+	for(chunk=self->chunks; chunk; chunk=next){
+		next = chunk->next;
+		free(chunk);
+	}
+	free(self->buckets);
 	free(self);
 }
 
@@ -933,15 +1542,32 @@ void hkl_geometry_list_add(HklGeometryList *self, HklGeometry *geometry)
 	HklGeometryListItem *item;
 
 	/* now check if the geometry is already in the geometry list */
-	list_for_each(&self->items, item, list){
-		if (hkl_geometry_distance_orthodromic(geometry,
-						      item->geometry) < HKL_EPSILON)
-			return;
-	}
+	if(!self->hash_valid || 2 * self->n_items >= self->n_buckets)
+		hkl_geometry_list_hash_rebuild(self);
+	if(hkl_geometry_list_hash_find(self, geometry))
+		return;
+
+	item = hkl_geometry_list_item_new_in(self, geometry, 0);
+	list_add_tail(&self->items, &item->list);
+	self->n_items += 1;
+	hkl_geometry_list_hash_insert(self, item);
+}
 
+/**
+ * hkl_geometry_list_append: (skip)
+ * @self: The current #HklGeometryList
+ * @geometry: the #HklGeometry to append
+ *
+ * append a copy of the geometry at the end of the list, even if an
+ * identical geometry is already in the list. Use it when the list is
+ * an ordered sequence of positions (trajectories).
+ **/
+void hkl_geometry_list_append(HklGeometryList *self, const HklGeometry *geometry)
+{
 	list_add_tail(&self->items,
-		      &hkl_geometry_list_item_new(geometry)->list);
+		      &hkl_geometry_list_item_new_in(self, geometry, 0)->list);
 	self->n_items += 1;
+	self->hash_valid = FALSE;
 }
 
 /**
@@ -996,12 +1622,57 @@ void hkl_geometry_list_reset(HklGeometryList *self)
 {
 	HklGeometryListItem *item;
 	HklGeometryListItem *next;
+	struct HklGeometryListChunk *chunk;
 
 	list_for_each_safe(&self->items, item, next, list)
-		hkl_geometry_list_item_free(item);
+		hkl_geometry_list_item_release(item);
 
 	list_head_init(&self->items);
 	self->n_items = 0;
+	self->hash_valid = FALSE;
+
+	/* keep the chunks for the next solutions */
+	for(chunk=self->chunks; chunk; chunk=chunk->next)
+		chunk->len = 0;
+}
+
+struct HklGeometryListSortEntry {
+	double distance;
+	size_t idx;
+	HklGeometryListItem *item;
+};
+
+/* the distances closer than HKL_EPSILON are equal, they keep the
+ * order of the list */
+static inline int hkl_geometry_list_sort_cmp(const struct HklGeometryListSortEntry *ea,
+					     const struct HklGeometryListSortEntry *eb)
+{
+	if(fabs(ea->distance - eb->distance) > HKL_EPSILON)
+		return ea->distance < eb->distance ? -1 : 1;
+	return (ea->idx > eb->idx) - (ea->idx < eb->idx);
+}
+
+/* restore the max-heap of the n first entries from the root i */
+static void hkl_geometry_list_sort_sift_down(struct HklGeometryListSortEntry entries[],
+					     size_t i, size_t n)
+{
+	for(;;){
+		size_t max = i;
+		size_t child = 2 * i + 1;
+		struct HklGeometryListSortEntry tmp;
+
+		if(child < n && hkl_geometry_list_sort_cmp(&entries[child], &entries[max]) > 0)
+			max = child;
+		if(child + 1 < n && hkl_geometry_list_sort_cmp(&entries[child + 1], &entries[max]) > 0)
+			max = child + 1;
+		if(max == i)
+			return;
+
+		tmp = entries[i];
+		entries[i] = entries[max];
+		entries[max] = tmp;
+		i = max;
+	}
 }
 
 /**
@@ -1010,43 +1681,71 @@ void hkl_geometry_list_reset(HklGeometryList *self)
  * @ref:
  *
  * sort the #HklGeometryList compare to the distance of the given
- * #HklGeometry
+ * #HklGeometry, or to the time to move from it depending on the
+ * ranking. If n_items_max is set only the n_items_max closest
+ * geometries are kept.
+ *
+ * The n closest entries are selected with a max-heap of size n, so
+ * the other ones are only compared once with its top, then the heap
+ * is sorted in place.
  **/
 void hkl_geometry_list_sort(HklGeometryList *self, HklGeometry *ref)
 {
-	double *distances = alloca(self->n_items * sizeof(*distances));
-	size_t *idx = alloca(self->n_items * sizeof(*idx));
-	HklGeometryListItem **items = alloca(self->n_items * sizeof(*items));
+	struct HklGeometryListSortEntry *entries;
+	struct HklGeometryListSortEntry tmp;
 	HklGeometryListItem *item;
-	int i = 0;
-	size_t x;
-	int j, p;
+	size_t i = 0;
+	size_t n;
+
+	if(self->n_items == 0)
+		return;
+
+	entries = malloc(self->n_items * sizeof(*entries));
 
 	/* compute the distances once for all */
 	list_for_each(&self->items, item, list){
-		distances[i] = hkl_geometry_distance(ref, item->geometry);
-		idx[i] = i;
-		items[i] = item;
+		if(self->ranking == HKL_ENGINE_LIST_RANKING_MOVE_TIME)
+			entries[i].distance = hkl_geometry_move_time(item->geometry, ref);
+		else
+			entries[i].distance = hkl_geometry_distance(ref, item->geometry);
+		entries[i].idx = i;
+		entries[i].item = item;
 		i++;
 	}
 
-	/* insertion sorting */
-	for(i=1; i<self->n_items; ++i){
-		x = idx[i];
-		/* find the smallest idx p lower than i with distance[idx[p]] >= distance[x] */
-		for(p = 0; distances[idx[p]] < distances[x] && fabs(distances[idx[p]] - distances[x]) > HKL_EPSILON; p++);
-
-		/* move everythings in between p and i */
-		for(j=i-1; j>=p; j--)
-			idx[j+1] = idx[j];
+	n = self->n_items;
+	if(self->n_items_max && self->n_items_max < n)
+		n = self->n_items_max;
+
+	/* keep the n closest in the heap */
+	for(i=n/2; i>0; --i)
+		hkl_geometry_list_sort_sift_down(entries, i - 1, n);
+	for(i=n; i<self->n_items; ++i)
+		if(hkl_geometry_list_sort_cmp(&entries[i], &entries[0]) < 0){
+			tmp = entries[0];
+			entries[0] = entries[i];
+			entries[i] = tmp;
+			hkl_geometry_list_sort_sift_down(entries, 0, n);
+		}
 
-		idx[p] = x; /* insert the saved idx */
+	/* heap sort of the kept ones */
+	for(i=n-1; i>0; --i){
+		tmp = entries[0];
+		entries[0] = entries[i];
+		entries[i] = tmp;
+		hkl_geometry_list_sort_sift_down(entries, 0, i);
 	}
 
 	list_head_init(&self->items);
+	for(i=0; i<n; ++i)
+		list_add_tail(&self->items, &entries[i].item->list);
+	for(; i<self->n_items; ++i){
+		hkl_geometry_list_item_release(entries[i].item);
+		self->hash_valid = FALSE;
+	}
+	self->n_items = n;
 
-	for(i=0; i<self->n_items; ++i)
-		list_add_tail(&self->items, &items[idx[i]]->list);
+	free(entries);
 }
 
 /**
@@ -1133,8 +1832,9 @@ static void perm_r(HklGeometryList *self, const HklGeometry *ref,
 	if (axis_idx == darray_size(geometry->axes)){
 		if(hkl_geometry_distance(geometry, ref) > HKL_EPSILON){
 			list_add_tail(&self->items,
-				      &hkl_geometry_list_item_new(geometry)->list);
+				      &hkl_geometry_list_item_new_in(self, geometry, 0)->list);
 			self->n_items++;
+			self->hash_valid = FALSE;
 		}
 	}else{
 		if(perm[axis_idx]){
@@ -1167,7 +1867,19 @@ static void perm_r(HklGeometryList *self, const HklGeometry *ref,
 	}
 }
 
-void hkl_geometry_list_multiply_from_range(HklGeometryList *self)
+/**
+ * hkl_geometry_list_multiply_from_range: (skip)
+ * @self: the this ptr
+ * @ref: (allow-none): the geometry the lazy variants are the closest
+ *       to, NULL for the solutions themselves.
+ *
+ * add the variants of the solutions (axes values modulo 2*pi) in the
+ * axes ranges. A lazy list keeps only the variant of each solution
+ * closest to @ref, so its first solution once sorted from @ref is the
+ * one of the eager list.
+ **/
+void hkl_geometry_list_multiply_from_range(HklGeometryList *self,
+					   const HklGeometry *ref)
 {
 	uint i;
 	uint len = self->n_items;
@@ -1177,6 +1889,23 @@ void hkl_geometry_list_multiply_from_range(HklGeometryList *self)
 	if(!self)
 		return;
 
+	/* keep only the closest variant, see HklGeometryVariants */
+	if(self->variants_lazy){
+		list_for_each(&self->items, item, list){
+			HklParameter **axis;
+
+			darray_foreach(axis, item->geometry->axes){
+				if(hkl_parameter_is_valid(*axis))
+					hkl_parameter_value_set_smallest_in_range(*axis);
+			}
+			hkl_geometry_update(item->geometry);
+			hkl_geometry_closest_from_geometry_with_range(item->geometry,
+								      ref ? ref : item->geometry);
+		}
+		self->hash_valid = FALSE;
+		return;
+	}
+
 	/*
 	 * warning this method change the self->len so we need to save it
 	 * before using the recursive perm_r calls
@@ -1224,8 +1953,164 @@ void hkl_geometry_list_remove_invalid(HklGeometryList *self)
 		if(!hkl_geometry_is_valid_range(item->geometry)){
 			list_del(&item->list);
 			self->n_items--;
-			hkl_geometry_list_item_free(item);
+			hkl_geometry_list_item_release(item);
+			self->hash_valid = FALSE;
+		}
+}
+
+/***********************/
+/* HklGeometryVariants */
+/***********************/
+
+struct HklGeometryVariantsEntry {
+	double distance;
+	size_t idx;
+};
+
+static int hkl_geometry_variants_cmp(const void *a, const void *b)
+{
+	const struct HklGeometryVariantsEntry *ea = a;
+	const struct HklGeometryVariantsEntry *eb = b;
+
+	if(ea->distance < eb->distance)
+		return -1;
+	if(ea->distance > eb->distance)
+		return 1;
+	return (ea->idx > eb->idx) - (ea->idx < eb->idx);
+}
+
+/* the axes values of the idx variant, the last axis changes first */
+static void hkl_geometry_variants_values(const HklGeometryVariants *self,
+					 size_t idx, double values[])
+{
+	size_t i;
+
+	for(i=self->n_axes; i>0; --i){
+		values[i-1] = self->starts[i-1] + 2*M_PI * (idx % self->lens[i-1]);
+		idx /= self->lens[i-1];
+	}
+}
+
+/**
+ * hkl_geometry_variants_new:
+ * @geometry: the #HklGeometry
+ * @ref: (allow-none): enumerate the closest variants of @ref first
+ *
+ * enumerate the variants of @geometry, the geometries with the same
+ * axes values modulo 2*pi and in the axes ranges. This is the lazy
+ * version of the range multiplication of the solutions, only the
+ * variants returned by hkl_geometry_variants_next are computed.
+ *
+ * Returns: the variants enumerator, free it with hkl_geometry_variants_free.
+ **/
+HklGeometryVariants *hkl_geometry_variants_new(const HklGeometry *geometry,
+					       const HklGeometry *ref)
+{
+	HklGeometryVariants *self;
+	size_t i;
+
+	self = HKL_MALLOC(HklGeometryVariants);
+
+	self->geometry = hkl_geometry_new_copy(geometry);
+	self->n_axes = darray_size(geometry->axes);
+	self->starts = malloc(self->n_axes * sizeof(*self->starts));
+	self->lens = malloc(self->n_axes * sizeof(*self->lens));
+	self->values = malloc(self->n_axes * sizeof(*self->values));
+	self->n = 1;
+	self->next = 0;
+	self->order = NULL;
+
+	for(i=0; i<self->n_axes; ++i){
+		HklParameter *axis = darray_item(self->geometry->axes, i);
+
+		self->lens[i] = 1;
+		if(hkl_parameter_is_valid(axis)){
+			hkl_parameter_value_set_smallest_in_range(axis);
+			self->lens[i] += floor((axis->range.max + HKL_EPSILON - axis->_value) / (2*M_PI));
+		}
+		self->starts[i] = axis->_value;
+		self->n *= self->lens[i];
+	}
+
+	/* the distances are computed from the axes values only */
+	if(ref){
+		struct HklGeometryVariantsEntry *entries;
+		size_t idx;
+
+		entries = malloc(self->n * sizeof(*entries));
+		for(idx=0; idx<self->n; ++idx){
+			entries[idx].distance = 0.;
+			entries[idx].idx = idx;
+			hkl_geometry_variants_values(self, idx, self->values);
+			for(i=0; i<self->n_axes; ++i)
+				entries[idx].distance += fabs(self->values[i]
+							      - darray_item(ref->axes, i)->_value);
 		}
+		qsort(entries, self->n, sizeof(*entries), hkl_geometry_variants_cmp);
+
+		self->order = malloc(self->n * sizeof(*self->order));
+		for(idx=0; idx<self->n; ++idx)
+			self->order[idx] = entries[idx].idx;
+		free(entries);
+	}
+
+	return self;
+}
+
+/**
+ * hkl_geometry_variants_free:
+ * @self: the this ptr
+ *
+ * destructor
+ **/
+void hkl_geometry_variants_free(HklGeometryVariants *self)
+{
+	hkl_geometry_free(self->geometry);
+	free(self->starts);
+	free(self->lens);
+	free(self->values);
+	free(self->order);
+	free(self);
+}
+
+/**
+ * hkl_geometry_variants_n_get:
+ * @self: the this ptr
+ *
+ * Return value: the number of variants
+ **/
+size_t hkl_geometry_variants_n_get(const HklGeometryVariants *self)
+{
+	return self->n;
+}
+
+/**
+ * hkl_geometry_variants_next:
+ * @self: the this ptr
+ *
+ * compute the next variant. The returned geometry belongs to the
+ * enumerator and is overwritten by the next call, copy it with
+ * hkl_geometry_new_copy to keep it.
+ *
+ * Returns: (allow-none): the next variant or NULL at the end.
+ **/
+const HklGeometry *hkl_geometry_variants_next(HklGeometryVariants *self)
+{
+	size_t idx;
+
+	if(self->next >= self->n)
+		return NULL;
+
+	idx = self->order ? self->order[self->next] : self->next;
+	self->next++;
+
+	hkl_geometry_variants_values(self, idx, self->values);
+	if(!hkl_geometry_axis_values_set(self->geometry,
+					 self->values, self->n_axes,
+					 HKL_UNIT_DEFAULT, NULL))
+		return NULL;
+
+	return self->geometry;
 }
 
 /***********************/
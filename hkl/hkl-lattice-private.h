@@ -56,6 +56,8 @@ extern void hkl_lattice_randomize(HklLattice *self);
 
 extern void hkl_lattice_fprintf(FILE *f, const HklLattice *self);
 
+extern int hkl_lattice_compute_B(const double values[6], HklMatrix *B, HklMatrix *dB);
+
 G_END_DECLS
 
 #endif /* __HKL_LATTICE_PRIVATE_H__ */
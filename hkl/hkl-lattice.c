@@ -22,6 +22,7 @@
 #include <math.h>                       // for cos, sin, M_PI, atan2, sqrt
 #include <stdio.h>                      // for fprintf, FILE
 #include <stdlib.h>                     // for NULL, free
+#include <string.h>                     // for memset
 #include "hkl-lattice-private.h"        // for _HklLattice
 #include "hkl-macros-private.h"         // for HKL_MALLOC
 #include "hkl-matrix-private.h"         // for _HklMatrix
@@ -458,25 +459,31 @@ void hkl_lattice_get(const HklLattice *self,
 }
 
 /**
- * hkl_lattice_get_B: (skip)
- * @self:
+ * hkl_lattice_compute_B: (skip)
+ * @values: the a, b, c, alpha, beta, gamma lattice parameters
  * @B: (out): where to store the B matrix
+ * @dB: (out) (allow-none): where to store the six derivatives of B with
+ * respect to each lattice parameter
  *
- * Get the B matrix from the lattice parameters
+ * Compute the B matrix and its derivatives from the lattice
+ * parameters values, in the default units.
  *
- * Returns:
+ * Returns: FALSE if the lattice parameters are not valid
  **/
-int hkl_lattice_get_B(const HklLattice *self, HklMatrix *B)
+int hkl_lattice_compute_B(const double values[6], HklMatrix *B, HklMatrix *dB)
 {
 	double D;
 	double c_alpha, s_alpha;
 	double c_beta, s_beta;
 	double c_gamma, s_gamma;
 	double b11, b22, tmp;
+	const double a = values[0];
+	const double b = values[1];
+	const double c = values[2];
 
-	c_alpha = cos(hkl_parameter_value_get(self->alpha, HKL_UNIT_DEFAULT));
-	c_beta = cos(hkl_parameter_value_get(self->beta, HKL_UNIT_DEFAULT));
-	c_gamma = cos(hkl_parameter_value_get(self->gamma, HKL_UNIT_DEFAULT));
+	c_alpha = cos(values[3]);
+	c_beta = cos(values[4]);
+	c_gamma = cos(values[5]);
 	D = 1 - c_alpha*c_alpha - c_beta*c_beta - c_gamma*c_gamma
 		+ 2*c_alpha*c_beta*c_gamma;
 
@@ -485,15 +492,15 @@ int hkl_lattice_get_B(const HklLattice *self, HklMatrix *B)
 	else
 		return FALSE;
 
-	s_alpha = sin(hkl_parameter_value_get(self->alpha, HKL_UNIT_DEFAULT));
-	s_beta  = sin(hkl_parameter_value_get(self->beta, HKL_UNIT_DEFAULT));
-	s_gamma = sin(hkl_parameter_value_get(self->gamma, HKL_UNIT_DEFAULT));
+	s_alpha = sin(values[3]);
+	s_beta  = sin(values[4]);
+	s_gamma = sin(values[5]);
 
-	b11 = HKL_TAU / (hkl_parameter_value_get(self->b, HKL_UNIT_DEFAULT) * s_alpha);
-	b22 = HKL_TAU / hkl_parameter_value_get(self->c, HKL_UNIT_DEFAULT);
+	b11 = HKL_TAU / (b * s_alpha);
+	b22 = HKL_TAU / c;
 	tmp = b22 / s_alpha;
 
-	B->data[0][0] = HKL_TAU * s_alpha / (hkl_parameter_value_get(self->a, HKL_UNIT_DEFAULT) * D);
+	B->data[0][0] = HKL_TAU * s_alpha / (a * D);
 	B->data[0][1] = b11 / D * (c_alpha*c_beta - c_gamma);
 	B->data[0][2] = tmp / D * (c_gamma*c_alpha - c_beta);
 
@@ -505,9 +512,76 @@ int hkl_lattice_get_B(const HklLattice *self, HklMatrix *B)
 	B->data[2][1] = 0;
 	B->data[2][2] = b22;
 
+	if (dB){
+		size_t i;
+		/* derivatives of D, of the numerators and the
+		 * denominators of B01, B02 and B12 with respect to
+		 * alpha, beta and gamma */
+		const double dD[3] = {s_alpha * (c_alpha - c_beta*c_gamma) / D,
+				      s_beta * (c_beta - c_alpha*c_gamma) / D,
+				      s_gamma * (c_gamma - c_alpha*c_beta) / D};
+		const double ds_alpha[3] = {c_alpha, 0, 0};
+		const double n01 = c_alpha*c_beta - c_gamma;
+		const double dn01[3] = {-s_alpha*c_beta, -c_alpha*s_beta, s_gamma};
+		const double n02 = c_gamma*c_alpha - c_beta;
+		const double dn02[3] = {-c_gamma*s_alpha, s_beta, -s_gamma*c_alpha};
+		const double n12 = c_beta*c_gamma - c_alpha;
+		const double dn12[3] = {s_alpha, -s_beta*c_gamma, -c_beta*s_gamma};
+		const double m = s_alpha * D;
+		const double m12 = s_alpha * s_beta * s_gamma;
+		const double dm12[3] = {c_alpha*s_beta*s_gamma,
+					s_alpha*c_beta*s_gamma,
+					s_alpha*s_beta*c_gamma};
+
+		memset(dB, 0, 6 * sizeof(*dB));
+
+		dB[0].data[0][0] = -B->data[0][0] / a;
+
+		dB[1].data[0][1] = -B->data[0][1] / b;
+		dB[1].data[1][1] = -B->data[1][1] / b;
+
+		dB[2].data[0][2] = -B->data[0][2] / c;
+		dB[2].data[1][2] = -B->data[1][2] / c;
+		dB[2].data[2][2] = -B->data[2][2] / c;
+
+		for(i=0; i<3; ++i){
+			HklMatrix *M = &dB[3 + i];
+			const double dm = ds_alpha[i] * D + s_alpha * dD[i];
+
+			M->data[0][0] = HKL_TAU / a * (ds_alpha[i] * D - s_alpha * dD[i]) / (D * D);
+			M->data[0][1] = HKL_TAU / b * (dn01[i] * m - n01 * dm) / (m * m);
+			M->data[0][2] = HKL_TAU / c * (dn02[i] * m - n02 * dm) / (m * m);
+			M->data[1][1] = -HKL_TAU / b * ds_alpha[i] / (s_alpha * s_alpha);
+			M->data[1][2] = HKL_TAU / c * (dn12[i] * m12 - n12 * dm12[i]) / (m12 * m12);
+		}
+	}
+
 	return TRUE;
 }
 
+/**
+ * hkl_lattice_get_B: (skip)
+ * @self:
+ * @B: (out): where to store the B matrix
+ *
+ * Get the B matrix from the lattice parameters
+ *
+ * Returns:
+ **/
+int hkl_lattice_get_B(const HklLattice *self, HklMatrix *B)
+{
+	const double values[6] = {
+		hkl_parameter_value_get(self->a, HKL_UNIT_DEFAULT),
+		hkl_parameter_value_get(self->b, HKL_UNIT_DEFAULT),
+		hkl_parameter_value_get(self->c, HKL_UNIT_DEFAULT),
+		hkl_parameter_value_get(self->alpha, HKL_UNIT_DEFAULT),
+		hkl_parameter_value_get(self->beta, HKL_UNIT_DEFAULT),
+		hkl_parameter_value_get(self->gamma, HKL_UNIT_DEFAULT),
+	};
+
+	return hkl_lattice_compute_B(values, B, NULL);
+}
+
 /**
  * hkl_lattice_get_1_B: (skip)
  * @self: the @HklLattice
@@ -248,6 +248,63 @@ void hkl_matrix_init_from_euler(HklMatrix *self,
 	M[2][2] = A *C;
 }
 
+/**
+ * hkl_matrix_init_from_euler_derivatives:
+ * @self: (array fixed-size=3): the three #HklMatrix to initialize
+ * @euler_x: the eulerian value along X
+ * @euler_y: the eulerian value along Y
+ * @euler_z: the eulerian value along Z
+ *
+ * Compute the derivatives of the rotation #HklMatrix created by
+ * hkl_matrix_init_from_euler with respect to each eulerian angle.
+ **/
+void hkl_matrix_init_from_euler_derivatives(HklMatrix self[3],
+					    double euler_x, double euler_y, double euler_z)
+{
+	double (*Mx)[3] = self[0].data;
+	double (*My)[3] = self[1].data;
+	double (*Mz)[3] = self[2].data;
+
+	double A = cos(euler_x);
+	double B = sin(euler_x);
+	double C = cos(euler_y);
+	double D = sin(euler_y);
+	double E = cos(euler_z);
+	double F = sin(euler_z);
+	double AD = A *D;
+	double BD = B *D;
+
+	Mx[0][0] = 0;
+	Mx[0][1] = 0;
+	Mx[0][2] = 0;
+	Mx[1][0] = AD *E - B *F;
+	Mx[1][1] =-AD *F - B *E;
+	Mx[1][2] =-A *C;
+	Mx[2][0] = BD *E + A *F;
+	Mx[2][1] =-BD *F + A *E;
+	Mx[2][2] =-B *C;
+
+	My[0][0] =-D*E;
+	My[0][1] = D*F;
+	My[0][2] = C;
+	My[1][0] = B *C *E;
+	My[1][1] =-B *C *F;
+	My[1][2] = BD;
+	My[2][0] =-A *C *E;
+	My[2][1] = A *C *F;
+	My[2][2] =-AD;
+
+	Mz[0][0] =-C*F;
+	Mz[0][1] =-C*E;
+	Mz[0][2] = 0;
+	Mz[1][0] =-BD *F + A *E;
+	Mz[1][1] =-BD *E - A *F;
+	Mz[1][2] = 0;
+	Mz[2][0] = AD *F + B *E;
+	Mz[2][1] = AD *E - B *F;
+	Mz[2][2] = 0;
+}
+
 /**
  * hkl_matrix_to_euler:
  * @self: the rotation #HklMatrix use to compute the eulerians angles
@@ -228,6 +228,10 @@ extern int hkl_parameter_is_valid_range(const HklParameter *self);
 
 extern void hkl_parameter_fprintf(FILE *f, HklParameter *self);
 
+extern void hkl_parameter_restart_point(HklParameter *const axes[], size_t len,
+					unsigned int index, const double shift[],
+					double x[]);
+
 /********************/
 /* HklParameterList */
 /********************/
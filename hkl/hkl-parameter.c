@@ -19,6 +19,7 @@
  *
  * Authors: Picca Frédéric-Emmanuel <picca@synchrotron-soleil.fr>
  */
+#include <math.h>                       // for M_PI, floor
 #include <stdio.h>                      // for fprintf, FILE
 #include <stdlib.h>                     // for free, malloc, NULL
 #include <string.h>                     // for strcmp
@@ -27,6 +28,7 @@
 #include "hkl-parameter-private.h"      // for _HklParameter, etc
 #include "hkl-unit-private.h"           // for hkl_unit_factor, HklUnit, etc
 #include "hkl.h"                        // for HklParameter, etc
+#include "hkl/ccan/array_size/array_size.h"  // for ARRAY_SIZE
 #include "hkl/ccan/darray/darray.h"     // for darray_size, darray_item, etc
 
 /****************/
@@ -339,6 +341,63 @@ void hkl_parameter_randomize(HklParameter *self)
 	self->ops->randomize(self);
 }
 
+/* one prime base per dimension of the Halton sequence */
+static const unsigned int halton_bases[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+
+static double halton(unsigned int index, unsigned int base)
+{
+	double f = 1. / base;
+	double res = 0.;
+
+	while(index > 0){
+		res += f * (index % base);
+		index /= base;
+		f /= base;
+	}
+
+	return res;
+}
+
+/**
+ * hkl_parameter_restart_point: (skip)
+ * @axes: the parameters explored by a solver
+ * @len: the number of parameters
+ * @index: the index of the point in the sequence, starting at 1
+ * @shift: (allow-none): one offset in [0, 1) per parameter or NULL
+ * @x: (out): the len values of the point
+ *
+ * compute a starting point for a solver restart. The points follow a
+ * Halton sequence spread over one turn of the parameters ranges, so
+ * successive restarts cover the ranges evenly. The optional shift is
+ * added modulo 1 to each coordinate to decorrelate the sequences of
+ * two solvers.
+ **/
+void hkl_parameter_restart_point(HklParameter *const axes[], size_t len,
+				 unsigned int index, const double shift[],
+				 double x[])
+{
+	for(size_t i=0; i<len; ++i){
+		double min = axes[i]->range.min;
+		double max = axes[i]->range.max;
+		double u;
+
+		/* only one turn is meaningful for the solver */
+		if(min < -M_PI && max > -M_PI)
+			min = -M_PI;
+		if(max > min + 2 * M_PI)
+			max = min + 2 * M_PI;
+
+		/* the solvers never have more axes than bases */
+		u = halton(index, halton_bases[i % ARRAY_SIZE(halton_bases)]);
+		if(shift){
+			u += shift[i];
+			u -= floor(u);
+		}
+
+		x[i] = min + (max - min) * u;
+	}
+}
+
 /**
  * hkl_parameter_is_valid: (skip)
  * @self:
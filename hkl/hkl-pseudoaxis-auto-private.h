@@ -22,6 +22,8 @@
 #ifndef __HKL_PSEUDOAXIS_AUTO_H__
 #define __HKL_PSEUDOAXIS_AUTO_H__
 
+#include <gsl/gsl_matrix_double.h>      // for gsl_matrix
+#include <gsl/gsl_multiroots.h>         // for gsl_multiroot_fsolver, etc
 #include <gsl/gsl_vector_double.h>      // for gsl_vector
 #include <stddef.h>                     // for NULL
 #include <sys/types.h>                  // for uint
@@ -29,6 +31,7 @@
 #include "hkl-geometry-private.h"       // for hkl_geometry_new_copy
 #include "hkl-macros-private.h"         // for hkl_assert, etc
 #include "hkl-pseudoaxis-private.h"     // for HklModeOperations, etc
+#include "hkl-vector-private.h"         // for HklVector
 #include "hkl.h"                        // for HklMode, hkl_detector_free, etc
 #include "hkl/ccan/container_of/container_of.h"  // for container_of
 #include "hkl/ccan/array_size/array_size.h"  // ARRAY_SIZE
@@ -43,22 +46,66 @@ typedef struct _HklModeAutoWithInit HklModeAutoWithInit;
 /* HklModeAuto */
 /***************/
 
+/* df is optional, it computes the analytic jacobian J(i, j) = dfi/dxj
+ * of the function. When it is missing the solver falls back on a
+ * finite differences jacobian.
+ *
+ * ubh is optional, it is set when the three first components of the
+ * function are kf - ki - R.UB.hkl and returns UB.hkl. The sectors of
+ * the solutions are then enumerated holder by holder. */
 struct _HklFunction
 {
 	const uint size;
 	int (* function) (const gsl_vector *x, void *params, gsl_vector *f);
+	int (* df) (const gsl_vector *x, void *params, gsl_matrix *J);
+	void (* ubh) (void *params, HklVector *ubh);
 };
 
 typedef darray(const HklFunction*) darray_function;
 
+typedef darray(double) darray_double;
+
 struct _HklModeAutoInfo {
 	const HklModeInfo info;
 	darray_function functions;
 };
 
+/* the memory of the numerical solvers of a mode. It is sized from the
+ * mode axes_w and allocated during the first solve, the next ones
+ * reuse it without any allocation. The fsolvers and the x vectors are
+ * indexed by their size - 1, from 1 to len. The engines of the
+ * parallel restarts are also built once and only synchronized with
+ * the solving engine before each race. */
+typedef struct _HklModeAutoRaceWorker HklModeAutoRaceWorker;
+
+struct _HklModeAutoWorkspace {
+	size_t len;
+	gsl_multiroot_fsolver **fsolvers;
+	gsl_multiroot_fdfsolver *fdfsolver;
+	gsl_vector **x;
+	gsl_vector *_x; /* sectors */
+	gsl_vector *_f;
+	gsl_matrix *J; /* degenerated axes */
+	HklParameter **axes;
+	darray_int sectors[2]; /* holders sectors */
+	darray_double v[2];
+	HklModeAutoRaceWorker *race_workers; /* the parallel restarts engines */
+	size_t n_race_workers;
+	int perm_r; /* always enumerate the sectors with perm_r (tests) */
+	int numerical; /* skip the closed form solutions (tests) */
+};
+
+extern HklModeAutoWorkspace *hkl_mode_auto_workspace_get(HklMode *self);
+
+extern gsl_multiroot_fsolver *hkl_mode_auto_workspace_fsolver(HklModeAutoWorkspace *self,
+							      size_t n);
+
+extern gsl_vector *hkl_mode_auto_workspace_x(HklModeAutoWorkspace *self, size_t n);
+
 #define HKL_MODE_OPERATIONS_AUTO_DEFAULTS	\
 	HKL_MODE_OPERATIONS_DEFAULTS,		\
-		.set = hkl_mode_auto_set_real
+		.set = hkl_mode_auto_set_real,	\
+		.set_local = hkl_mode_auto_set_local_real
 
 #define CHECK_NAN(x, len) do{				\
 		for(uint i=0; i<len; ++i)		\
@@ -86,6 +133,13 @@ extern int hkl_mode_auto_set_real(HklMode *self,
 				  HklSample *sample,
 				  GError **error);
 
+extern int hkl_mode_auto_set_local_real(HklMode *self,
+					HklEngine *engine,
+					HklGeometry *geometry,
+					HklDetector *detector,
+					HklSample *sample,
+					GError **error);
+
 /***********************/
 /* HklModeAutoWithInit */
 /***********************/
@@ -112,6 +166,7 @@ typedef enum {
 	HKL_MODE_OPERATIONS_AUTO_DEFAULTS,				\
 		.capabilities = HKL_ENGINE_CAPABILITIES_READABLE | HKL_ENGINE_CAPABILITIES_WRITABLE | HKL_ENGINE_CAPABILITIES_INITIALIZABLE, \
 		.free = hkl_mode_auto_with_init_free_real,		\
+		.init_copy = hkl_mode_auto_with_init_init_copy_real,	\
 		.initialized_set = hkl_mode_auto_with_init_initialized_set_real
 
 static NEEDED void hkl_mode_auto_with_init_free_real(HklMode *mode)
@@ -129,6 +184,32 @@ static NEEDED void hkl_mode_auto_with_init_free_real(HklMode *mode)
 }
 
 
+static NEEDED int hkl_mode_auto_with_init_init_copy_real(HklMode *mode,
+							 const HklMode *src)
+{
+	HklModeAutoWithInit *self = container_of(mode, HklModeAutoWithInit, mode);
+	const HklModeAutoWithInit *other = container_of(src, HklModeAutoWithInit, mode);
+
+	if(!hkl_mode_init_copy_real(mode, src))
+		return FALSE;
+
+	/* the initialization snapshot */
+	if(self->geometry)
+		hkl_geometry_free(self->geometry);
+	self->geometry = other->geometry ? hkl_geometry_new_copy(other->geometry) : NULL;
+
+	if(self->detector)
+		hkl_detector_free(self->detector);
+	self->detector = other->detector ? hkl_detector_new_copy(other->detector) : NULL;
+
+	if(self->sample)
+		hkl_sample_free(self->sample);
+	self->sample = other->sample ? hkl_sample_new_copy(other->sample) : NULL;
+
+	return TRUE;
+}
+
+
 static NEEDED int hkl_mode_auto_with_init_initialized_set_real(HklMode *mode,
 							       HklEngine *engine,
 							       HklGeometry *geometry,
@@ -27,14 +27,17 @@
 #include <gsl/gsl_vector_double.h>      // for gsl_vector, etc
 #include <math.h>                       // for fabs, M_PI
 #include <stddef.h>                     // for size_t
-#include <stdlib.h>                     // for rand, RAND_MAX
+#include <stdlib.h>                     // for calloc, free
 #include <string.h>                     // for NULL, memset, memcpy
 #include <sys/types.h>                  // for uint
+#include "hkl-axis-private.h"           // for HklAxis
 #include "hkl-geometry-private.h"       // for hkl_geometry_update
 #include "hkl-macros-private.h"         // for HKL_MALLOC, hkl_assert, etc
 #include "hkl-parameter-private.h"      // for _HklParameter
 #include "hkl-pseudoaxis-auto-private.h"  // for HklModeAutoInfo, etc
 #include "hkl-pseudoaxis-private.h"     // for _HklEngine, HklModeInfo, etc
+#include "hkl-quaternion-private.h"     // for hkl_quaternion_init_from_angle_and_axe
+#include "hkl-source-private.h"         // for hkl_source_compute_ki
 #include "hkl.h"                        // for HklEngine, HklMode, etc
 #include "hkl/ccan/container_of/container_of.h"  // for container_of
 #include "hkl/ccan/darray/darray.h"     // for darray_foreach
@@ -56,10 +59,195 @@ typedef enum {
 /* methods use to solve numerical pseudoAxes */
 /*********************************************/
 
+/* when the mode function provides an analytic jacobian, the gsl fdf
+ * solver needs the function and its jacobian to share the same
+ * params. So wrap the engine and the function together. */
+typedef struct _HklFunctionParams HklFunctionParams;
+
+struct _HklFunctionParams
+{
+	HklEngine *engine;
+	const HklFunction *function;
+};
+
+static int function_f(const gsl_vector *x, void *params, gsl_vector *f)
+{
+	HklFunctionParams *p = params;
+
+	return p->function->function(x, p->engine, f);
+}
+
+static int function_df(const gsl_vector *x, void *params, gsl_matrix *J)
+{
+	HklFunctionParams *p = params;
+
+	return p->function->df(x, p->engine, J);
+}
+
+static int function_fdf(const gsl_vector *x, void *params,
+			gsl_vector *f, gsl_matrix *J)
+{
+	HklFunctionParams *p = params;
+	int status;
+
+	status = p->function->function(x, p->engine, f);
+	if (status == GSL_SUCCESS)
+		status = p->function->df(x, p->engine, J);
+
+	return status;
+}
+
+/************************/
+/* HklModeAutoWorkspace */
+/************************/
+
+static void hkl_mode_auto_workspace_race_workers_free(HklModeAutoWorkspace *self);
+
+HklModeAutoWorkspace *hkl_mode_auto_workspace_get(HklMode *self)
+{
+	if(!self->workspace){
+		HklModeAutoWorkspace *ws = HKL_MALLOC(HklModeAutoWorkspace);
+		size_t i;
+
+		ws->len = darray_size(self->info->axes_w);
+		ws->fsolvers = calloc(ws->len, sizeof(*ws->fsolvers));
+		ws->fdfsolver = NULL;
+		ws->x = calloc(ws->len, sizeof(*ws->x));
+		ws->_x = gsl_vector_alloc(ws->len);
+		ws->_f = gsl_vector_alloc(ws->len);
+		ws->J = gsl_matrix_alloc(ws->len, ws->len);
+		ws->axes = calloc(ws->len, sizeof(*ws->axes));
+		for(i=0; i<ARRAY_SIZE(ws->sectors); ++i){
+			darray_init(ws->sectors[i]);
+			darray_init(ws->v[i]);
+		}
+		ws->race_workers = NULL;
+		ws->n_race_workers = 0;
+		ws->perm_r = FALSE;
+		ws->numerical = FALSE;
+
+		self->workspace = ws;
+	}
+
+	return self->workspace;
+}
+
+void hkl_mode_auto_workspace_free(HklModeAutoWorkspace *self)
+{
+	size_t i;
+
+	for(i=0; i<self->len; ++i){
+		if(self->fsolvers[i])
+			gsl_multiroot_fsolver_free(self->fsolvers[i]);
+		if(self->x[i])
+			gsl_vector_free(self->x[i]);
+	}
+	free(self->fsolvers);
+	free(self->x);
+	if(self->fdfsolver)
+		gsl_multiroot_fdfsolver_free(self->fdfsolver);
+	gsl_vector_free(self->_x);
+	gsl_vector_free(self->_f);
+	gsl_matrix_free(self->J);
+	free(self->axes);
+	for(i=0; i<ARRAY_SIZE(self->sectors); ++i){
+		darray_free(self->sectors[i]);
+		darray_free(self->v[i]);
+	}
+	hkl_mode_auto_workspace_race_workers_free(self);
+	free(self);
+}
+
+/* the hybrid solver of size n */
+gsl_multiroot_fsolver *hkl_mode_auto_workspace_fsolver(HklModeAutoWorkspace *self,
+						       size_t n)
+{
+	hkl_assert(n > 0 && n <= self->len);
+
+	if(!self->fsolvers[n-1])
+		self->fsolvers[n-1] = gsl_multiroot_fsolver_alloc(gsl_multiroot_fsolver_hybrid, n);
+
+	return self->fsolvers[n-1];
+}
+
+/* a vector of size n */
+gsl_vector *hkl_mode_auto_workspace_x(HklModeAutoWorkspace *self, size_t n)
+{
+	hkl_assert(n > 0 && n <= self->len);
+
+	if(!self->x[n-1])
+		self->x[n-1] = gsl_vector_alloc(n);
+
+	return self->x[n-1];
+}
+
+/* the hybridsj solver of size len */
+static gsl_multiroot_fdfsolver *hkl_mode_auto_workspace_fdfsolver(HklModeAutoWorkspace *self)
+{
+	if(!self->fdfsolver)
+		self->fdfsolver = gsl_multiroot_fdfsolver_alloc(gsl_multiroot_fdfsolver_hybridsj,
+								self->len);
+
+	return self->fdfsolver;
+}
+
+/* hide the difference between the fsolver and the fdfsolver */
+typedef struct _HklSolver HklSolver;
+
+struct _HklSolver
+{
+	gsl_multiroot_function *f;
+	gsl_multiroot_function_fdf *fdf;
+	gsl_multiroot_fsolver *s;
+	gsl_multiroot_fdfsolver *sdf;
+};
+
+/* the solvers are owned by the mode workspace */
+static void hkl_solver_init(HklSolver *self, HklModeAutoWorkspace *ws,
+			    gsl_multiroot_function *f,
+			    gsl_multiroot_function_fdf *fdf)
+{
+	self->f = f;
+	self->fdf = fdf;
+	self->s = NULL;
+	self->sdf = NULL;
+	if(fdf)
+		self->sdf = hkl_mode_auto_workspace_fdfsolver(ws);
+	else
+		self->s = hkl_mode_auto_workspace_fsolver(ws, ws->len);
+}
+
+static int hkl_solver_set(HklSolver *self, const gsl_vector *x)
+{
+	if(self->sdf)
+		return gsl_multiroot_fdfsolver_set(self->sdf, self->fdf, x);
+	else
+		return gsl_multiroot_fsolver_set(self->s, self->f, x);
+}
+
+static int hkl_solver_iterate(HklSolver *self)
+{
+	if(self->sdf)
+		return gsl_multiroot_fdfsolver_iterate(self->sdf);
+	else
+		return gsl_multiroot_fsolver_iterate(self->s);
+}
+
+static gsl_vector *hkl_solver_x(const HklSolver *self)
+{
+	return self->sdf ? self->sdf->x : self->s->x;
+}
+
+static gsl_vector *hkl_solver_f(const HklSolver *self)
+{
+	return self->sdf ? self->sdf->f : self->s->f;
+}
+
 /**
  * @brief This private method find the degenerated axes.
  *
  * @param func the gsl_multiroopt_function to test
+ * @param function the mode function, use its analytic jacobian if any
  * @param x the starting point
  * @param f the result of the function evaluation.
  *
@@ -71,16 +259,19 @@ typedef enum {
  */
 static void find_degenerated_axes(HklEngine *self,
 				  gsl_multiroot_function *func,
+				  const HklFunction *function,
 				  gsl_vector const *x, gsl_vector const *f,
 				  int degenerated[])
 {
-	gsl_matrix *J;
+	gsl_matrix *J = hkl_mode_auto_workspace_get(self->mode)->J;
 	size_t i, j;
 
 	memset(degenerated, 0, x->size * sizeof(int));
-	J = gsl_matrix_alloc(x->size, f->size);
 
-	gsl_multiroot_fdjacobian(func, x, f, GSL_SQRT_DBL_EPSILON, J);
+	if(function->df)
+		function->df(x, self, J);
+	else
+		gsl_multiroot_fdjacobian(func, x, f, GSL_SQRT_DBL_EPSILON, J);
 	for(j=0; j<x->size && !degenerated[j]; ++j) {
 		for(i=0; i<f->size; ++i)
 			if (fabs(gsl_matrix_get(J, i, j)) > HKL_EPSILON)
@@ -100,31 +291,231 @@ static void find_degenerated_axes(HklEngine *self,
 	}
 	fprintf(stdout, "\n");
 #endif
-	gsl_matrix_free(J);
+}
+
+/* the solver restarts from another point every HKL_SOLVER_RESTART
+ * iterations and gives up after HKL_SOLVER_MAX_ITER iterations */
+#define HKL_SOLVER_RESTART 300
+#define HKL_SOLVER_MAX_ITER 2000
+#define HKL_SOLVER_N_STARTS (HKL_SOLVER_MAX_ITER / HKL_SOLVER_RESTART)
+
+/**
+ * @brief iterate the solver from one of the starting points.
+ *
+ * @param s the solver, already set at the starting point.
+ * @param start the index of the starting point, 0 for the geometry.
+ * @param best the lowest converged starting point of a race or NULL.
+ *
+ * The iterations stop after HKL_SOLVER_RESTART iterations, on a
+ * solver error, or when a lower starting point already converged.
+ *
+ * @return GSL_SUCCESS if the solver converged, GSL_CONTINUE otherwise.
+ */
+static int hkl_solver_iterate_start(HklSolver *s, gint start,
+				    volatile gint *best)
+{
+	size_t iter = 0;
+	int status;
+
+	do {
+		++iter;
+		status = hkl_solver_iterate(s);
+		if(status)
+			return GSL_CONTINUE;
+		status = gsl_multiroot_test_residual(hkl_solver_f(s), HKL_EPSILON / 10.);
+	} while (status == GSL_CONTINUE && iter < HKL_SOLVER_RESTART
+		 && !(best && g_atomic_int_get(best) < start));
+
+	return status == GSL_SUCCESS ? GSL_SUCCESS : GSL_CONTINUE;
+}
+
+/* parallel multi-start: the restart points are tried concurrently,
+ * each worker on its own copy of the engine. Like with the serial
+ * restarts the lowest converged restart point wins, the workers on
+ * the higher ones stop as soon as it is known. */
+struct race {
+	const HklFunction *function;
+	size_t len;
+	const double *shift;
+	gint n_starts;
+	volatile gint next; /* index of the next restart point */
+	volatile gint best; /* lowest converged restart point */
+	GMutex mutex; /* protect best and x */
+	double *x; /* the winner */
+};
+
+struct _HklModeAutoRaceWorker {
+	HklEngineWorker worker;
+	struct race *race;
+};
+
+static gpointer race_worker_run(gpointer data)
+{
+	HklModeAutoRaceWorker *self = data;
+	struct race *race = self->race;
+	HklEngine *engine = self->worker.engine;
+	HklModeAutoWorkspace *ws = hkl_mode_auto_workspace_get(engine->mode);
+	HklFunctionParams params;
+	HklSolver s;
+	gsl_multiroot_function f;
+	gsl_multiroot_function_fdf fdf;
+	gsl_vector *x;
+	gint start;
+
+	f.f = race->function->function;
+	f.n = race->function->size;
+	f.params = engine;
+	if(race->function->df){
+		params.engine = engine;
+		params.function = race->function;
+		fdf.f = function_f;
+		fdf.df = function_df;
+		fdf.fdf = function_fdf;
+		fdf.n = f.n;
+		fdf.params = &params;
+		hkl_solver_init(&s, ws, &f, &fdf);
+	}else
+		hkl_solver_init(&s, ws, &f, NULL);
+	x = hkl_mode_auto_workspace_x(ws, race->len);
+
+	while((start = g_atomic_int_add(&race->next, 1)) <= race->n_starts
+	      && start < g_atomic_int_get(&race->best)){
+		hkl_parameter_restart_point(&darray_item(engine->axes, 0), race->len,
+					    start, race->shift, x->data);
+		hkl_solver_set(&s, x);
+		if(GSL_SUCCESS != hkl_solver_iterate_start(&s, start, &race->best))
+			continue;
+
+		g_mutex_lock(&race->mutex);
+		if(start < race->best){
+			memcpy(race->x, hkl_solver_x(&s)->data, race->len * sizeof(*race->x));
+			g_atomic_int_set(&race->best, start);
+		}
+		g_mutex_unlock(&race->mutex);
+	}
+
+	return NULL;
+}
+
+/* the race workers are built during the first race and kept in the
+ * workspace, the next races only synchronize them with the engine */
+static int hkl_mode_auto_workspace_race_workers(HklModeAutoWorkspace *self,
+						 const HklEngine *engine,
+						 size_t n, GError **error)
+{
+	size_t i;
+
+	if(self->n_race_workers < n){
+		hkl_mode_auto_workspace_race_workers_free(self);
+		self->race_workers = calloc(n, sizeof(*self->race_workers));
+		self->n_race_workers = n;
+		for(i=0; i<n; ++i)
+			if(!hkl_engine_worker_init(&self->race_workers[i].worker,
+						   engine, error)){
+				hkl_mode_auto_workspace_race_workers_free(self);
+				return FALSE;
+			}
+	}
+
+	/* the race starts from the geometry the engine is solving in */
+	for(i=0; i<n; ++i)
+		if(!hkl_engine_worker_sync(&self->race_workers[i].worker,
+					   engine, engine->geometry, error))
+			return FALSE;
+
+	return TRUE;
+}
+
+static void hkl_mode_auto_workspace_race_workers_free(HklModeAutoWorkspace *self)
+{
+	size_t i;
+
+	for(i=0; i<self->n_race_workers; ++i)
+		hkl_engine_worker_release(&self->race_workers[i].worker);
+	free(self->race_workers);
+	self->race_workers = NULL;
+	self->n_race_workers = 0;
+}
+
+/**
+ * @brief race the restarts of find_first_geometry in parallel
+ *
+ * @param self the current HklPseudoAxeEngine.
+ * @param function the mode function.
+ * @param shift the offsets of the restart points sequence.
+ * @param x the converged point if any.
+ * @param error return location for a GError, or NULL
+ *
+ * the restart points are the same than the serial solver ones, and
+ * the winner is the one the serial restarts would have found.
+ * @return TRUE if one of the restarts converged.
+ */
+static int find_first_geometry_race(HklEngine *self,
+				    const HklFunction *function,
+				    const double shift[],
+				    double x[],
+				    GError **error)
+{
+	struct race race;
+	HklModeAutoWorkspace *ws = hkl_mode_auto_workspace_get(self->mode);
+	size_t n_workers;
+	size_t i;
+
+	race.function = function;
+	race.len = darray_size(self->axes);
+	race.shift = shift;
+	race.n_starts = HKL_SOLVER_N_STARTS;
+	race.next = 1;
+	race.best = race.n_starts + 1;
+	race.x = x;
+
+	n_workers = self->n_parallel_starts < (size_t)race.n_starts ? self->n_parallel_starts : (size_t)race.n_starts;
+
+	if(!hkl_mode_auto_workspace_race_workers(ws, self, n_workers, error))
+		return FALSE;
+	for(i=0; i<n_workers; ++i)
+		ws->race_workers[i].race = &race;
+
+	g_mutex_init(&race.mutex);
+	hkl_engine_pool_run(race_worker_run, ws->race_workers,
+			    sizeof(*ws->race_workers), n_workers);
+	g_mutex_clear(&race.mutex);
+
+	return race.best <= race.n_starts;
 }
 
 /**
  * @brief this private method try to find the first solution
  *
  * @param self the current HklPseudoAxeEngine.
+ * @param function the mode function.
  * @param f The function to use for the computation.
  *
+ * If the mode function provides an analytic jacobian the hybridsj
+ * solver is used, otherwise the hybrid one with a finite differences
+ * jacobian.
  * If a solution was found it also check for degenerated axes.
  * A degenerated axes is an Axes with no effect on the function.
  * @see find_degenerated
- * @return TRUE or FALSE.
+ * @return TRUE or FALSE, FALSE with @error set if the parallel
+ * restarts could not be prepared.
  */
 static int find_first_geometry(HklEngine *self,
+			       const HklFunction *function,
 			       gsl_multiroot_function *f,
-			       int degenerated[])
+			       int degenerated[],
+			       GError **error)
 {
-	gsl_multiroot_fsolver_type const *T;
-	gsl_multiroot_fsolver *s;
+	HklSolver s;
+	HklFunctionParams params;
+	gsl_multiroot_function_fdf fdf;
 	gsl_vector *x;
+	HklModeAutoWorkspace *ws = hkl_mode_auto_workspace_get(self->mode);
 	size_t len = darray_size(self->mode->info->axes_w);
 	double *x_data;
 	double *x_data0 = alloca(len * sizeof(*x_data0));
-	size_t iter = 0;
+	double *shift = alloca(len * sizeof(*shift));
+	gint start;
 	int status;
 	int res = FALSE;
 	size_t i;
@@ -132,7 +523,7 @@ static int find_first_geometry(HklEngine *self,
 
 	/* get the starting point from the geometry */
 	/* must be put in the auto_set method */
-	x = gsl_vector_alloc(len);
+	x = hkl_mode_auto_workspace_x(ws, len);
 	x_data = (double *)x->data;
 	i = 0;
 	darray_foreach(axis, self->axes){
@@ -142,63 +533,62 @@ static int find_first_geometry(HklEngine *self,
 	/* keep a copy of the first axes positions to deal with degenerated axes */
 	memcpy(x_data0, x_data, len * sizeof(double));
 
+	/* the restart points of this solve */
+	hkl_engine_restart_shift(self, shift, len);
+
 	/* Initialize method  */
-	T = gsl_multiroot_fsolver_hybrid;
-	s = gsl_multiroot_fsolver_alloc (T, len);
-	gsl_multiroot_fsolver_set (s, f, x);
+	if(function->df){
+		params.engine = self;
+		params.function = function;
+		fdf.f = function_f;
+		fdf.df = function_df;
+		fdf.fdf = function_fdf;
+		fdf.n = f->n;
+		fdf.params = &params;
+		hkl_solver_init(&s, ws, f, &fdf);
+	}else
+		hkl_solver_init(&s, ws, f, NULL);
+	hkl_solver_set(&s, x);
 
 #ifdef DEBUG
 	fprintf(stdout, "Initial starting point: \n");
 	fprintf(stdout, "x: ");
 	for(i=0; i<len; ++i)
-		fprintf(stdout, " %.7f", s->x->data[i]);
+		fprintf(stdout, " %.7f", hkl_solver_x(&s)->data[i]);
 	fprintf(stdout, "\nf: ");
 	for(i=0; i<len; ++i)
-		fprintf(stdout, " %.7f", s->f->data[i]);
+		fprintf(stdout, " %.7f", hkl_solver_f(&s)->data[i]);
 #endif
 
-	/* iterate to find the solution */
-	do {
-		++iter;
-		status = gsl_multiroot_fsolver_iterate(s);
-#ifdef DEBUG
-		fprintf(stdout, "\nstatus : %d iter : %d\n", status, iter);
-#endif
-		if (status || (iter % 300) == 0) {
-			/* Restart from another point. */
-			for(i=0; i<len; ++i)
-				x_data[i] = (double)rand() / RAND_MAX / 180. * M_PI;
-			gsl_multiroot_fsolver_set(s, f, x);
-			gsl_multiroot_fsolver_iterate(s);
-#ifdef DEBUG
-			fprintf(stdout, "randomize the starting point: \n");
-			fprintf(stdout, "x: ");
-			for(i=0; i<len; ++i)
-				fprintf(stdout, " %.7f", s->x->data[i]);
-			fprintf(stdout, "\nf: ");
-			for(i=0; i<len; ++i)
-				fprintf(stdout, " %.7f", s->f->data[i]);
-#endif
-		}
-		status = gsl_multiroot_test_residual (s->f, HKL_EPSILON / 10.);
-#ifdef DEBUG
-		fprintf(stdout, "\nstatus : %d iter : %d", status, iter);
-		for(i=0; i<len; ++i)
-			fprintf(stdout, " %.7f", s->f->data[i]);
-		fprintf(stdout, "\n");
-#endif
-
-	} while (status == GSL_CONTINUE && iter < 2000);
+	/* iterate from the geometry, then from the restart points */
+	status = hkl_solver_iterate_start(&s, 0, NULL);
+	if(status != GSL_SUCCESS){
+		if(self->n_parallel_starts > 1){
+			if(find_first_geometry_race(self, function, shift, x_data, error)){
+				hkl_solver_set(&s, x);
+				status = GSL_SUCCESS;
+			}else if(error && *error)
+				return FALSE;
+		}else
+			for(start=1; start<=HKL_SOLVER_N_STARTS && status != GSL_SUCCESS; ++start){
+				hkl_parameter_restart_point(&darray_item(self->axes, 0), len,
+							    start, shift, x_data);
+				hkl_solver_set(&s, x);
+				status = hkl_solver_iterate_start(&s, start, NULL);
+			}
+	}
 
 #ifdef DEBUG
-	fprintf(stdout, "\nstatus : %d iter : %d", status, iter);
+	fprintf(stdout, "\nstatus : %d", status);
 	for(i=0; i<len; ++i)
-		fprintf(stdout, " %.7f", s->f->data[i]);
+		fprintf(stdout, " %.7f", hkl_solver_f(&s)->data[i]);
 	fprintf(stdout, "\n");
 #endif
 
-	if (status != GSL_CONTINUE) {
-		find_degenerated_axes(self, f, s->x, s->f, degenerated);
+	if (status == GSL_SUCCESS) {
+		find_degenerated_axes(self, f, function,
+				      hkl_solver_x(&s), hkl_solver_f(&s),
+				      degenerated);
 
 #ifdef DEBUG
 		/* print the test header */
@@ -212,7 +602,7 @@ static int find_first_geometry(HklEngine *self,
 		/* set the geometry from the gsl_vector */
 		/* in a futur version the geometry must contain a gsl_vector */
 		/* to avoid this. */
-		x_data = (double *)s->x->data;
+		x_data = (double *)hkl_solver_x(&s)->data;
 		i = 0;
 		darray_foreach(axis, self->axes){
 			hkl_parameter_value_set(*axis,
@@ -226,47 +616,49 @@ static int find_first_geometry(HklEngine *self,
 		res = TRUE;
 	}
 
-	/* release memory */
-	gsl_vector_free(x);
-	gsl_multiroot_fsolver_free(s);
-
 	return res;
 }
 
 /**
- * @brief This private method change the sector of angles.
+ * @brief This private method change the sector of an angle.
  *
- * @param x The vector of changed angles.
- * @param x0 The vector of angles to change.
- * @param sector the sector vector operation.
- * @param n the size of all vectors.
+ * @param x0 The angle to change.
+ * @param sector the sector operation.
  *
  * 0 -> no change
  * 1 -> pi - angle
  * 2 -> pi + angle
  * 3 -> -angle
  */
+static inline double sector_angle(double x0, int sector)
+{
+	switch (sector) {
+	case 1:
+		return M_PI - x0;
+	case 2:
+		return M_PI + x0;
+	case 3:
+		return -x0;
+	default:
+		return x0;
+	}
+}
+
+/**
+ * @brief This private method change the sector of angles.
+ *
+ * @param x The vector of changed angles.
+ * @param x0 The vector of angles to change.
+ * @param sector the sector vector operation.
+ * @param n the size of all vectors.
+ */
 static void change_sector(double x[], double const x0[],
 			  int const sector[], size_t n)
 {
 	size_t i;
 
-	for(i=0; i<n; ++i) {
-		switch (sector[i]) {
-		case 0:
-			x[i] = x0[i];
-			break;
-		case 1:
-			x[i] = M_PI - x0[i];
-			break;
-		case 2:
-			x[i] = M_PI + x0[i];
-			break;
-		case 3:
-			x[i] = -x0[i];
-			break;
-		}
-	}
+	for(i=0; i<n; ++i)
+		x[i] = sector_angle(x0[i], sector[i]);
 }
 
 /**
@@ -341,11 +733,214 @@ static void perm_r(size_t axes_len, size_t op_len[], int p[], size_t axes_idx,
 			perm_r(axes_len, op_len, p, axes_idx, i, f, x0, _x, _f);
 }
 
+/* the sectors of the axes of one holder. For each position of the
+ * holder the candidates quaternions of the axis, one if the axis is
+ * not part of the mode or degenerated, the 4 sectors otherwise. */
+struct sector_axis {
+	int idx; /* index in the engine axes or -1 */
+	size_t n;
+	HklQuaternion q[4];
+};
+
+/* all the sectors combinations of one holder stored in flat arrays,
+ * the engine axes of the other holders are left at sector 0. */
+struct holder_sectors {
+	size_t n;
+	size_t len;	/* number of engine axes */
+	int *sectors;	/* n x len */
+	double *v;	/* n x 3, the holder rotation applied to v0 */
+};
+
+static void holder_sectors_r(struct holder_sectors *self,
+			     const struct sector_axis axes[], size_t axes_len,
+			     size_t pos, const HklQuaternion *q,
+			     int sectors[], const HklVector *v0)
+{
+	size_t i;
+
+	if(pos == axes_len){
+		HklVector v = *v0;
+
+		hkl_vector_rotated_quaternion(&v, q);
+		memcpy(&self->v[3 * self->n], v.data, sizeof(v.data));
+		memcpy(&self->sectors[self->len * self->n], sectors,
+		       self->len * sizeof(*sectors));
+		self->n++;
+		return;
+	}
+
+	/* the prefix product is shared by all the inner axes sectors */
+	for(i=0; i<axes[pos].n; ++i){
+		HklQuaternion qi = *q;
+
+		hkl_quaternion_times_quaternion(&qi, &axes[pos].q[i]);
+		if(axes[pos].idx >= 0)
+			sectors[axes[pos].idx] = i;
+		holder_sectors_r(self, axes, axes_len, pos + 1, &qi, sectors, v0);
+	}
+}
+
+/**
+ * @brief compute all the sectors combinations of a holder.
+ *
+ * @param self the holder_sectors to fill.
+ * @param engine the current HklEngine.
+ * @param holder the holder.
+ * @param x0 The starting point of all geometry permutations.
+ * @param op_len number of operation per axes.
+ * @param v0 the vector rotated by the holder.
+ * @param found count the engine axes which are part of the holder.
+ * @param sectors_buffer the memory of the sectors.
+ * @param v_buffer the memory of the vectors.
+ */
+static void holder_sectors_init(struct holder_sectors *self,
+				const HklEngine *engine,
+				const HklHolder *holder,
+				const double x0[], const size_t op_len[],
+				const HklVector *v0, int found[],
+				darray_int *sectors_buffer,
+				darray_double *v_buffer)
+{
+	static HklQuaternion q0 = {{1, 0, 0, 0}};
+	struct sector_axis *axes = alloca(holder->config->len * sizeof(*axes));
+	int *sectors;
+	size_t n = 1;
+	size_t i;
+
+	self->n = 0;
+	self->len = darray_size(engine->axes);
+
+	for(i=0; i<holder->config->len; ++i){
+		HklParameter *parameter = darray_item(holder->geometry->axes,
+						      holder->config->idx[i]);
+		HklAxis *axis = container_of(parameter, HklAxis, parameter);
+		size_t j;
+
+		axes[i].idx = -1;
+		axes[i].n = 1;
+		axes[i].q[0] = axis->q;
+		for(j=0; j<self->len; ++j)
+			if(darray_item(engine->axes, j) == parameter){
+				size_t k;
+
+				axes[i].idx = j;
+				axes[i].n = op_len[j];
+				for(k=0; k<axes[i].n; ++k)
+					hkl_quaternion_init_from_angle_and_axe(&axes[i].q[k],
+									       sector_angle(x0[j], k),
+									       &axis->axis_v);
+				found[j]++;
+				break;
+			}
+		n *= axes[i].n;
+	}
+
+	/* the buffers of the mode workspace only grow */
+	darray_resize(*sectors_buffer, n * self->len);
+	darray_resize(*v_buffer, n * 3);
+	self->sectors = sectors_buffer->item;
+	self->v = v_buffer->item;
+	sectors = alloca(self->len * sizeof(*sectors));
+	memset(sectors, 0, self->len * sizeof(*sectors));
+
+	holder_sectors_r(self, axes, holder->config->len, 0, &q0, sectors, v0);
+}
+
+/**
+ * @brief enumerate the sectors holder by holder.
+ *
+ * @param self the current HklEngine
+ * @param function The mode function
+ * @param f The function for the validity test.
+ * @param x0 The starting point of all geometry permutations.
+ * @param op_len number of operation per axes.
+ * @param _x a gsl_vector use to compute the sectors (optimization)
+ * @param _f a gsl_vector use during the sector test (optimization)
+ *
+ * @return FALSE if the function can not be enumerated this way.
+ *
+ * The three first components of the function are kf - ki - R.UB.hkl.
+ * R.UB.hkl depends only on the sample holder axes and kf on the
+ * detector holder ones, so the sectors of each holder are computed
+ * once with the prefix products of the axes quaternions, and only
+ * the combinations with matching vectors are tested with the whole
+ * mode function instead of the 4^n permutations of perm_r.
+ */
+static int perm_holders(HklEngine *self, const HklFunction *function,
+			gsl_multiroot_function *f, double x0[],
+			const size_t op_len[], gsl_vector *_x, gsl_vector *_f)
+{
+	size_t len = function->size;
+	int *found = alloca(len * sizeof(*found));
+	int *p = alloca(len * sizeof(*p));
+	const HklHolder *sample_holder;
+	const HklHolder *detector_holder;
+	struct holder_sectors sample;
+	struct holder_sectors detector;
+	HklVector ubh;
+	HklVector kf0;
+	HklVector ki;
+	HklModeAutoWorkspace *ws = hkl_mode_auto_workspace_get(self->mode);
+	size_t i, j, k;
+
+	if(!function->ubh || len != darray_size(self->axes))
+		return FALSE;
+
+	/* for now the 0 holder is the sample holder. */
+	sample_holder = darray_item(self->geometry->holders, 0);
+	detector_holder = darray_item(self->geometry->holders, self->detector->idx);
+	if(sample_holder == detector_holder)
+		return FALSE;
+
+	hkl_geometry_update(self->geometry);
+	function->ubh(self, &ubh);
+	hkl_vector_init(&kf0, HKL_TAU / self->geometry->source.wave_length, 0, 0);
+	hkl_source_compute_ki(&self->geometry->source, &ki);
+
+	memset(found, 0, len * sizeof(*found));
+	holder_sectors_init(&sample, self, sample_holder, x0, op_len, &ubh, found,
+			    &ws->sectors[0], &ws->v[0]);
+	holder_sectors_init(&detector, self, detector_holder, x0, op_len, &kf0, found,
+			    &ws->sectors[1], &ws->v[1]);
+
+	/* each axis must be part of one and only one holder */
+	for(i=0; i<len; ++i)
+		if(found[i] != 1)
+			return FALSE;
+
+	/* kf - ki */
+	for(j=0; j<detector.n; ++j)
+		for(k=0; k<3; ++k)
+			detector.v[3 * j + k] -= ki.data[k];
+
+	for(i=0; i<sample.n; ++i){
+		const double *s = &sample.v[3 * i];
+
+		for(j=0; j<detector.n; ++j){
+			const double *d = &detector.v[3 * j];
+
+			if(fabs(d[0] - s[0]) > HKL_EPSILON
+			   || fabs(d[1] - s[1]) > HKL_EPSILON
+			   || fabs(d[2] - s[2]) > HKL_EPSILON)
+				continue;
+
+			for(k=0; k<len; ++k)
+				p[k] = sample.sectors[len * i + k] + detector.sectors[len * j + k];
+			change_sector(_x->data, x0, p, len);
+			if (test_sector(_x, f, _f))
+				hkl_engine_add_geometry(self, _x->data);
+		}
+	}
+
+	return TRUE;
+}
+
 /**
  * @brief Find all numerical solutions of a mode.
  *
  * @param self the current HklEngine
  * @param function The mode function
+ * @param error return location for a GError, or NULL
  *
  * @return TRUE or FALSE
  *
@@ -355,7 +950,8 @@ static void perm_r(size_t axes_len, size_t op_len[], int p[], size_t axes_idx,
  * It addes all valid solutions to the self->geometries.
  */
 static int solve_function(HklEngine *self,
-			  const HklFunction *function)
+			  const HklFunction *function,
+			  GError **error)
 {
 
 	size_t i;
@@ -364,19 +960,17 @@ static int solve_function(HklEngine *self,
 	int degenerated[function->size];
 	size_t op_len[function->size];
 	int res;
-	gsl_vector *_x; /* use to compute sectors in perm_r (avoid copy) */
-	gsl_vector *_f; /* use to test sectors in perm_r (avoid copy) */
+	HklModeAutoWorkspace *ws = hkl_mode_auto_workspace_get(self->mode);
+	gsl_vector *_x = ws->_x; /* use to compute sectors in perm_r (avoid copy) */
+	gsl_vector *_f = ws->_f; /* use to test sectors in perm_r (avoid copy) */
 	gsl_multiroot_function f;
 	HklParameter **axis;
 
-	_x = gsl_vector_alloc(function->size);
-	_f = gsl_vector_alloc(function->size);
-
 	f.f = function->function;
 	f.n = function->size;
 	f.params = self;
 
-	res = find_first_geometry(self, &f, degenerated);
+	res = find_first_geometry(self, function, &f, degenerated, error);
 	if (res) {
 		memset(p, 0, sizeof(p));
 		/* use first solution as starting point for permutations */
@@ -386,12 +980,84 @@ static int solve_function(HklEngine *self,
 			op_len[i] = degenerated[i] ? 1 : 4;
 			++i;
 		}
-		for (i=0; i<op_len[0]; ++i)
-			perm_r(function->size, op_len, p, 0, i, &f, x0, _x, _f);
+		if(ws->perm_r
+		   || !perm_holders(self, function, &f, x0, op_len, _x, _f))
+			for (i=0; i<op_len[0]; ++i)
+				perm_r(function->size, op_len, p, 0, i, &f, x0, _x, _f);
 	}
 
-	gsl_vector_free(_f);
-	gsl_vector_free(_x);
+	return res;
+}
+
+/**
+ * @brief converge from the current engine axes without any restart.
+ *
+ * @param self the current HklEngine
+ * @param function The mode function
+ *
+ * @return TRUE or FALSE
+ *
+ * This is the corrector used by the trajectories. The starting point is
+ * already close to a solution (predicted from the previous points), so
+ * there is no random restart, no sectors permutation and only a few
+ * iterations are allowed. On success the engine geometry contains
+ * the solution.
+ */
+static int correct_function(HklEngine *self,
+			    const HklFunction *function)
+{
+	HklSolver s;
+	HklFunctionParams params;
+	gsl_multiroot_function f;
+	gsl_multiroot_function_fdf fdf;
+	gsl_vector *x;
+	size_t iter = 0;
+	int status;
+	int res = FALSE;
+	size_t i;
+	HklParameter **axis;
+	HklModeAutoWorkspace *ws = hkl_mode_auto_workspace_get(self->mode);
+
+	x = hkl_mode_auto_workspace_x(ws, function->size);
+	i = 0;
+	darray_foreach(axis, self->axes){
+		x->data[i++] = (*axis)->_value;
+	}
+
+	f.f = function->function;
+	f.n = function->size;
+	f.params = self;
+	if(function->df){
+		params.engine = self;
+		params.function = function;
+		fdf.f = function_f;
+		fdf.df = function_df;
+		fdf.fdf = function_fdf;
+		fdf.n = function->size;
+		fdf.params = &params;
+		hkl_solver_init(&s, ws, &f, &fdf);
+	}else
+		hkl_solver_init(&s, ws, &f, NULL);
+
+	if(GSL_SUCCESS == hkl_solver_set(&s, x)){
+		do {
+			++iter;
+			status = hkl_solver_iterate(&s);
+			if (status)
+				break;
+			status = gsl_multiroot_test_residual (hkl_solver_f(&s), HKL_EPSILON / 10.);
+		} while (status == GSL_CONTINUE && iter < 100);
+
+		if (status == GSL_SUCCESS){
+			set_geometry_axes(self, hkl_solver_x(&s)->data);
+			res = TRUE;
+		}
+	}
+
+	/* put back the starting point for the next function */
+	if(!res)
+		set_geometry_axes(self, x->data);
+
 	return res;
 }
 
@@ -445,8 +1111,15 @@ int hkl_mode_auto_set_real(HklMode *self,
 		return FALSE;
 	}
 
-	darray_foreach(function, auto_info->functions)
-		ok |= solve_function(engine, *function);
+	darray_foreach(function, auto_info->functions){
+		GError *err = NULL;
+
+		ok |= solve_function(engine, *function, &err);
+		if(err){
+			g_propagate_error(error, err);
+			return FALSE;
+		}
+	}
 
 	if(!ok){
 		g_set_error(error,
@@ -463,6 +1136,30 @@ int hkl_mode_auto_set_real(HklMode *self,
 	return TRUE;
 }
 
+int hkl_mode_auto_set_local_real(HklMode *self,
+				 HklEngine *engine,
+				 HklGeometry *geometry,
+				 HklDetector *detector,
+				 HklSample *sample,
+				 GError **error)
+{
+	HklModeAutoInfo *auto_info = container_of(self->info, HklModeAutoInfo, info);
+	const HklFunction **function;
+
+	hkl_error (error == NULL || *error == NULL);
+
+	darray_foreach(function, auto_info->functions)
+		if(correct_function(engine, *function))
+			return TRUE;
+
+	g_set_error(error,
+		    HKL_MODE_AUTO_ERROR,
+		    HKL_MODE_AUTO_ERROR_SET,
+		    "the local solver did not converge");
+
+	return FALSE;
+}
+
 HklMode *hkl_mode_auto_with_init_new(const HklModeAutoInfo *auto_info,
 				     const HklModeOperations *ops,
 				     int initialized)
@@ -23,6 +23,7 @@
 #ifndef __HKL_PSEUDOAXIS_COMMON_HKL_PRIVATE__
 #define __HKL_PSEUDOAXIS_COMMON_HKL_PRIVATE__
 
+#include <gsl/gsl_matrix_double.h>      // for gsl_matrix
 #include <gsl/gsl_vector_double.h>      // for gsl_vector
 #include "hkl-pseudoaxis-auto-private.h"
 #include "hkl-pseudoaxis-private.h"     // for HklModeOperations, etc
@@ -37,12 +38,23 @@ struct _HklEngineHkl {
 	HklParameter *l;
 };
 
+/* hkl modes with a closed form solution */
+typedef struct _HklModeHklAnalyticInfo HklModeHklAnalyticInfo;
+struct _HklModeHklAnalyticInfo {
+	const HklModeAutoInfo auto_info;
+	const char *bissector; /* the sample axis at half the detector angle */
+	const darray_string zeros; /* the sample axes kept at zero */
+};
+
+extern void RUBh_minus_Q_ubh(void *params, HklVector *ubh);
 extern int _RUBh_minus_Q_func(const gsl_vector *x, void *params, gsl_vector *f);
+extern int _RUBh_minus_Q_df(const gsl_vector *x, void *params, gsl_matrix *J);
 extern int _double_diffraction_func(const gsl_vector *x, void *params, gsl_vector *f);
 extern int _psi_constant_vertical_func(const gsl_vector *x, void *params, gsl_vector *f);
 extern int _emergence_fixed_func(const gsl_vector *x, void *params, gsl_vector *f);
 
 extern int RUBh_minus_Q(double const x[], void *params, double f[]);
+extern int RUBh_minus_Q_df(double const x[], void *params, gsl_matrix *J);
 extern int _double_diffraction(double const x[], void *params, double f[]);
 
 extern int hkl_mode_get_hkl_real(HklMode *self,
@@ -52,6 +64,13 @@ extern int hkl_mode_get_hkl_real(HklMode *self,
 				 HklSample *sample,
 				 GError **error);
 
+extern int hkl_mode_get_hkl_batch_real(HklMode *self,
+				       HklEngine *engine,
+				       HklSample *sample,
+				       const double qx[], const double qy[], const double qz[],
+				       size_t n,
+				       double *values[]);
+
 extern int hkl_mode_set_hkl_real(HklMode *self,
 				 HklEngine *engine,
 				 HklGeometry *geometry,
@@ -59,6 +78,20 @@ extern int hkl_mode_set_hkl_real(HklMode *self,
 				 HklSample *sample,
 				 GError **error);
 
+extern int hkl_mode_set_hkl_analytic_real(HklMode *self,
+					  HklEngine *engine,
+					  HklGeometry *geometry,
+					  HklDetector *detector,
+					  HklSample *sample,
+					  GError **error);
+
+extern int hkl_mode_set_hkl_analytic_full_real(HklMode *self,
+					       HklEngine *engine,
+					       HklGeometry *geometry,
+					       HklDetector *detector,
+					       HklSample *sample,
+					       GError **error);
+
 extern int hkl_mode_initialized_set_psi_constant_vertical_real(HklMode *base,
 							       HklEngine *engine,
 							       HklGeometry *geometry,
@@ -71,7 +104,8 @@ extern HklEngine *hkl_engine_hkl_new(HklEngineList *engines);
 
 #define HKL_MODE_OPERATIONS_HKL_DEFAULTS	\
 	HKL_MODE_OPERATIONS_AUTO_DEFAULTS,	\
-		.get = hkl_mode_get_hkl_real
+		.get = hkl_mode_get_hkl_real,	\
+		.get_batch = hkl_mode_get_hkl_batch_real
 
 #define HKL_MODE_OPERATIONS_HKL_FULL_DEFAULTS	\
 	HKL_MODE_OPERATIONS_HKL_DEFAULTS,	\
@@ -81,10 +115,23 @@ static const HklModeOperations hkl_mode_operations = {
 	HKL_MODE_OPERATIONS_HKL_DEFAULTS,
 };
 
+#define HKL_MODE_OPERATIONS_HKL_ANALYTIC_DEFAULTS	\
+	HKL_MODE_OPERATIONS_HKL_DEFAULTS,		\
+		.set = hkl_mode_set_hkl_analytic_real
+
+static const HklModeOperations hkl_analytic_mode_operations = {
+	HKL_MODE_OPERATIONS_HKL_ANALYTIC_DEFAULTS,
+};
+
 static const HklModeOperations hkl_full_mode_operations = {
 	HKL_MODE_OPERATIONS_HKL_FULL_DEFAULTS,
 };
 
+static const HklModeOperations hkl_analytic_full_mode_operations = {
+	HKL_MODE_OPERATIONS_HKL_DEFAULTS,
+	.set = hkl_mode_set_hkl_analytic_full_real,
+};
+
 static const HklModeOperations psi_constant_vertical_mode_operations = {
 	HKL_MODE_OPERATIONS_HKL_FULL_DEFAULTS,
 	.capabilities = HKL_ENGINE_CAPABILITIES_READABLE | HKL_ENGINE_CAPABILITIES_WRITABLE | HKL_ENGINE_CAPABILITIES_INITIALIZABLE,
@@ -94,21 +141,26 @@ static const HklModeOperations psi_constant_vertical_mode_operations = {
 static const HklModeOperations constant_incidence_mode_operations = {
 	HKL_MODE_OPERATIONS_AUTO_WITH_INIT_DEFAULTS,
 	.get = hkl_mode_get_hkl_real,
+	.get_batch = hkl_mode_get_hkl_batch_real,
 	.set = hkl_mode_set_hkl_real
 };
 
 static const HklFunction RUBh_minus_Q_func = {
 	.function = _RUBh_minus_Q_func,
+	.df = _RUBh_minus_Q_df,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 3,
 };
 
 static const HklFunction double_diffraction_func = {
 	.function = _double_diffraction_func,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
 static const HklFunction psi_constant_vertical_func = {
 	.function = _psi_constant_vertical_func,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
@@ -195,6 +247,7 @@ static const HklParameter constant_incidence_parameters[] = {
 
 static const HklFunction emergence_fixed_func = {
 	.function = _emergence_fixed_func,
+	.ubh = RUBh_minus_Q_ubh,
 	.size = 4,
 };
 
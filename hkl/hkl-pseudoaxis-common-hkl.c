@@ -20,13 +20,15 @@
  * Authors: Picca Frédéric-Emmanuel <picca@synchrotron-soleil.fr>
  *          Maria-Teresa Nunez-Pardo-de-Verra <tnunez@mail.desy.de>
  */
+#include <alloca.h>                     // for alloca
 #include <gsl/gsl_errno.h>              // for ::GSL_SUCCESS, etc
+#include <gsl/gsl_matrix_double.h>      // for gsl_matrix_set
 #include <gsl/gsl_multiroots.h>
 #include <gsl/gsl_sf_trig.h>            // for gsl_sf_angle_restrict_pos
 #include <gsl/gsl_vector_double.h>      // for gsl_vector, etc
 #include <math.h>                       // for fabs, M_PI
 #include <stddef.h>                     // for size_t
-#include <stdlib.h>                     // for free, malloc, rand, etc
+#include <stdlib.h>                     // for free, malloc, etc
 #include <string.h>                     // for NULL
 #include <sys/types.h>                  // for uint
 #include "hkl-axis-private.h"           // for HklAxis
@@ -105,12 +107,13 @@ static int fit_detector_function(const gsl_vector *x, void *params, gsl_vector *
 }
 
 
-static int fit_detector_position(HklMode *mode, HklGeometry *geometry,
+static int fit_detector_position(HklEngine *engine, HklMode *mode,
+				 HklGeometry *geometry,
 				 HklDetector *detector, HklVector *kf)
 {
-	const char **axis_name;
+	const int *idx;
 	HklDetectorFit params;
-	gsl_multiroot_fsolver_type const *T;
+	HklModeAutoWorkspace *ws = hkl_mode_auto_workspace_get(mode);
 	gsl_multiroot_fsolver *s;
 	gsl_multiroot_function f;
 	gsl_vector *x;
@@ -129,14 +132,13 @@ static int fit_detector_position(HklMode *mode, HklGeometry *geometry,
 	params.geometry = geometry;
 	params.detector = detector;
 	params.kf0 = kf;
-	params.axes = malloc(sizeof(*params.axes) * detector_holder->config->len);
+	params.axes = ws->axes;
 	params.len = 0;
 	/* for each axis of the mode */
-	darray_foreach(axis_name, mode->info->axes_w){
+	darray_foreach(idx, mode->axes_w_idx){
 		size_t k;
-		size_t tmp;
+		size_t tmp = *idx;
 
-		tmp = hkl_geometry_get_axis_idx_by_name(params.geometry, *axis_name);
 		/* check that this axis is in the detector's holder */
 		for(k=0; k<detector_holder->config->len; ++k)
 			if(tmp == detector_holder->config->idx[k]){
@@ -159,12 +161,15 @@ static int fit_detector_position(HklMode *mode, HklGeometry *geometry,
 	/* maybe put this at the begining of the method */
 	if (params.len > 0){
 		size_t i;
+		double *shift = alloca(params.len * sizeof(*shift));
+		unsigned int n_restarts = 0;
+
+		hkl_engine_restart_shift(engine, shift, params.len);
 
 		/* now solve the system */
 		/* Initialize method  */
-		T = gsl_multiroot_fsolver_hybrid;
-		s = gsl_multiroot_fsolver_alloc (T, params.len);
-		x = gsl_vector_alloc(params.len);
+		s = hkl_mode_auto_workspace_fsolver(ws, params.len);
+		x = hkl_mode_auto_workspace_x(ws, params.len);
 
 		/* initialize x with the right values */
 		for(i=0; i<params.len; ++i)
@@ -182,8 +187,8 @@ static int fit_detector_position(HklMode *mode, HklGeometry *geometry,
 			status = gsl_multiroot_fsolver_iterate(s);
 			if (status || iter % 100 == 0) {
 				/* Restart from another point. */
-				for(i=0; i<params.len; ++i)
-					x->data[i] = (double)rand() / RAND_MAX * 180. / M_PI;
+				hkl_parameter_restart_point(params.axes, params.len,
+							    ++n_restarts, shift, x->data);
 				gsl_multiroot_fsolver_set(s, &f, x);
 				gsl_multiroot_fsolver_iterate(s);
 			}
@@ -217,11 +222,7 @@ static int fit_detector_position(HklMode *mode, HklGeometry *geometry,
 							HKL_UNIT_DEFAULT, NULL);
 			}
 		}
-		/* release memory */
-		gsl_vector_free(x);
-		gsl_multiroot_fsolver_free(s);
 	}
-	free(params.axes);
 
 	return res;
 }
@@ -230,21 +231,19 @@ static int fit_detector_position(HklMode *mode, HklGeometry *geometry,
 /* BEWARE, NOT the axis index in the geometry->axes */
 /* which is part of the axis_names of the mode */
 /* return -1 if there is no axes of the mode in the sample part of the geometry */
-static int get_last_axis_idx(HklGeometry *geometry, int holder_idx, const darray_string *axes)
+static int get_last_axis_idx(HklGeometry *geometry, int holder_idx, const darray_int *axes)
 {
 	int last = -1;
-	const char **axis_name;
+	const int *idx;
 	HklHolder *holder;
 
 	holder = darray_item(geometry->holders, holder_idx);
-	darray_foreach(axis_name, *axes){
+	darray_foreach(idx, *axes){
 		size_t i;
-		size_t idx;
 
 		/* FIXME for now the sample holder is the first one */
-		idx = hkl_geometry_get_axis_idx_by_name(geometry, *axis_name);
 		for(i=0; i<holder->config->len; ++i)
-			if(idx == holder->config->idx[i]){
+			if((size_t)*idx == holder->config->idx[i]){
 				last = last > (int)i ? last : (int)i;
 				break;
 			}
@@ -276,6 +275,26 @@ static int hkl_is_reachable(HklEngine *engine, double wavelength, GError **error
 	return TRUE;
 }
 
+/**
+ * RUBh_minus_Q_ubh: (skip)
+ * @params: the #HklEngine
+ * @ubh: (out caller-allocates): UB.hkl
+ *
+ * the sample vector of the RUBh_minus_Q functions before the sample
+ * holder rotation.
+ **/
+void RUBh_minus_Q_ubh(void *params, HklVector *ubh)
+{
+	HklEngine *engine = params;
+	HklEngineHkl *engine_hkl = container_of(engine, HklEngineHkl, engine);
+
+	hkl_vector_init(ubh,
+			engine_hkl->h->_value,
+			engine_hkl->k->_value,
+			engine_hkl->l->_value);
+	hkl_matrix_times_vector(&engine->sample->UB, ubh);
+}
+
 /**
  * _RUBh_minus_Q_func: (skip)
  * @x:
@@ -340,6 +359,90 @@ int RUBh_minus_Q(double const x[], void *params, double f[])
 	return GSL_SUCCESS;
 }
 
+/**
+ * _RUBh_minus_Q_df: (skip)
+ * @x:
+ * @params:
+ * @J:
+ *
+ * Only usefull if you need to create a new hkl mode.
+ *
+ * Returns:
+ **/
+int _RUBh_minus_Q_df(const gsl_vector *x, void *params, gsl_matrix *J)
+{
+	CHECK_NAN(x->data, x->size);
+
+	return RUBh_minus_Q_df(x->data, params, J);
+}
+
+/**
+ * RUBh_minus_Q_df: (skip)
+ * @x:
+ * @params:
+ * @J:
+ *
+ * analytic jacobian of the RUBh_minus_Q function. Only the first
+ * three rows of J are set, one column per axis of the engine.
+ *
+ * for a rotation axis of the detector holder d(kf)/dx = a ^ kf
+ * for a rotation axis of the sample holder d(R.UB.h)/dx = a ^ R.UB.h
+ * with a the axis direction in the laboratory frame.
+ *
+ * Returns:
+ **/
+int RUBh_minus_Q_df(double const x[], void *params, gsl_matrix *J)
+{
+	HklEngine *engine = params;
+	HklEngineHkl *engine_hkl = container_of(engine, HklEngineHkl, engine);
+	HklVector Hkl = {
+		.data = {
+			engine_hkl->h->_value,
+			engine_hkl->k->_value,
+			engine_hkl->l->_value,
+		},
+	};
+	HklVector kf;
+	HklHolder *sample_holder;
+	HklHolder *detector_holder;
+	HklParameter **axis;
+	size_t j = 0;
+
+	/* update the workspace from x; */
+	set_geometry_axes(engine, x);
+
+	/* R * UB * h = Q */
+	/* for now the 0 holder is the sample holder. */
+	sample_holder = darray_item(engine->geometry->holders, 0);
+	detector_holder = darray_item(engine->geometry->holders, engine->detector->idx);
+	hkl_matrix_times_vector(&engine->sample->UB, &Hkl);
+	hkl_vector_rotated_quaternion(&Hkl, &sample_holder->q);
+
+	hkl_detector_compute_kf(engine->detector, engine->geometry, &kf);
+
+	darray_foreach(axis, engine->axes){
+		HklVector a;
+		HklVector df = {{0}};
+
+		/* an axis can be part of the two holders */
+		if(hkl_holder_axis_v_lab(detector_holder, *axis, &a)){
+			hkl_vector_vectorial_product(&a, &kf);
+			hkl_vector_add_vector(&df, &a);
+		}
+		if(hkl_holder_axis_v_lab(sample_holder, *axis, &a)){
+			hkl_vector_vectorial_product(&a, &Hkl);
+			hkl_vector_minus_vector(&df, &a);
+		}
+
+		gsl_matrix_set(J, 0, j, df.data[0]);
+		gsl_matrix_set(J, 1, j, df.data[1]);
+		gsl_matrix_set(J, 2, j, df.data[2]);
+		++j;
+	}
+
+	return GSL_SUCCESS;
+}
+
 int hkl_mode_get_hkl_real(HklMode *self,
 			  HklEngine *engine,
 			  HklGeometry *geometry,
@@ -375,6 +478,58 @@ int hkl_mode_get_hkl_real(HklMode *self,
 	return TRUE;
 }
 
+/**
+ * hkl_mode_get_hkl_batch_real: (skip)
+ * @self:
+ * @engine:
+ * @sample:
+ * @qx: the x coordinates of the sample frame Q of the frames
+ * @qy: the y coordinates of the sample frame Q of the frames
+ * @qz: the z coordinates of the sample frame Q of the frames
+ * @n: the number of frames
+ * @values: the h, k and l columns to fill
+ *
+ * batched hkl_mode_get_hkl_real, hkl = UB^-1.R^-1.Q. The caller
+ * already removed the sample rotation R, so UB is inverted once and
+ * applied to all the frames in a loop without any branch.
+ *
+ * Returns: FALSE if UB is not invertible.
+ **/
+int hkl_mode_get_hkl_batch_real(HklMode *self,
+				HklEngine *engine,
+				HklSample *sample,
+				const double qx[], const double qy[], const double qz[],
+				size_t n,
+				double *values[])
+{
+	HklMatrix UB_1;
+	size_t i, j;
+
+	/* the columns of UB^-1 */
+	for(j=0; j<3; ++j){
+		HklVector e = {{0, 0, 0}};
+		HklVector column;
+
+		e.data[j] = 1;
+		if(!hkl_matrix_solve(&sample->UB, &column, &e))
+			return FALSE;
+		for(i=0; i<3; ++i)
+			UB_1.data[i][j] = column.data[i];
+	}
+
+	for(j=0; j<3; ++j){
+		const double m0 = UB_1.data[j][0];
+		const double m1 = UB_1.data[j][1];
+		const double m2 = UB_1.data[j][2];
+		double *out = values[j];
+
+		for(i=0; i<n; ++i)
+			out[i] = m0 * qx[i] + m1 * qy[i] + m2 * qz[i];
+	}
+
+	return TRUE;
+}
+
 int hkl_mode_set_hkl_real(HklMode *self,
 			  HklEngine *engine,
 			  HklGeometry *geometry,
@@ -406,7 +561,7 @@ int hkl_mode_set_hkl_real(HklMode *self,
 
 	/* check that the mode allow to move a sample axis */
 	/* FIXME for now the sample holder is the first one */
-	last_axis = get_last_axis_idx(geometry, 0, &self->info->axes_w);
+	last_axis = get_last_axis_idx(geometry, 0, &self->axes_w_idx);
 	if(last_axis >= 0){
 		uint i;
 		const HklGeometryListItem *item;
@@ -494,7 +649,7 @@ int hkl_mode_set_hkl_real(HklMode *self,
 			hkl_vector_add_vector(&kf2, &ki);
 
 			/* at the end we just need to solve numerically the position of the detector */
-			if(fit_detector_position(self, geom, detector, &kf2))
+			if(fit_detector_position(engine, self, geom, detector, &kf2))
 				hkl_geometry_list_add(engine->engines->geometries,
 						      geom);
 
@@ -504,6 +659,418 @@ int hkl_mode_set_hkl_real(HklMode *self,
 	return TRUE;
 }
 
+/*****************************/
+/* the analytic hkl set part */
+/*****************************/
+
+/* role of each axis of the engine in the analytic solver */
+enum analytic_axis {
+	ANALYTIC_AXIS_DETECTOR,
+	ANALYTIC_AXIS_SAMPLE,
+	ANALYTIC_AXIS_BISSECTOR,
+	ANALYTIC_AXIS_ZERO,
+};
+
+/* position of an axis in an holder, -1 if not part of it */
+static int holder_axis_position(const HklHolder *holder,
+				const HklParameter *axis)
+{
+	size_t i;
+
+	for(i=0; i<holder->config->len; ++i)
+		if(darray_item(holder->geometry->axes, holder->config->idx[i]) == axis)
+			return i;
+	return -1;
+}
+
+/* the angle of the rotation around the axis a which brings u onto v
+ * (Paden-Kahan subproblem 1). The angle is undetermined and the
+ * method returns FALSE if u or v are colinear with the axis. */
+static int subproblem1(const HklVector *a, const HklVector *u,
+		       const HklVector *v, double *angle)
+{
+	HklVector up = *u;
+	HklVector vp = *v;
+	HklVector w;
+
+	hkl_vector_project_on_plan(&up, a);
+	hkl_vector_project_on_plan(&vp, a);
+	if(hkl_vector_norm2(&up) < HKL_EPSILON
+	   || hkl_vector_norm2(&vp) < HKL_EPSILON)
+		return FALSE;
+
+	w = up;
+	hkl_vector_vectorial_product(&w, &vp);
+	*angle = atan2(hkl_vector_scalar_product(a, &w),
+		       hkl_vector_scalar_product(&up, &vp));
+
+	return TRUE;
+}
+
+/* the z vectors such as R(a1, t1).z = q and z = R(a2, t2).p
+ * (Paden-Kahan subproblem 2). a1 and a2 are unit vectors. z is the
+ * intersection of the two cones, return the number of solutions. */
+static int subproblem2(const HklVector *a1, const HklVector *a2,
+		       const HklVector *p, const HklVector *q,
+		       HklVector z[2])
+{
+	HklVector a1a2 = *a1;
+	double c = hkl_vector_scalar_product(a1, a2);
+	double d = c * c - 1;
+	double p2 = hkl_vector_scalar_product(p, p);
+	double alpha, beta, gamma2;
+	int i, n;
+
+	/* parallel axes, there is an infinity of solutions */
+	if(fabs(d) < HKL_EPSILON)
+		return 0;
+
+	alpha = (c * hkl_vector_scalar_product(a2, p) - hkl_vector_scalar_product(a1, q)) / d;
+	beta = (c * hkl_vector_scalar_product(a1, q) - hkl_vector_scalar_product(a2, p)) / d;
+
+	hkl_vector_vectorial_product(&a1a2, a2);
+	gamma2 = (p2 - alpha * alpha - beta * beta - 2 * alpha * beta * c)
+		/ hkl_vector_scalar_product(&a1a2, &a1a2);
+
+	if(gamma2 < -HKL_EPSILON * p2)
+		return 0;
+	n = gamma2 > HKL_EPSILON * p2 ? 2 : 1;
+
+	for(i=0; i<n; ++i){
+		HklVector tmp = *a2;
+
+		z[i] = *a1;
+		hkl_vector_times_double(&z[i], alpha);
+		hkl_vector_times_double(&tmp, beta);
+		hkl_vector_add_vector(&z[i], &tmp);
+		tmp = a1a2;
+		hkl_vector_times_double(&tmp, (i ? -1 : 1) * sqrt(gamma2 > 0 ? gamma2 : 0));
+		hkl_vector_add_vector(&z[i], &tmp);
+	}
+
+	return n;
+}
+
+/* the angles of the detector axis a which put kf = R(a, t).kf0 on the
+ * cone ki.kf = c. This is A cos(t) + B sin(t) = C, return the number
+ * of solutions. */
+static int detector_angles(const HklVector *a, const HklVector *kf0,
+			   const HklVector *ki, double c, double angles[2])
+{
+	HklVector u_par = *a;
+	HklVector u_perp = *kf0;
+	HklVector w = *a;
+	double A, B, C, R, t0, dt;
+
+	hkl_vector_times_double(&u_par, hkl_vector_scalar_product(a, kf0));
+	hkl_vector_minus_vector(&u_perp, &u_par);
+	hkl_vector_vectorial_product(&w, kf0);
+
+	A = hkl_vector_scalar_product(ki, &u_perp);
+	B = hkl_vector_scalar_product(ki, &w);
+	C = c - hkl_vector_scalar_product(ki, &u_par);
+	R = sqrt(A * A + B * B);
+
+	if(R < HKL_EPSILON || fabs(C) > R * (1 + HKL_EPSILON))
+		return 0;
+
+	t0 = atan2(B, A);
+	dt = acos(fabs(C) > R ? (C > 0 ? 1 : -1) : C / R);
+	angles[0] = gsl_sf_angle_restrict_symm(t0 + dt);
+	angles[1] = gsl_sf_angle_restrict_symm(t0 - dt);
+
+	return dt > HKL_EPSILON ? 2 : 1;
+}
+
+/* a solution is kept only if it is a root of one of the mode
+ * functions, like the numerical solver does for its sectors. */
+static int analytic_test_solution(HklEngine *engine,
+				  const HklModeAutoInfo *auto_info,
+				  gsl_vector *x, gsl_vector *f)
+{
+	const HklFunction **function;
+
+	darray_foreach(function, auto_info->functions){
+		size_t i;
+		int res = TRUE;
+
+		if((*function)->size != x->size)
+			continue;
+
+		(*function)->function(x, engine, f);
+		for(i=0; i<f->size; ++i)
+			if(fabs(f->data[i]) > HKL_EPSILON){
+				res = FALSE;
+				break;
+			}
+		if(res)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* the numerical solver used when the closed form does not apply */
+typedef int (* HklModeSetFunction) (HklMode *self,
+				    HklEngine *engine,
+				    HklGeometry *geometry,
+				    HklDetector *detector,
+				    HklSample *sample,
+				    GError **error);
+
+/*
+ * closed form solution of the hkl modes with one detector axis and
+ * two free sample axes, the other sample axes of the mode being
+ * either zero or the half of the detector angle (bissector).
+ *
+ * the detector angle put kf on the Ewald cone of Q = UB.h, then the
+ * two sample angles are the intersection of two cones (Paden-Kahan
+ * subproblem 2). All the branches are tested against the mode
+ * functions and added to the engines geometries. When the mode does
+ * not fit this scheme, is degenerated (parallel sample axes) or when
+ * no branch is found, even for an hkl out of the Ewald cone of the
+ * detector axis, the numerical solver is used instead. So the closed
+ * form never reports an error the numerical solver would not.
+ */
+static int analytic_set(HklMode *self,
+			HklEngine *engine,
+			HklGeometry *geometry,
+			HklDetector *detector,
+			HklSample *sample,
+			HklModeSetFunction numerical,
+			GError **error)
+{
+	HklModeAutoInfo *auto_info = container_of(self->info, HklModeAutoInfo, info);
+	HklModeHklAnalyticInfo *info = container_of(auto_info, HklModeHklAnalyticInfo, auto_info);
+	HklEngineHkl *engine_hkl = container_of(engine, HklEngineHkl, engine);
+	size_t len = darray_size(engine->axes);
+	enum analytic_axis *roles = alloca(len * sizeof(*roles));
+	double *x0 = alloca(len * sizeof(*x0));
+	HklHolder *sample_holder;
+	HklHolder *detector_holder;
+	HklParameter **axis;
+	HklVector Hkl = {
+		.data = {
+			engine_hkl->h->_value,
+			engine_hkl->k->_value,
+			engine_hkl->l->_value,
+		},
+	};
+	HklVector ki, kf0, a_d;
+	double k, c;
+	double tths[2];
+	int n_tths;
+	int detector_idx = -1;
+	int sample_idx[2] = {-1, -1};
+	size_t n_sample = 0;
+	size_t n_zeros = 0;
+	size_t n_added;
+	size_t i;
+	int bissector = FALSE;
+	int t;
+	HklModeAutoWorkspace *ws = hkl_mode_auto_workspace_get(self);
+	gsl_vector *_x = ws->_x;
+	gsl_vector *_f = ws->_f;
+
+	hkl_error (error == NULL || *error == NULL);
+
+	if(ws->numerical)
+		goto numerical;
+
+	sample_holder = darray_item(engine->geometry->holders, 0);
+	detector_holder = darray_item(engine->geometry->holders, engine->detector->idx);
+
+	/* classify the axes of the mode */
+	i = 0;
+	darray_foreach(axis, engine->axes){
+		int in_sample = holder_axis_position(sample_holder, *axis) >= 0;
+		int in_detector = holder_axis_position(detector_holder, *axis) >= 0;
+		const char **name;
+
+		x0[i] = (*axis)->_value;
+		if(in_sample == in_detector)
+			goto numerical;
+
+		if(in_detector){
+			if(detector_idx >= 0)
+				goto numerical;
+			roles[i] = ANALYTIC_AXIS_DETECTOR;
+			detector_idx = i;
+		}else{
+			roles[i] = ANALYTIC_AXIS_SAMPLE;
+			if(info->bissector && !strcmp(info->bissector, (*axis)->name)){
+				roles[i] = ANALYTIC_AXIS_BISSECTOR;
+				bissector = TRUE;
+			}
+			darray_foreach(name, info->zeros)
+				if(!strcmp(*name, (*axis)->name)){
+					roles[i] = ANALYTIC_AXIS_ZERO;
+					++n_zeros;
+				}
+			if(roles[i] == ANALYTIC_AXIS_SAMPLE){
+				if(n_sample >= 2)
+					goto numerical;
+				sample_idx[n_sample++] = i;
+			}
+		}
+		++i;
+	}
+	if(detector_idx < 0 || n_sample != 2)
+		goto numerical;
+
+	/* the outer sample axis first */
+	if(holder_axis_position(sample_holder, darray_item(engine->axes, sample_idx[0]))
+	   > holder_axis_position(sample_holder, darray_item(engine->axes, sample_idx[1]))){
+		int tmp = sample_idx[0];
+		sample_idx[0] = sample_idx[1];
+		sample_idx[1] = tmp;
+	}
+
+	/* the detector angles. |kf - ki| = |Q| gives ki.kf = k^2 - |Q|^2 / 2 */
+	hkl_parameter_value_set(darray_item(engine->axes, detector_idx),
+				0, HKL_UNIT_DEFAULT, NULL);
+	hkl_detector_compute_kf(engine->detector, engine->geometry, &kf0);
+	hkl_holder_axis_v_lab(detector_holder,
+			      darray_item(engine->axes, detector_idx), &a_d);
+	hkl_source_compute_ki(&engine->geometry->source, &ki);
+	hkl_matrix_times_vector(&engine->sample->UB, &Hkl);
+
+	k = hkl_vector_norm2(&ki);
+	c = k * k - hkl_vector_scalar_product(&Hkl, &Hkl) / 2;
+	n_tths = detector_angles(&a_d, &kf0, &ki, c, tths);
+
+	n_added = engine->engines->geometries->n_items;
+
+	for(t=0; t<n_tths; ++t){
+		HklVector Q = kf0;
+		unsigned int variant;
+
+		/* Q = kf - ki */
+		hkl_vector_rotated_around_vector(&Q, &a_d, tths[t]);
+		hkl_vector_minus_vector(&Q, &ki);
+
+		/* each zero axis can be at 0 or pi and the bissector
+		 * axis at tth / 2, tth / 2 + pi or tth / 2 - pi */
+		for(variant=0; variant<(4u << n_zeros); ++variant){
+			unsigned int zeros = variant >> 2;
+			unsigned int half = variant & 3;
+			HklVector a1, a2, p;
+			HklVector z[2];
+			int n_z, j;
+
+			if(half == 3 || (half && !bissector))
+				continue;
+
+			for(i=0; i<len; ++i){
+				HklParameter *parameter = darray_item(engine->axes, i);
+				double value = 0;
+
+				switch(roles[i]){
+				case ANALYTIC_AXIS_DETECTOR:
+					value = tths[t];
+					break;
+				case ANALYTIC_AXIS_BISSECTOR:
+					value = tths[t] / 2 + (half == 1 ? M_PI : half == 2 ? -M_PI : 0);
+					break;
+				case ANALYTIC_AXIS_ZERO:
+					value = (zeros & 1) ? M_PI : 0;
+					zeros >>= 1;
+					break;
+				case ANALYTIC_AXIS_SAMPLE:
+					value = 0;
+					break;
+				}
+				_x->data[i] = value;
+				hkl_parameter_value_set(parameter, value, HKL_UNIT_DEFAULT, NULL);
+			}
+			hkl_geometry_update(engine->geometry);
+
+			/* R(a1, t1).R(a2, t2).p = Q with the free axes at zero */
+			hkl_holder_axis_v_lab(sample_holder,
+					      darray_item(engine->axes, sample_idx[0]), &a1);
+			hkl_holder_axis_v_lab(sample_holder,
+					      darray_item(engine->axes, sample_idx[1]), &a2);
+			p = Hkl;
+			hkl_vector_rotated_quaternion(&p, &sample_holder->q);
+
+			n_z = subproblem2(&a1, &a2, &p, &Q, z);
+			for(j=0; j<n_z; ++j){
+				double *t1 = &_x->data[sample_idx[0]];
+				double *t2 = &_x->data[sample_idx[1]];
+
+				if(!subproblem1(&a2, &p, &z[j], t2))
+					*t2 = x0[sample_idx[1]];
+				if(!subproblem1(&a1, &z[j], &Q, t1))
+					*t1 = x0[sample_idx[0]];
+
+				if(analytic_test_solution(engine, auto_info, _x, _f))
+					hkl_engine_add_geometry(engine, _x->data);
+			}
+		}
+	}
+	n_added = engine->engines->geometries->n_items - n_added;
+
+	if(n_added)
+		return TRUE;
+
+	/* restore the starting point of the numerical solver */
+	set_geometry_axes(engine, x0);
+
+numerical:
+	return numerical(self, engine, geometry, detector, sample, error);
+}
+
+/**
+ * hkl_mode_set_hkl_analytic_real: (skip)
+ * @self:
+ * @engine:
+ * @geometry:
+ * @detector:
+ * @sample:
+ * @error:
+ *
+ * closed form solution of the hkl modes, see analytic_set. The
+ * numerical fallback is hkl_mode_auto_set_real.
+ *
+ * Returns:
+ **/
+int hkl_mode_set_hkl_analytic_real(HklMode *self,
+				   HklEngine *engine,
+				   HklGeometry *geometry,
+				   HklDetector *detector,
+				   HklSample *sample,
+				   GError **error)
+{
+	return analytic_set(self, engine, geometry, detector, sample,
+			    hkl_mode_auto_set_real, error);
+}
+
+/**
+ * hkl_mode_set_hkl_analytic_full_real: (skip)
+ * @self:
+ * @engine:
+ * @geometry:
+ * @detector:
+ * @sample:
+ * @error:
+ *
+ * closed form solution of the hkl modes, see analytic_set. The
+ * numerical fallback is hkl_mode_set_hkl_real, the closed form
+ * already contains its Ewald construction solutions.
+ *
+ * Returns:
+ **/
+int hkl_mode_set_hkl_analytic_full_real(HklMode *self,
+					HklEngine *engine,
+					HklGeometry *geometry,
+					HklDetector *detector,
+					HklSample *sample,
+					GError **error)
+{
+	return analytic_set(self, engine, geometry, detector, sample,
+			    hkl_mode_set_hkl_real, error);
+}
+
 /***************************************/
 /* the double diffraction get set part */
 /***************************************/
@@ -177,6 +177,20 @@ static int hkl_mode_initialized_set_psi_real(HklMode *self,
 	return TRUE;
 }
 
+static int hkl_mode_init_copy_psi_real(HklMode *self, const HklMode *src)
+{
+	HklModePsi *psi_mode = container_of(self, HklModePsi, parent);
+	const HklModePsi *psi_src = container_of(src, HklModePsi, parent);
+
+	if(!hkl_mode_init_copy_real(self, src))
+		return FALSE;
+
+	psi_mode->Q0 = psi_src->Q0;
+	psi_mode->hkl0 = psi_src->hkl0;
+
+	return TRUE;
+}
+
 static int hkl_mode_get_psi_real(HklMode *base,
 				 HklEngine *engine,
 				 HklGeometry *geometry,
@@ -252,6 +266,7 @@ HklMode *hkl_mode_psi_new(const HklModeAutoInfo *auto_info)
 	static const HklModeOperations operations = {
 		HKL_MODE_OPERATIONS_AUTO_DEFAULTS,
 		.capabilities = HKL_ENGINE_CAPABILITIES_READABLE | HKL_ENGINE_CAPABILITIES_WRITABLE | HKL_ENGINE_CAPABILITIES_INITIALIZABLE,
+		.init_copy = hkl_mode_init_copy_psi_real,
 		.initialized_set = hkl_mode_initialized_set_psi_real,
 		.get = hkl_mode_get_psi_real,
 	};
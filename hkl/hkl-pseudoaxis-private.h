@@ -22,15 +22,18 @@
 #ifndef __HKL_PSEUDOAXIS_PRIVATE_H__
 #define __HKL_PSEUDOAXIS_PRIVATE_H__
 
+#include <alloca.h>                     // for alloca
 #include <gsl/gsl_sf_trig.h>            // for gsl_sf_angle_restrict_symm
 #include <stddef.h>                     // for size_t
 #include <stdlib.h>                     // for free
 #include <string.h>                     // for NULL
 #include <sys/types.h>                  // for uint
+#include "hkl-axis-private.h"           // for hkl_axis_values_set_fast
 #include "hkl-detector-private.h"
 #include "hkl-geometry-private.h"       // for hkl_geometry_update, etc
 #include "hkl-macros-private.h"         // for HKL_MALLOC
 #include "hkl-parameter-private.h"      // for hkl_parameter_list_free, etc
+#include "hkl-sample-private.h"         // for hkl_sample_init_copy_UB
 #include "hkl.h"                        // for HklEngine, HklMode, etc
 #include "hkl/ccan/array_size/array_size.h"
 #include "hkl/ccan/darray/darray.h"     // for darray_foreach, etc
@@ -40,6 +43,7 @@ G_BEGIN_DECLS
 typedef struct _HklModeOperations HklModeOperations;
 typedef struct _HklModeInfo HklModeInfo;
 typedef struct _HklMode HklMode;
+typedef struct _HklModeAutoWorkspace HklModeAutoWorkspace;
 typedef struct _HklEngineInfo HklEngineInfo;
 typedef struct _HklEngineOperations HklEngineOperations;
 
@@ -68,6 +72,7 @@ struct _HklModeOperations
 	unsigned long capabilities;
 
 	void (* free)(HklMode *self);
+	int (* init_copy)(HklMode *self, const HklMode *src);
 	int (* initialized_get)(const HklMode *self);
 	int (* initialized_set)(HklMode *self,
 				HklEngine *engine,
@@ -88,15 +93,31 @@ struct _HklModeOperations
 		    HklDetector *detector,
 		    HklSample *sample,
 		    GError **error);
+	int (* set_local)(HklMode *self,
+			  HklEngine *engine,
+			  HklGeometry *geometry,
+			  HklDetector *detector,
+			  HklSample *sample,
+			  GError **error);
+	/* optional, the pseudo axes of n frames from their scattering
+	 * vectors Q = kf - ki expressed in the sample holder frame */
+	int (* get_batch)(HklMode *self,
+			  HklEngine *engine,
+			  HklSample *sample,
+			  const double qx[], const double qy[], const double qz[],
+			  size_t n,
+			  double *values[]);
 };
 
 
 #define HKL_MODE_OPERATIONS_DEFAULTS .capabilities=HKL_ENGINE_CAPABILITIES_READABLE | HKL_ENGINE_CAPABILITIES_WRITABLE, \
 		.free=hkl_mode_free_real,				\
+		.init_copy=hkl_mode_init_copy_real,			\
 		.initialized_get=hkl_mode_initialized_get_real,		\
 		.initialized_set=hkl_mode_initialized_set_real,		\
 		.get=hkl_mode_get_real,					\
-		.set=hkl_mode_set_real
+		.set=hkl_mode_set_real,					\
+		.set_local=hkl_mode_set_local_real
 
 
 struct _HklMode
@@ -106,8 +127,12 @@ struct _HklMode
 	darray_parameter parameters;
 	darray_string parameters_names;
 	int initialized;
+	HklModeAutoWorkspace *workspace; /* the numerical solvers memory */
+	darray_int axes_w_idx; /* indexes of the axes_w in the geometry */
 };
 
+extern void hkl_mode_auto_workspace_free(HklModeAutoWorkspace *self);
+
 
 static inline void hkl_mode_free_real(HklMode *self)
 {
@@ -120,10 +145,38 @@ static inline void hkl_mode_free_real(HklMode *self)
 
 	darray_free(self->parameters_names);
 
+	darray_free(self->axes_w_idx);
+
+	if(self->workspace)
+		hkl_mode_auto_workspace_free(self->workspace);
+
 	free(self);
 }
 
 
+/* copy the parameters values and the initialization state of src, the
+ * same mode of another engine list. Modes which keep some state
+ * computed during the initialization must also copy it. */
+static inline int hkl_mode_init_copy_real(HklMode *self, const HklMode *src)
+{
+	for(size_t i=0; i<darray_size(self->parameters); ++i)
+		if(!hkl_parameter_init_copy(darray_item(self->parameters, i),
+					    darray_item(src->parameters, i),
+					    NULL))
+			return FALSE;
+
+	self->initialized = src->initialized;
+
+	return TRUE;
+}
+
+
+static inline int hkl_mode_init_copy(HklMode *self, const HklMode *src)
+{
+	return self->ops->init_copy(self, src);
+}
+
+
 static inline int hkl_mode_initialized_get_real(const HklMode *self)
 {
 	return self->initialized;
@@ -187,6 +240,21 @@ static inline int hkl_mode_set_real(HklMode *self,
 }
 
 
+/* set_local converge from the current engine geometry without any
+ * restart and without exploring the other solutions. The default
+ * implementation does not know how to do this. */
+static inline int hkl_mode_set_local_real(HklMode *self,
+					  HklEngine *engine,
+					  HklGeometry *geometry,
+					  HklDetector *detector,
+					  HklSample *sample,
+					  GError **error)
+{
+	/* by default do nothing and no error */
+	return FALSE;
+}
+
+
 static inline int hkl_mode_init(HklMode *self,
 				const HklModeInfo *info,
 				const HklModeOperations *ops,
@@ -210,6 +278,8 @@ static inline int hkl_mode_init(HklMode *self,
 	}
 
 	self->initialized = initialized;
+	self->workspace = NULL;
+	darray_init(self->axes_w_idx);
 
 	return TRUE;
 }
@@ -229,6 +299,28 @@ static inline HklMode *hkl_mode_new(const HklModeInfo *info,
 }
 
 
+/**
+ * hkl_mode_axes_w_resolve: (skip)
+ * @self: the HklMode
+ * @geometry: the geometry the mode is attached to
+ *
+ * resolve once the names of the axes_w of the mode into the indexes
+ * of these axes in the @geometry, so the solvers do not have to look
+ * for them by name.
+ **/
+static inline void hkl_mode_axes_w_resolve(HklMode *self,
+					   const HklGeometry *geometry)
+{
+	const char **axis_name;
+
+	darray_resize(self->axes_w_idx, 0);
+	darray_foreach(axis_name, self->info->axes_w){
+		darray_append(self->axes_w_idx,
+			      hkl_geometry_get_axis_idx_by_name(geometry, *axis_name));
+	}
+}
+
+
 /**
  * hkl_mode_free: (skip)
  * @self:
@@ -255,6 +347,14 @@ struct _HklEngineInfo {
 		.pseudo_axes = DARRAY(_pseudo_axes),			\
 		.dependencies = (_dependencies)
 
+/* the generations of the inputs of the pseudo axes values */
+struct HklEngineInputs {
+	int valid;
+	int axes;
+	int source;
+	int sample;
+};
+
 struct _HklEngine
 {
 	const HklEngineInfo *info;
@@ -269,6 +369,9 @@ struct _HklEngine
 	darray_string pseudo_axis_names;
 	darray_mode modes;
 	darray_string mode_names;
+	GRand *rand; /* solvers restarts */
+	unsigned int n_parallel_starts; /* solvers restarts run in parallel */
+	struct HklEngineInputs inputs; /* of the current pseudo axes values */
 };
 
 
@@ -307,12 +410,7 @@ typedef enum {
 
 static inline void set_geometry_axes(HklEngine *engine, const double values[])
 {
-	HklParameter **axis;
-	uint i = 0;
-
-	darray_foreach(axis, engine->axes){
-		hkl_parameter_value_set(*axis, values[i++], HKL_UNIT_DEFAULT, NULL);
-	}
+	hkl_axis_values_set_fast(engine->axes.item, values, darray_size(engine->axes));
 	hkl_geometry_update(engine->geometry);
 }
 
@@ -330,6 +428,8 @@ static inline void hkl_engine_release(HklEngine *self)
 	if(self->sample)
 		hkl_sample_free(self->sample);
 
+	g_rand_free(self->rand);
+
 	/* release the mode added */
 	darray_foreach(mode, self->modes){
 		hkl_mode_free(*mode);
@@ -343,6 +443,10 @@ static inline void hkl_engine_release(HklEngine *self)
 }
 
 
+/* the default seed of the engines random generator, so two runs
+ * explore the same restart points */
+#define HKL_ENGINE_RANDOM_SEED 0
+
 struct _HklEngineOperations
 {
 	void (*free)(HklEngine *self);
@@ -378,11 +482,31 @@ static inline void hkl_engine_init(HklEngine *self,
 	self->detector = NULL;
 	self->sample = NULL;
 	self->engines = engines;
+	self->rand = g_rand_new_with_seed(HKL_ENGINE_RANDOM_SEED);
+	self->n_parallel_starts = 1;
+	self->inputs.valid = FALSE;
 
 	darray_append(*engines, self);
 }
 
 
+/**
+ * hkl_engine_restart_shift: (skip)
+ * @self: the HklEngine
+ * @shift: (out): the len offsets
+ * @len: the number of axes of the solver
+ *
+ * draw from the engine generator the offsets of the restart points
+ * sequence of one solve (see hkl_parameter_restart_point).
+ **/
+static inline void hkl_engine_restart_shift(HklEngine *self,
+					    double shift[], size_t len)
+{
+	for(size_t i=0; i<len; ++i)
+		shift[i] = g_rand_double(self->rand);
+}
+
+
 static inline HklParameter *register_mode_parameter(HklMode *mode, unsigned int index)
 {
 	return darray_item(mode->parameters, index);
@@ -440,16 +564,14 @@ static inline void hkl_engine_add_mode(HklEngine *self,
 static inline void hkl_engine_add_geometry(HklEngine *self,
 					   double const x[])
 {
-	HklParameter **axis;
-	uint i = 0;
+	const size_t n = darray_size(self->axes);
+	double *values = alloca(n * sizeof(*values));
+	size_t i;
 
 	/* copy the axes configuration into the engine->geometry */
-	darray_foreach(axis, self->axes){
-		hkl_parameter_value_set(*axis,
-					gsl_sf_angle_restrict_symm(x[i++]),
-					HKL_UNIT_DEFAULT,
-					NULL);
-	}
+	for(i=0; i<n; ++i)
+		values[i] = gsl_sf_angle_restrict_symm(x[i]);
+	hkl_axis_values_set_fast(self->axes.item, values, n);
 
 	hkl_geometry_list_add(self->engines->geometries, self->geometry);
 }
@@ -460,30 +582,49 @@ static inline void hkl_engine_prepare_internal(HklEngine *self)
 	if(!self || !self->engines)
 		return;
 
-	/* set */
-	if(self->geometry)
-		hkl_geometry_free(self->geometry);
-	self->geometry = hkl_geometry_new_copy(self->engines->geometry);
+	/* set, the private copies are updated in place. The geometry
+	 * is the solvers workspace, so it is always synchronized, but
+	 * the sample only when its UB matrix changed. Its reflections
+	 * are not needed. */
+	if(self->geometry && self->engines->geometry
+	   && self->geometry->factory == self->engines->geometry->factory)
+		hkl_geometry_init_geometry(self->geometry, self->engines->geometry);
+	else{
+		if(self->geometry)
+			hkl_geometry_free(self->geometry);
+		self->geometry = hkl_geometry_new_copy(self->engines->geometry);
+	}
 
-	if(self->detector)
-		hkl_detector_free(self->detector);
-	self->detector = hkl_detector_new_copy(self->engines->detector);
+	if(self->detector && self->engines->detector)
+		*self->detector = *self->engines->detector;
+	else{
+		if(self->detector)
+			hkl_detector_free(self->detector);
+		self->detector = hkl_detector_new_copy(self->engines->detector);
+	}
 
-	if(self->sample)
+	if(self->engines->sample){
+		if(!self->sample)
+			self->sample = hkl_sample_new(hkl_sample_name_get(self->engines->sample));
+		if(self->sample->gen != self->engines->sample->gen)
+			hkl_sample_init_copy_UB(self->sample, self->engines->sample);
+	}else if(self->sample){
 		hkl_sample_free(self->sample);
-	self->sample = hkl_sample_new_copy(self->engines->sample);
+		self->sample = NULL;
+	}
 
-	/* fill the axes member from the function */
+	/* fill the axes member from the mode axes indexes */
 	if(self->mode){
-		const char **axis_name;
-
-		darray_free(self->axes);
-		darray_init(self->axes);
-		darray_foreach(axis_name, self->mode->info->axes_w){
-			HklParameter *axis = hkl_geometry_get_axis_by_name(self->geometry,
-									   *axis_name);
-			darray_append(self->axes, axis);
-		}
+		const darray_int *idx = &self->mode->axes_w_idx;
+
+		if(darray_size(*idx) != darray_size(self->mode->info->axes_w))
+			hkl_mode_axes_w_resolve(self->mode, self->geometry);
+
+		darray_resize(self->axes, darray_size(*idx));
+		for(size_t i=0; i<darray_size(*idx); ++i)
+			darray_item(self->axes, i) = darray_item(*idx, i) < 0
+				? NULL
+				: darray_item(self->geometry->axes, darray_item(*idx, i));
 	}
 
 	/* reset the geometries len */
@@ -504,6 +645,42 @@ static inline void hkl_engine_mode_set(HklEngine *self, HklMode *mode)
 }
 
 
+/**
+ * hkl_engine_stale_set: (skip)
+ * @self: the HklEngine
+ *
+ * the pseudo axes values or the mode were modified, the next get
+ * must recompute the pseudo axes values.
+ **/
+static inline void hkl_engine_stale_set(HklEngine *self)
+{
+	self->inputs.valid = FALSE;
+}
+
+
+/**
+ * hkl_engine_changes_get: (skip)
+ * @self: the HklEngine
+ *
+ * Return value: the #HklEngineDependencies which changed since the
+ * pseudo axes values were computed.
+ **/
+static inline unsigned int hkl_engine_changes_get(const HklEngine *self)
+{
+	const HklEngineList *engines = self->engines;
+	unsigned int changes = 0;
+
+	if(self->inputs.axes != engines->geometry->gen_axes)
+		changes |= HKL_ENGINE_DEPENDENCIES_AXES;
+	if(self->inputs.source != engines->geometry->gen_source)
+		changes |= HKL_ENGINE_DEPENDENCIES_ENERGY;
+	if(!engines->sample || self->inputs.sample != engines->sample->gen)
+		changes |= HKL_ENGINE_DEPENDENCIES_SAMPLE;
+
+	return changes;
+}
+
+
 static inline int hkl_engine_get(HklEngine *self,
 				 GError **error) HKL_ARG_NONNULL(1);
 /**
@@ -528,6 +705,11 @@ static inline int hkl_engine_get(HklEngine *self, GError **error)
 		return FALSE;
 	}
 
+	/* nothing the pseudo axes values depend on changed */
+	if(self->inputs.valid
+	   && !(hkl_engine_changes_get(self) & self->info->dependencies))
+		return TRUE;
+
 	if (!self->mode->ops->get(self->mode,
 				  self,
 				  self->engines->geometry,
@@ -539,6 +721,12 @@ static inline int hkl_engine_get(HklEngine *self, GError **error)
 	}
 	hkl_assert(error == NULL || *error == NULL);
 
+	/* the get itself can update the geometry holders */
+	self->inputs.valid = TRUE;
+	self->inputs.axes = self->engines->geometry->gen_axes;
+	self->inputs.source = self->engines->geometry->gen_source;
+	self->inputs.sample = self->engines->sample->gen;
+
 	return TRUE;
 }
 
@@ -556,6 +744,8 @@ static inline int hkl_engine_set(HklEngine *self, GError **error)
 {
 	hkl_error (error == NULL || *error == NULL);
 
+	hkl_engine_stale_set(self);
+
 	if(!self->geometry || !self->detector || !self->sample
 	   || !self->mode || !self->mode->ops->set){
 		g_set_error(error,
@@ -578,7 +768,8 @@ static inline int hkl_engine_set(HklEngine *self, GError **error)
 	hkl_assert(error == NULL || *error == NULL);
 
 	hkl_geometry_list_multiply(self->engines->geometries);
-	hkl_geometry_list_multiply_from_range(self->engines->geometries);
+	hkl_geometry_list_multiply_from_range(self->engines->geometries,
+					      self->engines->geometry);
 	hkl_geometry_list_remove_invalid(self->engines->geometries);
 	hkl_geometry_list_sort(self->engines->geometries, self->engines->geometry);
 
@@ -593,6 +784,35 @@ static inline int hkl_engine_set(HklEngine *self, GError **error)
 	return TRUE;
 }
 
+/* HklEngineWorker */
+
+/* a private copy of an engine and of its engine list, so the copy
+ * can be used from another thread */
+typedef struct _HklEngineWorker HklEngineWorker;
+
+struct _HklEngineWorker
+{
+	HklEngineList *engines;
+	HklGeometry *geometry;
+	HklDetector *detector;
+	HklSample *sample;
+	HklEngine *engine;
+};
+
+extern int hkl_engine_worker_init(HklEngineWorker *self, const HklEngine *engine,
+				  GError **error);
+
+extern int hkl_engine_worker_sync(HklEngineWorker *self, const HklEngine *engine,
+				  const HklGeometry *geometry, GError **error);
+
+extern void hkl_engine_worker_release(HklEngineWorker *self);
+
+/* HklEnginePool */
+
+/* run the tasks on the threads shared by all the engines */
+extern void hkl_engine_pool_run(GThreadFunc func, gpointer data,
+				size_t size, size_t n);
+
 /* HklEngineList */
 
 
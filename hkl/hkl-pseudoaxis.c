@@ -20,6 +20,9 @@
  *
  * Authors: Picca Frédéric-Emmanuel <picca@synchrotron-soleil.fr>
  */
+#include <alloca.h>                     // for alloca
+#include <gsl/gsl_nan.h>                // for GSL_NAN
+#include <math.h>                       // for sqrt, floor, ceil
 #include <stdio.h>                      // for fprintf, FILE
 #include <stdlib.h>                     // for free
 #include <string.h>                     // for NULL, strcmp
@@ -196,6 +199,7 @@ HklGeometryList *hkl_engine_pseudo_axis_values_set(HklEngine *self,
 	hkl_sample_fprintf(stream, self->sample);
 	hkl_engine_fprintf(stream, self);
 #endif
+	hkl_engine_stale_set(self);
 	for(size_t i=0; i<n_values; ++i){
 		if(!hkl_parameter_value_set(darray_item(self->pseudo_axes, i),
 					    values[i],
@@ -231,6 +235,872 @@ out:
 	return solutions;
 }
 
+/* the corrected position of a trajectory point can not be farther than
+ * this from the predicted one (on top of the predicted step), otherwise
+ * the corrector probably jumped on another branch. */
+#define HKL_TRAJECTORY_MAX_JUMP (5 * HKL_DEGTORAD)
+
+static int pseudo_axis_values_set_real(HklEngine *self,
+				       const double values[], size_t n_values,
+				       HklUnitEnum unit_type, GError **error)
+{
+	hkl_engine_stale_set(self);
+	for(size_t i=0; i<n_values; ++i){
+		if(!hkl_parameter_value_set(darray_item(self->pseudo_axes, i),
+					    values[i],
+					    unit_type, error)){
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* linear extrapolation from the two last points of a branch */
+static void trajectory_predict(HklGeometry *prediction,
+			       const HklGeometry *last,
+			       const HklGeometry *before)
+{
+	for(size_t i=0; i<darray_size(prediction->axes); ++i){
+		double value = darray_item(last->axes, i)->_value;
+
+		if(before)
+			value += gsl_sf_angle_restrict_symm(value - darray_item(before->axes, i)->_value);
+		hkl_parameter_value_set(darray_item(prediction->axes, i),
+					value, HKL_UNIT_DEFAULT, NULL);
+	}
+	hkl_geometry_update(prediction);
+}
+
+/* converge from the prediction, the engine must be already prepared */
+static int trajectory_correct(HklEngine *self,
+			      const HklGeometry *prediction,
+			      const HklGeometry *last)
+{
+	double step;
+
+	hkl_geometry_set(self->geometry, prediction);
+	if(!self->mode->ops->set_local(self->mode, self,
+				       self->geometry,
+				       self->detector,
+				       self->sample,
+				       NULL))
+		return FALSE;
+
+	if(!hkl_geometry_is_valid(self->geometry))
+		return FALSE;
+
+	step = hkl_geometry_distance_orthodromic(prediction, last);
+	if(hkl_geometry_distance_orthodromic(self->geometry, prediction) > step + HKL_TRAJECTORY_MAX_JUMP)
+		return FALSE;
+
+	return TRUE;
+}
+
+/* full solver, keep the solution closest to the prediction */
+static const HklGeometry *trajectory_solve(HklEngine *self,
+					   const HklGeometry *prediction,
+					   GError **error)
+{
+	const HklGeometryListItem *item;
+	const HklGeometry *closest = NULL;
+	double distance = 0.;
+
+	if(!hkl_engine_set(self, error))
+		return NULL;
+
+	list_for_each(&self->engines->geometries->items, item, list){
+		double tmp = hkl_geometry_distance_orthodromic(item->geometry, prediction);
+
+		if(!closest || tmp < distance){
+			closest = item->geometry;
+			distance = tmp;
+		}
+	}
+
+	return closest;
+}
+
+/**
+ * hkl_engine_pseudo_axis_values_set_trajectory: (skip)
+ * @self: the this ptr
+ * @values: the n_points * n_values pseudo axes values, one point after the other.
+ * @n_values: the number of pseudo axes of the engine.
+ * @n_points: the number of points of the trajectory.
+ * @unit_type: the unit type (default or user) of the values
+ * @n_branches: (out caller-allocates): the number of returned branches.
+ * @error: return location for a GError, or NULL
+ *
+ * Compute the real axes positions along a trajectory of pseudo axes
+ * values. The solutions of the first point are the starting points
+ * of the branches. Then each branch is followed continuously: the
+ * next position is predicted from the previous ones and corrected
+ * with a local solve. Only when the correction fails the full solver
+ * is used and the solution closest to the prediction is kept.
+ *
+ * Return value: an array of n_branches #HklGeometryList, each one
+ *               containing n_points geometries in the trajectory
+ *               order or NULL if no solution was found. Release each
+ *               list with hkl_geometry_list_free and the array with
+ *               free once done.
+ **/
+HklGeometryList **hkl_engine_pseudo_axis_values_set_trajectory(HklEngine *self,
+							      double values[], size_t n_values,
+							      size_t n_points,
+							      HklUnitEnum unit_type,
+							      size_t *n_branches,
+							      GError **error)
+{
+	HklGeometryList **branches = NULL;
+	HklGeometry *prediction = NULL;
+	const HklGeometryListItem *item;
+	size_t n = 0;
+	size_t b;
+
+	hkl_error(error == NULL ||*error == NULL);
+
+	*n_branches = 0;
+
+	if(n_values != darray_size(self->info->pseudo_axes)){
+		g_set_error(error,
+			    HKL_ENGINE_ERROR,
+			    HKL_ENGINE_ERROR_PSEUDO_AXIS_VALUES_SET,
+			    "cannot set engine pseudo axes, wrong number of parameter (%d) given, (%d) expected\n",
+			    n_values,  darray_size(self->info->pseudo_axes));
+		return NULL;
+	}
+
+	if(n_points == 0){
+		g_set_error(error,
+			    HKL_ENGINE_ERROR,
+			    HKL_ENGINE_ERROR_PSEUDO_AXIS_VALUES_SET,
+			    "cannot set an empty trajectory\n");
+		return NULL;
+	}
+
+	/* one branch per solution of the first point */
+	if(!pseudo_axis_values_set_real(self, values, n_values, unit_type, error)
+	   || !hkl_engine_set(self, error))
+		return NULL;
+
+	n = self->engines->geometries->n_items;
+	branches = malloc(n * sizeof(*branches));
+	b = 0;
+	list_for_each(&self->engines->geometries->items, item, list){
+		branches[b] = hkl_geometry_list_new();
+		hkl_geometry_list_append(branches[b], item->geometry);
+		++b;
+	}
+
+	prediction = hkl_geometry_new_copy(self->engines->geometry);
+
+	for(size_t p=1; p<n_points; ++p){
+		if(!pseudo_axis_values_set_real(self, &values[p * n_values], n_values,
+						unit_type, error))
+			goto fail;
+
+		/* refresh the engine workspace for this point */
+		hkl_engine_prepare_internal(self);
+
+		for(b=0; b<n; ++b){
+			const HklGeometryListItem *last;
+			const HklGeometryListItem *before = NULL;
+
+			last = list_tail(&branches[b]->items, HklGeometryListItem, list);
+			if(p > 1)
+				before = list_prev(&branches[b]->items, last, list);
+
+			trajectory_predict(prediction, last->geometry,
+					   before ? before->geometry : NULL);
+
+			if(trajectory_correct(self, prediction, last->geometry))
+				hkl_geometry_list_append(branches[b], self->geometry);
+			else{
+				const HklGeometry *geometry;
+
+				geometry = trajectory_solve(self, prediction, error);
+				if(!geometry)
+					goto fail;
+				hkl_geometry_list_append(branches[b], geometry);
+			}
+		}
+	}
+
+	hkl_geometry_free(prediction);
+	*n_branches = n;
+
+	return branches;
+
+fail:
+	hkl_geometry_free(prediction);
+	for(b=0; b<n; ++b)
+		hkl_geometry_list_free(branches[b]);
+	free(branches);
+
+	return NULL;
+}
+
+struct batch {
+	const double *values;
+	size_t n_values;
+	size_t n_points;
+	HklUnitEnum unit_type;
+	HklGeometryList **results;
+	guint32 seed;
+	volatile gint next;
+};
+
+struct batch_worker {
+	HklEngineWorker worker;
+	struct batch *batch;
+};
+
+static gpointer batch_worker_run(gpointer data)
+{
+	struct batch_worker *self = data;
+	struct batch *batch = self->batch;
+	HklEngine *engine = self->worker.engine;
+	gint i;
+
+	/* hand out the points one by one, their cost is very uneven */
+	while((i = g_atomic_int_add(&batch->next, 1)) < (gint)batch->n_points){
+		/* the restarts of a point do not depend on the worker */
+		hkl_engine_random_seed_set(engine, batch->seed + i);
+
+		if(!pseudo_axis_values_set_real(engine,
+						&batch->values[i * batch->n_values],
+						batch->n_values,
+						batch->unit_type, NULL)
+		   || !hkl_engine_set(engine, NULL))
+			continue;
+
+		batch->results[i] = hkl_geometry_list_new_copy(engine->engines->geometries);
+	}
+
+	return NULL;
+}
+
+/**
+ * hkl_engine_pseudo_axis_values_set_batch: (skip)
+ * @self: the this ptr
+ * @values: the n_points * n_values pseudo axes values, one point after the other.
+ * @n_values: the number of pseudo axes of the engine.
+ * @n_points: the number of points to compute.
+ * @unit_type: the unit type (default or user) of the values
+ * @n_threads: the number of threads used, 0 means one per processor.
+ * @error: return location for a GError, or NULL
+ *
+ * Compute the real axes positions of many independent points. Each
+ * point is solved from the current geometry of the engine list
+ * exactly like hkl_engine_pseudo_axis_values_set, but the points are
+ * spread over n_threads threads, each one working on its own copy of
+ * the engine list. Only the random generator of the engine is
+ * advanced, it seeds the solver restarts of each point so the results
+ * do not depend on the number of threads.
+ *
+ * Return value: an array of n_points #HklGeometryList, NULL for the
+ *               points without solution. Release each list with
+ *               hkl_geometry_list_free and the array with free once
+ *               done.
+ **/
+HklGeometryList **hkl_engine_pseudo_axis_values_set_batch(HklEngine *self,
+							  double values[], size_t n_values,
+							  size_t n_points,
+							  HklUnitEnum unit_type,
+							  unsigned int n_threads,
+							  GError **error)
+{
+	struct batch batch;
+	struct batch_worker *workers;
+	size_t n_workers;
+	size_t i;
+
+	hkl_error(error == NULL ||*error == NULL);
+
+	if(n_values != darray_size(self->info->pseudo_axes)){
+		g_set_error(error,
+			    HKL_ENGINE_ERROR,
+			    HKL_ENGINE_ERROR_PSEUDO_AXIS_VALUES_SET,
+			    "cannot set engine pseudo axes, wrong number of parameter (%d) given, (%d) expected\n",
+			    n_values,  darray_size(self->info->pseudo_axes));
+		return NULL;
+	}
+
+	if(!self->engines || !self->engines->geometry || !self->engines->detector
+	   || !self->engines->sample || !self->mode){
+		g_set_error(error,
+			    HKL_ENGINE_ERROR,
+			    HKL_ENGINE_ERROR_SET,
+			    "Internal error");
+		return NULL;
+	}
+
+	if(n_threads == 0)
+		n_threads = g_get_num_processors();
+	n_workers = n_points < n_threads ? n_points : n_threads;
+	if(n_workers == 0)
+		n_workers = 1;
+
+	batch.values = values;
+	batch.n_values = n_values;
+	batch.n_points = n_points;
+	batch.unit_type = unit_type;
+	batch.results = calloc(n_points ? n_points : 1, sizeof(*batch.results));
+	batch.seed = g_rand_int(self->rand);
+	batch.next = 0;
+
+	/* prepare all the engine lists before starting any thread */
+	workers = calloc(n_workers, sizeof(*workers));
+	for(i=0; i<n_workers; ++i){
+		workers[i].batch = &batch;
+		if(!hkl_engine_worker_init(&workers[i].worker, self, error))
+			goto fail;
+	}
+
+	hkl_engine_pool_run(batch_worker_run, workers, sizeof(*workers), n_workers);
+
+	for(i=0; i<n_workers; ++i)
+		hkl_engine_worker_release(&workers[i].worker);
+	free(workers);
+
+	return batch.results;
+
+fail:
+	for(i=0; i<n_workers; ++i)
+		hkl_engine_worker_release(&workers[i].worker);
+	free(workers);
+	free(batch.results);
+
+	return NULL;
+}
+
+/* the points of a scan cost the same, they are handed out by blocks */
+#define HKL_BATCH_GET_BLOCK 1024
+
+struct batch_get {
+	const double *axes;
+	size_t n_axes;
+	size_t n_points;
+	double *values;
+	size_t n_values;
+	HklUnitEnum unit_type;
+	volatile gint next;
+};
+
+struct batch_get_worker {
+	HklEngineWorker worker;
+	struct batch_get *batch;
+};
+
+/* write the axes of the frame i in the worker geometry, only the
+ * moving axes of a scan are updated */
+static void batch_get_frame_set(struct batch_get_worker *self, size_t i,
+				double axes[], const double factors[])
+{
+	struct batch_get *batch = self->batch;
+	HklGeometry *geometry = self->worker.geometry;
+	size_t j;
+
+	for(j=0; j<batch->n_axes; ++j)
+		axes[j] = batch->axes[j * batch->n_points + i] / factors[j];
+	hkl_axis_values_set_fast(geometry->axes.item, axes, batch->n_axes);
+	hkl_geometry_update(geometry);
+}
+
+/* the frames of a block one by one with the engine get */
+static void batch_get_block_get(struct batch_get_worker *self,
+				size_t start, size_t end,
+				double axes[], const double factors[])
+{
+	struct batch_get *batch = self->batch;
+	HklEngine *engine = self->worker.engine;
+	size_t i, j;
+
+	for(i=start; i<end; ++i){
+		batch_get_frame_set(self, i, axes, factors);
+
+		if(hkl_engine_get(engine, NULL))
+			for(j=0; j<batch->n_values; ++j)
+				batch->values[j * batch->n_points + i] =
+					hkl_parameter_value_get(darray_item(engine->pseudo_axes, j),
+								batch->unit_type);
+		else
+			for(j=0; j<batch->n_values; ++j)
+				batch->values[j * batch->n_points + i] = GSL_NAN;
+	}
+}
+
+/* the frames of a block with the get_batch kernel of the mode. Only
+ * the kinematics are computed frame by frame, the sample frame Q of
+ * the block are packed and given to the kernel at once. */
+static int batch_get_block_get_batch(struct batch_get_worker *self,
+				     size_t start, size_t end,
+				     double axes[], const double factors[],
+				     double q[])
+{
+	struct batch_get *batch = self->batch;
+	HklEngine *engine = self->worker.engine;
+	HklGeometry *geometry = self->worker.geometry;
+	HklHolder *sample_holder = darray_item(geometry->holders, 0);
+	const size_t n = end - start;
+	double *qx = &q[0];
+	double *qy = &q[HKL_BATCH_GET_BLOCK];
+	double *qz = &q[2 * HKL_BATCH_GET_BLOCK];
+	double **values = alloca(batch->n_values * sizeof(*values));
+	HklVector ki;
+	size_t i, j;
+
+	hkl_source_compute_ki(&geometry->source, &ki);
+
+	for(i=0; i<n; ++i){
+		HklVector Q;
+		HklQuaternion r;
+
+		batch_get_frame_set(self, start + i, axes, factors);
+
+		/* R^-1.(kf - ki) */
+		hkl_detector_compute_kf(self->worker.detector, geometry, &Q);
+		hkl_vector_minus_vector(&Q, &ki);
+		r = sample_holder->q;
+		hkl_quaternion_conjugate(&r);
+		hkl_vector_rotated_quaternion(&Q, &r);
+
+		qx[i] = Q.data[0];
+		qy[i] = Q.data[1];
+		qz[i] = Q.data[2];
+	}
+
+	for(j=0; j<batch->n_values; ++j)
+		values[j] = &batch->values[j * batch->n_points + start];
+
+	if(!engine->mode->ops->get_batch(engine->mode, engine,
+					 self->worker.sample,
+					 qx, qy, qz, n, values))
+		return FALSE;
+
+	for(j=0; j<batch->n_values; ++j){
+		const HklParameter *pseudo_axis = darray_item(engine->pseudo_axes, j);
+
+		if(batch->unit_type == HKL_UNIT_USER){
+			const double factor = hkl_unit_factor(pseudo_axis->unit,
+							      pseudo_axis->punit);
+
+			for(i=0; i<n; ++i)
+				values[j][i] *= factor;
+		}
+	}
+
+	return TRUE;
+}
+
+static gpointer batch_get_worker_run(gpointer data)
+{
+	struct batch_get_worker *self = data;
+	struct batch_get *batch = self->batch;
+	HklEngine *engine = self->worker.engine;
+	HklGeometry *geometry = self->worker.geometry;
+	double *axes = alloca(batch->n_axes * sizeof(*axes));
+	double *factors = alloca(batch->n_axes * sizeof(*factors));
+	double *q = NULL;
+	size_t j, start, end;
+
+	for(j=0; j<batch->n_axes; ++j){
+		const HklParameter *axis = darray_item(geometry->axes, j);
+
+		factors[j] = batch->unit_type == HKL_UNIT_USER
+			? hkl_unit_factor(axis->unit, axis->punit) : 1.;
+	}
+
+	if(engine->mode->ops->get_batch)
+		q = malloc(3 * HKL_BATCH_GET_BLOCK * sizeof(*q));
+
+	while((start = (size_t)g_atomic_int_add(&batch->next, 1) * HKL_BATCH_GET_BLOCK) < batch->n_points){
+		end = start + HKL_BATCH_GET_BLOCK;
+		if(end > batch->n_points)
+			end = batch->n_points;
+
+		if(!q || !batch_get_block_get_batch(self, start, end, axes, factors, q))
+			batch_get_block_get(self, start, end, axes, factors);
+	}
+
+	free(q);
+
+	return NULL;
+}
+
+/**
+ * hkl_engine_pseudo_axis_values_get_batch: (skip)
+ * @self: the this ptr
+ * @axes: the n_axes * n_points axes values, one axis after the other.
+ * @n_axes: the number of axes of the geometry.
+ * @n_points: the number of points to compute.
+ * @values: (out caller-allocates): the n_values * n_points computed
+ *          pseudo axes values, one pseudo axis after the other.
+ * @n_values: the number of pseudo axes of the engine.
+ * @unit_type: the unit type (default or user) of the axes and pseudo axes values
+ * @n_threads: the number of threads used, 0 means one per processor.
+ * @error: return location for a GError, or NULL
+ *
+ * Compute the pseudo axes values of many axes positions, for example
+ * all the frames of a recorded scan. Each point is computed with the
+ * detector, sample and source of the engine list, like
+ * hkl_engine_pseudo_axis_values_get, but the points are spread over
+ * n_threads workers each one working on its own copy of the engine
+ * list. The engine list itself is not modified. Consecutive points
+ * only update the axes which moved. When the current mode provides a
+ * get_batch kernel (the hkl engine), the pseudo axes of a whole block
+ * of points are computed at once from their packed scattering
+ * vectors. The values of the points which can not be computed are set
+ * to NaN.
+ *
+ * Return value: TRUE if succeded or FALSE otherwise.
+ **/
+int hkl_engine_pseudo_axis_values_get_batch(HklEngine *self,
+					    const double axes[], size_t n_axes,
+					    size_t n_points,
+					    double values[], size_t n_values,
+					    HklUnitEnum unit_type,
+					    unsigned int n_threads,
+					    GError **error)
+{
+	struct batch_get batch;
+	struct batch_get_worker *workers;
+	size_t n_workers;
+	size_t i;
+	int res = TRUE;
+
+	hkl_error(error == NULL ||*error == NULL);
+
+	if(n_values != darray_size(self->info->pseudo_axes)){
+		g_set_error(error,
+			    HKL_ENGINE_ERROR,
+			    HKL_ENGINE_ERROR_PSEUDO_AXIS_VALUES_GET,
+			    "cannot get engine pseudo axes, wrong number of parameter (%d) given, (%d) expected\n",
+			    n_values, darray_size(self->info->pseudo_axes));
+		return FALSE;
+	}
+
+	if(!self->engines || !self->engines->geometry || !self->engines->detector
+	   || !self->engines->sample || !self->mode){
+		g_set_error(error,
+			    HKL_ENGINE_ERROR,
+			    HKL_ENGINE_ERROR_GET,
+			    "Internal error");
+		return FALSE;
+	}
+
+	if(n_axes != darray_size(self->engines->geometry->axes)){
+		g_set_error(error,
+			    HKL_ENGINE_ERROR,
+			    HKL_ENGINE_ERROR_PSEUDO_AXIS_VALUES_GET,
+			    "cannot get engine pseudo axes, wrong number of axes (%d) given, (%d) expected\n",
+			    n_axes, darray_size(self->engines->geometry->axes));
+		return FALSE;
+	}
+
+	if(n_threads == 0)
+		n_threads = g_get_num_processors();
+	n_workers = (n_points + HKL_BATCH_GET_BLOCK - 1) / HKL_BATCH_GET_BLOCK;
+	if(n_workers > n_threads)
+		n_workers = n_threads;
+	if(n_workers == 0)
+		n_workers = 1;
+
+	batch.axes = axes;
+	batch.n_axes = n_axes;
+	batch.n_points = n_points;
+	batch.values = values;
+	batch.n_values = n_values;
+	batch.unit_type = unit_type;
+	batch.next = 0;
+
+	/* prepare all the engine lists before starting any thread */
+	workers = calloc(n_workers, sizeof(*workers));
+	for(i=0; i<n_workers; ++i){
+		workers[i].batch = &batch;
+		if(!hkl_engine_worker_init(&workers[i].worker, self, error)){
+			res = FALSE;
+			goto out;
+		}
+	}
+
+	hkl_engine_pool_run(batch_get_worker_run, workers, sizeof(*workers), n_workers);
+
+out:
+	for(i=0; i<n_workers; ++i)
+		hkl_engine_worker_release(&workers[i].worker);
+	free(workers);
+
+	return res;
+}
+
+/* the hkl are handed out by small blocks, the unreachable ones are
+ * much slower to solve than the others */
+#define HKL_REACHABLE_BLOCK 16
+
+struct reachable_candidate {
+	double norm;
+	double hkl[3];
+};
+
+struct reachable {
+	const struct reachable_candidate *candidates;
+	size_t n_candidates;
+	HklGeometry **geometries;
+	guint32 seed;
+	volatile gint next;
+};
+
+struct reachable_worker {
+	HklEngineWorker worker;
+	struct reachable *reachable;
+};
+
+static int reachable_candidate_cmp(const void *p1, const void *p2)
+{
+	const struct reachable_candidate *c1 = p1;
+	const struct reachable_candidate *c2 = p2;
+
+	if(c1->norm < c2->norm)
+		return -1;
+	if(c1->norm > c2->norm)
+		return 1;
+	return memcmp(c1->hkl, c2->hkl, sizeof(c1->hkl));
+}
+
+static gpointer reachable_worker_run(gpointer data)
+{
+	struct reachable_worker *self = data;
+	struct reachable *reachable = self->reachable;
+	HklEngine *engine = self->worker.engine;
+	size_t i, start, end;
+
+	while((start = (size_t)g_atomic_int_add(&reachable->next, 1) * HKL_REACHABLE_BLOCK) < reachable->n_candidates){
+		end = start + HKL_REACHABLE_BLOCK;
+		if(end > reachable->n_candidates)
+			end = reachable->n_candidates;
+
+		for(i=start; i<end; ++i){
+			const HklGeometryListItem *first;
+
+			hkl_engine_random_seed_set(engine, reachable->seed + i);
+
+			if(!pseudo_axis_values_set_real(engine,
+							reachable->candidates[i].hkl, 3,
+							HKL_UNIT_DEFAULT, NULL)
+			   || !hkl_engine_set(engine, NULL))
+				continue;
+
+			first = list_top(&engine->engines->geometries->items,
+					 HklGeometryListItem, list);
+			if(first)
+				reachable->geometries[i] = hkl_geometry_new_copy(first->geometry);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * all the hkl (but 0 0 0) with |B.hkl| <= q_max, the ellipsoid is
+ * scanned line by line, the bounds of each line are the roots of the
+ * quadratic form of the reciprocal metric G = B^T.B.
+ */
+static struct reachable_candidate *reachable_candidates(const HklMatrix *B,
+							const HklMatrix *B_1,
+							double q_max,
+							size_t *n_candidates)
+{
+	darray(struct reachable_candidate) candidates;
+	double G[3][3];
+	double q2 = q_max * q_max * (1. + HKL_EPSILON);
+	double h_max;
+	int h, k, l;
+	size_t i, j;
+
+	for(i=0; i<3; ++i)
+		for(j=0; j<3; ++j)
+			G[i][j] = B->data[0][i] * B->data[0][j]
+				+ B->data[1][i] * B->data[1][j]
+				+ B->data[2][i] * B->data[2][j];
+
+	/* the extent of the ellipsoid along h */
+	h_max = q_max * sqrt(B_1->data[0][0] * B_1->data[0][0]
+			     + B_1->data[0][1] * B_1->data[0][1]
+			     + B_1->data[0][2] * B_1->data[0][2]);
+
+	darray_init(candidates);
+	for(h=-floor(h_max); h<=floor(h_max); ++h){
+		/* minimized over l, the form is a k quadratic */
+		const double a = G[1][1] - G[1][2] * G[1][2] / G[2][2];
+		const double b = h * (G[0][1] - G[0][2] * G[1][2] / G[2][2]);
+		const double c = h * h * (G[0][0] - G[0][2] * G[0][2] / G[2][2]) - q2;
+		const double d = b * b - a * c;
+
+		if(d < 0)
+			continue;
+
+		for(k=ceil((-b - sqrt(d)) / a); k<=floor((-b + sqrt(d)) / a); ++k){
+			const double b2 = G[0][2] * h + G[1][2] * k;
+			const double c2 = G[0][0] * h * h + 2 * G[0][1] * h * k
+				+ G[1][1] * k * k - q2;
+			const double d2 = b2 * b2 - G[2][2] * c2;
+
+			if(d2 < 0)
+				continue;
+
+			for(l=ceil((-b2 - sqrt(d2)) / G[2][2]); l<=floor((-b2 + sqrt(d2)) / G[2][2]); ++l){
+				struct reachable_candidate candidate = {0, {h, k, l}};
+				HklVector g = {{h, k, l}};
+
+				if(!h && !k && !l)
+					continue;
+
+				hkl_matrix_times_vector(B, &g);
+				candidate.norm = hkl_vector_norm2(&g);
+				darray_append(candidates, candidate);
+			}
+		}
+	}
+
+	*n_candidates = darray_size(candidates);
+	qsort(candidates.item, *n_candidates, sizeof(*candidates.item),
+	      reachable_candidate_cmp);
+
+	return candidates.item;
+}
+
+/**
+ * hkl_engine_reachable_reflections: (skip)
+ * @self: the "hkl" #HklEngine
+ * @q_max: the largest |Q| of the reflections, 0 for the Ewald limiting
+ *         sphere only.
+ * @mode: (allow-none): the mode used to reach the reflections, NULL
+ *        for the current mode of the engine.
+ * @hkl: (out): the h, k, l of the reachable reflections, one after the other.
+ * @n_reflections: (out): the number of reachable reflections.
+ * @n_threads: the number of threads used, 0 means one per processor.
+ * @error: return location for a GError, or NULL
+ *
+ * Enumerate the reflections inside the Ewald limiting sphere (|Q| <=
+ * 2k) and the q_max sphere, for the current sample, wavelength and
+ * axes ranges, and solve them in parallel like
+ * hkl_engine_pseudo_axis_values_set_batch. The reflections are
+ * sorted by increasing |Q|. Only the candidates inside the limiting
+ * sphere of the lattice are tried, so most of the hkl given to the
+ * solver are reachable in a geometric sense.
+ *
+ * Return value: an array of n_reflections #HklGeometry, the first
+ *               solution of each reachable reflection, or NULL if an
+ *               error occurred. Release each geometry with
+ *               hkl_geometry_free, the array and @hkl with free once
+ *               done.
+ **/
+HklGeometry **hkl_engine_reachable_reflections(HklEngine *self,
+					       double q_max, const char *mode,
+					       double **hkl, size_t *n_reflections,
+					       unsigned int n_threads,
+					       GError **error)
+{
+	struct reachable reachable;
+	struct reachable_candidate *candidates;
+	struct reachable_worker *workers = NULL;
+	HklGeometry **geometries = NULL;
+	HklMatrix B, B_1;
+	double q_ewald;
+	size_t n_candidates = 0;
+	size_t n_workers = 0;
+	size_t i, n;
+
+	hkl_error(error == NULL ||*error == NULL);
+
+	*hkl = NULL;
+	*n_reflections = 0;
+
+	if(strcmp(self->info->name, "hkl")
+	   || darray_size(self->info->pseudo_axes) != 3){
+		g_set_error(error,
+			    HKL_ENGINE_ERROR,
+			    HKL_ENGINE_ERROR_SET,
+			    "the \"%s\" engine is not the \"hkl\" engine",
+			    self->info->name);
+		return NULL;
+	}
+
+	if(!self->engines || !self->engines->geometry || !self->engines->detector
+	   || !self->engines->sample || !self->mode){
+		g_set_error(error,
+			    HKL_ENGINE_ERROR,
+			    HKL_ENGINE_ERROR_SET,
+			    "Internal error");
+		return NULL;
+	}
+
+	if(!hkl_lattice_get_B(self->engines->sample->lattice, &B)
+	   || !hkl_lattice_get_1_B(self->engines->sample->lattice, &B_1)){
+		g_set_error(error,
+			    HKL_ENGINE_ERROR,
+			    HKL_ENGINE_ERROR_SET,
+			    "the lattice of the sample is not valid");
+		return NULL;
+	}
+
+	/* the limiting sphere of radius 2k */
+	q_ewald = 2. * HKL_TAU / self->engines->geometry->source.wave_length;
+	if(q_max <= 0. || q_max > q_ewald)
+		q_max = q_ewald;
+
+	candidates = reachable_candidates(&B, &B_1, q_max, &n_candidates);
+
+	if(n_threads == 0)
+		n_threads = g_get_num_processors();
+	n_workers = (n_candidates + HKL_REACHABLE_BLOCK - 1) / HKL_REACHABLE_BLOCK;
+	if(n_workers > n_threads)
+		n_workers = n_threads;
+	if(n_workers == 0)
+		n_workers = 1;
+
+	reachable.candidates = candidates;
+	reachable.n_candidates = n_candidates;
+	reachable.geometries = calloc(n_candidates ? n_candidates : 1,
+				      sizeof(*reachable.geometries));
+	reachable.seed = g_rand_int(self->rand);
+	reachable.next = 0;
+
+	/* prepare all the engine lists before starting any thread */
+	workers = calloc(n_workers, sizeof(*workers));
+	for(i=0; i<n_workers; ++i){
+		workers[i].reachable = &reachable;
+		if(!hkl_engine_worker_init(&workers[i].worker, self, error)
+		   || (mode && !hkl_engine_current_mode_set(workers[i].worker.engine,
+							    mode, error)))
+			goto out;
+	}
+
+	hkl_engine_pool_run(reachable_worker_run, workers, sizeof(*workers), n_workers);
+
+	/* keep only the reachable reflections */
+	geometries = reachable.geometries;
+	reachable.geometries = NULL;
+	*hkl = malloc((n_candidates ? 3 * n_candidates : 1) * sizeof(**hkl));
+	for(i=0, n=0; i<n_candidates; ++i)
+		if(geometries[i]){
+			geometries[n] = geometries[i];
+			memcpy(&(*hkl)[3 * n], candidates[i].hkl, sizeof(candidates[i].hkl));
+			n++;
+		}
+	*n_reflections = n;
+
+out:
+	for(i=0; i<n_workers; ++i)
+		hkl_engine_worker_release(&workers[i].worker);
+	free(workers);
+	free(reachable.geometries);
+	free(candidates);
+
+	return geometries;
+}
+
 /**
  * hkl_engine_pseudo_axis_get:
  * @self: the this ptr
@@ -289,6 +1159,7 @@ HklGeometryList *hkl_engine_pseudo_axis_set(HklEngine *self,
 	darray_foreach(p, self->pseudo_axes)
 		if(!strcmp((*p)->name, parameter->name)){
 			/* todo save the previous value to restore this value */
+			hkl_engine_stale_set(self);
 			hkl_parameter_init_copy(*p, parameter, NULL);
 			if(!hkl_engine_set(self, error)){
 				g_assert(error == NULL || *error != NULL);
@@ -394,6 +1265,7 @@ int hkl_engine_parameters_values_set(HklEngine *self,
 {
 	hkl_error (error == NULL || *error == NULL || n_values == darray_size(self->mode->parameters));
 
+	hkl_engine_stale_set(self);
 	for(size_t i=0; i<n_values; ++i){
 		if(!hkl_parameter_value_set(darray_item(self->mode->parameters, i),
 					    values[i], unit_type, error)){
@@ -462,6 +1334,7 @@ int hkl_engine_parameter_set(HklEngine *self,
 	darray_foreach(p, self->mode->parameters)
 		if(!strcmp(name, (*p)->name)){
 			const char *old_name = (*p)->name;
+			hkl_engine_stale_set(self);
 			hkl_parameter_init_copy(*p, parameter, NULL);
 			/* we do not check if the name is identical so force the right name */
 			/* TODO rethink this HklParameter assignement */
@@ -510,6 +1383,7 @@ int hkl_engine_current_mode_set(HklEngine *self, const char *name,
 	darray_foreach(mode, self->modes)
 		if(!strcmp((*mode)->info->name, name)){
 			hkl_engine_mode_set(self, *mode);
+			hkl_engine_stale_set(self);
 			return TRUE;
 		}
 
@@ -577,6 +1451,8 @@ int hkl_engine_initialized_set(HklEngine *self, int initialized, GError **error)
 		return FALSE;
 	}
 
+	hkl_engine_stale_set(self);
+
 	return hkl_mode_initialized_set(self->mode,
 					self,
 					self->engines->geometry,
@@ -586,6 +1462,58 @@ int hkl_engine_initialized_set(HklEngine *self, int initialized, GError **error)
 					error);
 }
 
+/**
+ * hkl_engine_random_seed_set:
+ * @self: the HklEngine
+ * @seed: the new seed
+ *
+ * reset the random generator used by the numerical solvers of the
+ * engine to pick their restart points. Two engines with the same
+ * seed and the same inputs compute the same solutions.
+ **/
+void hkl_engine_random_seed_set(HklEngine *self, unsigned int seed)
+{
+	g_rand_set_seed(self->rand, seed);
+}
+
+/**
+ * hkl_engine_parallel_starts_set:
+ * @self: the HklEngine
+ * @n_starts: the number of starting points tried at the same time
+ *
+ * When the numerical solver does not converge from the current
+ * position, it restarts from other starting points. With @n_starts
+ * greater than 1 these restarts are tried concurrently in @n_starts
+ * threads, the first one which converges is kept and the others are
+ * stopped. The solution found can then depend on the threads
+ * scheduling. 1, the default, tries the restarts one after the other.
+ **/
+void hkl_engine_parallel_starts_set(HklEngine *self, unsigned int n_starts)
+{
+	self->n_parallel_starts = n_starts > 0 ? n_starts : 1;
+}
+
+/**
+ * hkl_engine_stale_get:
+ * @self: the this ptr
+ *
+ * The pseudo axes values are recomputed by the get methods only if
+ * one of the dependencies of the engine changed since they were
+ * computed (see hkl_engine_dependencies_get), or if the pseudo axes,
+ * the parameters or the mode of the engine were modified since.
+ *
+ * return value: TRUE if the next get recomputes the pseudo axes
+ * values, FALSE if they are up to date.
+ **/
+int hkl_engine_stale_get(const HklEngine *self)
+{
+	if(!self->inputs.valid
+	   || !self->engines || !self->engines->geometry || !self->engines->sample)
+		return TRUE;
+
+	return (hkl_engine_changes_get(self) & self->info->dependencies) != 0;
+}
+
 /**
  * hkl_engine_dependencies_get:
  * @self: the this ptr
@@ -639,6 +1567,249 @@ void hkl_engine_fprintf(FILE *f, const HklEngine *self)
 	fprintf(f, "\n");
 }
 
+/*******************/
+/* HklEngineWorker */
+/*******************/
+
+/**
+ * hkl_engine_worker_init: (skip)
+ * @self: the worker to initialize
+ * @engine: the engine to copy
+ * @error: return location for a GError, or NULL
+ *
+ * build a private engine list with copies of the geometry, detector
+ * and sample of the @engine list (the geometry copy does not share
+ * its holders configurations with the caller), and select in it the
+ * same engine with the same mode, mode state and pseudo axes
+ * values. The worker engine can then be used from another thread. It
+ * must be released with hkl_engine_worker_release even if the
+ * initialization failed.
+ *
+ * return value: TRUE if succeded or FALSE otherwise.
+ **/
+int hkl_engine_worker_init(HklEngineWorker *self, const HklEngine *engine,
+			   GError **error)
+{
+	const HklEngineList *engines = engine->engines;
+
+	hkl_error (error == NULL || *error == NULL);
+
+	self->geometry = hkl_geometry_new_copy_unshared(engines->geometry);
+	self->detector = hkl_detector_new_copy(engines->detector);
+	self->sample = hkl_sample_new_copy(engines->sample);
+	self->engines = hkl_factory_create_new_engine_list(engines->geometry->factory);
+	hkl_engine_list_init(self->engines,
+			     self->geometry, self->detector, self->sample);
+
+	self->engine = hkl_engine_list_engine_get_by_name(self->engines,
+							  engine->info->name,
+							  error);
+	if(!self->engine)
+		return FALSE;
+
+	return hkl_engine_worker_sync(self, engine, engines->geometry, error);
+}
+
+/**
+ * hkl_engine_worker_sync: (skip)
+ * @self: the worker to update
+ * @engine: the engine the worker was initialized from
+ * @geometry: the geometry to solve from
+ * @error: return location for a GError, or NULL
+ *
+ * bring an initialized worker back in the state of @engine, its
+ * geometry is set from @geometry, so a worker can be reused for
+ * many solves without building a new engine list.
+ *
+ * return value: TRUE if succeded or FALSE otherwise.
+ **/
+int hkl_engine_worker_sync(HklEngineWorker *self, const HklEngine *engine,
+			   const HklGeometry *geometry, GError **error)
+{
+	const HklEngineList *engines = engine->engines;
+
+	hkl_error (error == NULL || *error == NULL);
+
+	if(!hkl_geometry_init_geometry(self->geometry, geometry)){
+		g_set_error(error,
+			    HKL_ENGINE_ERROR,
+			    HKL_ENGINE_ERROR_SET,
+			    "can not copy the geometry");
+		return FALSE;
+	}
+	*self->detector = *engines->detector;
+	if(self->sample->gen != engines->sample->gen)
+		hkl_sample_init_copy_UB(self->sample, engines->sample);
+
+	hkl_engine_list_solutions_max_set(self->engines,
+					  hkl_engine_list_solutions_max_get(engines));
+	hkl_engine_list_variants_lazy_set(self->engines,
+					  hkl_engine_list_variants_lazy_get(engines));
+	hkl_engine_list_ranking_set(self->engines,
+				    hkl_engine_list_ranking_get(engines));
+
+	if(!hkl_engine_current_mode_set(self->engine, engine->mode->info->name, error))
+		return FALSE;
+
+	if(!hkl_mode_init_copy(self->engine->mode, engine->mode)){
+		g_set_error(error,
+			    HKL_ENGINE_ERROR,
+			    HKL_ENGINE_ERROR_SET,
+			    "can not copy the \"%s\" mode state",
+			    engine->mode->info->name);
+		return FALSE;
+	}
+
+	for(size_t i=0; i<darray_size(engine->pseudo_axes); ++i)
+		if(!hkl_parameter_init_copy(darray_item(self->engine->pseudo_axes, i),
+					    darray_item(engine->pseudo_axes, i),
+					    error))
+			return FALSE;
+
+	hkl_engine_prepare_internal(self->engine);
+
+	return TRUE;
+}
+
+/**
+ * hkl_engine_worker_release: (skip)
+ * @self: the worker to release
+ *
+ * release the memory of the worker engine list.
+ **/
+void hkl_engine_worker_release(HklEngineWorker *self)
+{
+	if(self->engines)
+		hkl_engine_list_free(self->engines);
+	if(self->geometry)
+		hkl_geometry_free(self->geometry);
+	if(self->detector)
+		hkl_detector_free(self->detector);
+	if(self->sample)
+		hkl_sample_free(self->sample);
+}
+
+/*****************/
+/* HklEnginePool */
+/*****************/
+
+/* one parallel run of hkl_engine_pool_run. The helpers queued on the
+ * pool may start after the run is over, so the job is refcounted. */
+struct hkl_engine_pool_job {
+	GThreadFunc func;
+	char *data;
+	size_t size;
+	size_t n;
+	volatile gint next; /* index of the next task to claim */
+	volatile gint running; /* helpers between claim and completion */
+	volatile gint ref;
+	GMutex mutex;
+	GCond cond;
+};
+
+static void hkl_engine_pool_job_unref(struct hkl_engine_pool_job *job)
+{
+	if(!g_atomic_int_dec_and_test(&job->ref))
+		return;
+
+	g_mutex_clear(&job->mutex);
+	g_cond_clear(&job->cond);
+	free(job);
+}
+
+/* claim and run the tasks until none is left */
+static void hkl_engine_pool_job_work(struct hkl_engine_pool_job *job)
+{
+	gint i;
+
+	for(;;){
+		g_atomic_int_inc(&job->running);
+		i = g_atomic_int_add(&job->next, 1);
+		if(i < (gint)job->n)
+			job->func(job->data + i * job->size);
+		if(g_atomic_int_dec_and_test(&job->running)){
+			g_mutex_lock(&job->mutex);
+			g_cond_broadcast(&job->cond);
+			g_mutex_unlock(&job->mutex);
+		}
+		if(i >= (gint)job->n)
+			break;
+	}
+}
+
+static void hkl_engine_pool_helper(gpointer data, gpointer user_data)
+{
+	struct hkl_engine_pool_job *job = data;
+
+	hkl_engine_pool_job_work(job);
+	hkl_engine_pool_job_unref(job);
+}
+
+static GThreadPool *hkl_engine_pool_get(void)
+{
+	static gsize pool = 0;
+
+	if(g_once_init_enter(&pool)){
+		GThreadPool *tmp = g_thread_pool_new(hkl_engine_pool_helper, NULL,
+						     g_get_num_processors(),
+						     FALSE, NULL);
+		g_once_init_leave(&pool, (gsize)tmp);
+	}
+
+	return (GThreadPool *)pool;
+}
+
+/**
+ * hkl_engine_pool_run: (skip)
+ * @func: the task function
+ * @data: the array of the @n tasks data
+ * @size: the size of one element of @data
+ * @n: the number of tasks
+ *
+ * run func(@data + i * @size) for all the i < @n and return once
+ * they are all done. The tasks run on the threads of a pool shared
+ * by all the engines and on the calling thread. The caller claims the
+ * tasks not yet started by the pool, so it never waits for a busy
+ * pool and the tasks may themself call hkl_engine_pool_run.
+ **/
+void hkl_engine_pool_run(GThreadFunc func, gpointer data, size_t size, size_t n)
+{
+	struct hkl_engine_pool_job *job;
+	size_t i;
+
+	if(n == 0)
+		return;
+
+	if(n == 1){
+		func(data);
+		return;
+	}
+
+	job = HKL_MALLOC(struct hkl_engine_pool_job);
+	job->func = func;
+	job->data = data;
+	job->size = size;
+	job->n = n;
+	job->next = 0;
+	job->running = 0;
+	job->ref = n;
+	g_mutex_init(&job->mutex);
+	g_cond_init(&job->cond);
+
+	for(i=0; i<n-1; ++i)
+		g_thread_pool_push(hkl_engine_pool_get(), job, NULL);
+
+	hkl_engine_pool_job_work(job);
+
+	/* wait for the tasks claimed by the helpers */
+	g_mutex_lock(&job->mutex);
+	while(g_atomic_int_get(&job->running) > 0)
+		g_cond_wait(&job->cond, &job->mutex);
+	g_mutex_unlock(&job->mutex);
+
+	hkl_engine_pool_job_unref(job);
+}
+
 /*****************/
 /* HklEngineList */
 /*****************/
@@ -703,6 +1874,86 @@ int hkl_engine_list_select_solution(HklEngineList *self,
 	return hkl_geometry_init_geometry(self->geometry, item->geometry);
 }
 
+/**
+ * hkl_engine_list_solutions_max_get:
+ * @self: the this ptr
+ *
+ * Return value: the maximum number of solutions computed by the
+ * engines, 0 if all of them are kept.
+ **/
+size_t hkl_engine_list_solutions_max_get(const HklEngineList *self)
+{
+	return self->geometries->n_items_max;
+}
+
+/**
+ * hkl_engine_list_solutions_max_set:
+ * @self: the this ptr
+ * @n: the maximum number of solutions, 0 to keep all of them.
+ *
+ * keep only the @n solutions closest to the current geometry the next
+ * time a pseudo axis is set. Use 1 if only the first solution is
+ * ever selected.
+ **/
+void hkl_engine_list_solutions_max_set(HklEngineList *self, size_t n)
+{
+	self->geometries->n_items_max = n;
+}
+
+/**
+ * hkl_engine_list_ranking_get:
+ * @self: the this ptr
+ *
+ * Return value: how the solutions are ordered.
+ **/
+HklEngineListRanking hkl_engine_list_ranking_get(const HklEngineList *self)
+{
+	return self->geometries->ranking;
+}
+
+/**
+ * hkl_engine_list_ranking_set:
+ * @self: the this ptr
+ * @ranking: the #HklEngineListRanking
+ *
+ * order the solutions by their distance to the current geometry (the
+ * default), or by the time to move to them computed with the axes
+ * kinematics of the geometry (see hkl_geometry_axis_kinematics_set).
+ **/
+void hkl_engine_list_ranking_set(HklEngineList *self,
+				 HklEngineListRanking ranking)
+{
+	self->geometries->ranking = ranking;
+}
+
+/**
+ * hkl_engine_list_variants_lazy_get:
+ * @self: the this ptr
+ *
+ * Return value: TRUE if the range variants of the solutions are not
+ * added to the solutions list.
+ **/
+int hkl_engine_list_variants_lazy_get(const HklEngineList *self)
+{
+	return self->geometries->variants_lazy;
+}
+
+/**
+ * hkl_engine_list_variants_lazy_set:
+ * @self: the this ptr
+ * @lazy: TRUE to not add the range variants of the solutions
+ *
+ * when @lazy is TRUE, the solutions list contains only one variant
+ * of each solution, the one closest to the current geometry, so the
+ * first solution is the same than with all the variants. The other
+ * variants (axes values modulo 2*pi) can be enumerated with an
+ * #HklGeometryVariants.
+ **/
+void hkl_engine_list_variants_lazy_set(HklEngineList *self, int lazy)
+{
+	self->geometries->variants_lazy = lazy;
+}
+
 /**
  * hkl_engine_list_engine_get_by_name:
  * @self: the this ptr
@@ -757,6 +2008,15 @@ void hkl_engine_list_init(HklEngineList *self,
 	self->sample = sample;
 
 	darray_foreach(engine, *self){
+		HklMode **mode;
+
+		/* the modes axes indexes depend on the geometry */
+		if(geometry)
+			darray_foreach(mode, (*engine)->modes){
+				hkl_mode_axes_w_resolve(*mode, geometry);
+			}
+
+		hkl_engine_stale_set(*engine);
 		hkl_engine_prepare_internal(*engine);
 	}
 }
@@ -767,6 +2027,7 @@ void hkl_engine_list_init(HklEngineList *self,
  *
  * apply the get method to all the #HklEngine of the list
  * after this it is possible to retrive all the #HklPseudoAxis values.
+ * Only the stale engines are recomputed (see hkl_engine_stale_get).
  *
  * Returns: HKL_SUCCESS or HKL_FAIL if one of the #HklEngine
  * get method failed.
@@ -44,6 +44,10 @@ struct _HklSample {
 	HklParameter *uz;
 	struct list_head reflections;
 	size_t n_reflections;
+	int gen; /* changed with the UB matrix, shared by the copies */
+	double *packed; /* h, k, l then _hkl x, y, z of the flagged reflections */
+	size_t n_packed; /* number of flagged reflections */
+	int packed_valid; /* the reflections did not change since the packing */
 };
 
 #define HKL_SAMPLE_ERROR hkl_sample_error_quark ()
@@ -56,11 +60,15 @@ static inline GQuark hkl_sample_error_quark (void)
 typedef enum {
 	HKL_SAMPLE_ERROR_MINIMIZED, /* can not minimize the sample */
 	HKL_SAMPLE_ERROR_COMPUTE_UB_BUSING_LEVY, /* can not compute UB */
+	HKL_SAMPLE_ERROR_COMPUTE_UB_LEAST_SQUARES, /* can not compute UB */
+	HKL_SAMPLE_ERROR_INDEX_PEAKS, /* can not index the peaks */
 } HklSampleError;
 
 
 extern void hkl_sample_fprintf(FILE *f, const HklSample *self);
 
+extern void hkl_sample_init_copy_UB(HklSample *self, const HklSample *src);
+
 
 /***********************/
 /* hklSampleReflection */
@@ -73,6 +81,7 @@ struct _HklSampleReflection {
 	HklVector _hkl;
 	int flag;
 	struct list_node list;
+	HklSample *sample; /* owner of the reflection, NULL until added */
 };
 
 #define HKL_SAMPLE_REFLECTION_ERROR hkl_sample_reflection_error_quark ()
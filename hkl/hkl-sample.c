@@ -23,6 +23,9 @@
 /* for strdup */
 #define _XOPEN_SOURCE 500
 #include <gsl/gsl_errno.h>              // for gsl_set_error_handler, etc
+#include <gsl/gsl_linalg.h>             // for gsl_linalg_SV_decomp
+#include <gsl/gsl_matrix_double.h>      // for gsl_matrix_set, etc
+#include <gsl/gsl_multifit_nlinear.h>   // for gsl_multifit_nlinear_fdf, etc
 #include <gsl/gsl_multimin.h>           // for gsl_multimin_function, etc
 #include <gsl/gsl_nan.h>                // for GSL_NAN
 #include <gsl/gsl_vector_double.h>      // for gsl_vector_get, etc
@@ -48,6 +51,9 @@
 
 /* #define DEBUG */
 #define ITER_MAX 10000
+#define RANSAC_ITER_MAX 1000
+#define INDEX_SEEDS_MAX 20
+#define INDEX_VECTORS_MAX 2000
 
 /* private */
 static void hkl_sample_clear_all_reflections(HklSample *self)
@@ -59,6 +65,7 @@ static void hkl_sample_clear_all_reflections(HklSample *self)
 		list_del(&reflection->list);
 		hkl_sample_reflection_free(reflection);
 	}
+	self->packed_valid = FALSE;
 }
 
 
@@ -68,26 +75,125 @@ static void hkl_sample_copy_all_reflections(HklSample *self, const  HklSample *s
 
 	list_head_init(&self->reflections);
 	list_for_each(&src->reflections, reflection, list){
-		list_add_tail(&self->reflections,
-			      &hkl_sample_reflection_new_copy(reflection)->list);
+		HklSampleReflection *dup = hkl_sample_reflection_new_copy(reflection);
+
+		dup->sample = self;
+		list_add_tail(&self->reflections, &dup->list);
 	}
 	self->n_reflections = src->n_reflections;
+	self->packed_valid = FALSE;
+}
+
+/*
+ * pack the hkl and the _hkl of the flagged reflections coordinate by
+ * coordinate, so the fitness of the sample is computed in one pass
+ * over contiguous arrays. Only done again when the reflections change.
+ */
+static void hkl_sample_packed_update(HklSample *self)
+{
+	size_t i;
+	size_t n = 0;
+	HklSampleReflection *reflection;
+
+	if (self->packed_valid)
+		return;
+
+	list_for_each(&self->reflections, reflection, list)
+		if(reflection->flag)
+			n++;
+
+	if (n != self->n_packed || !self->packed){
+		free(self->packed);
+		self->packed = n ? malloc(6 * n * sizeof(*self->packed)) : NULL;
+		self->n_packed = n;
+	}
+
+	i = 0;
+	list_for_each(&self->reflections, reflection, list){
+		if(reflection->flag){
+			size_t c;
+
+			for(c=0; c<3; ++c){
+				self->packed[c * n + i] = reflection->hkl.data[c];
+				self->packed[(3 + c) * n + i] = reflection->_hkl.data[c];
+			}
+			i++;
+		}
+	}
+
+	self->packed_valid = TRUE;
+}
+
+/*
+ * residuals[3 * i + c] = (UB.hkl - _hkl)[c] of the i-th flagged
+ * reflection, spaced by stride (residuals can be NULL).
+ *
+ * Returns: the sum of the squared residuals
+ */
+static double hkl_sample_packed_residuals(const HklSample *self,
+					  const HklMatrix *UB,
+					  double *residuals, size_t stride)
+{
+	size_t i;
+	const size_t n = self->n_packed;
+	const double *h = self->packed;
+	const double *k = h + n;
+	const double *l = k + n;
+	const double *x = l + n;
+	const double *y = x + n;
+	const double *z = y + n;
+	const double (*M)[3] = UB->data;
+	double fitness = 0.;
+
+	for(i=0; i<n; ++i){
+		const double r0 = M[0][0] * h[i] + M[0][1] * k[i] + M[0][2] * l[i] - x[i];
+		const double r1 = M[1][0] * h[i] + M[1][1] * k[i] + M[1][2] * l[i] - y[i];
+		const double r2 = M[2][0] * h[i] + M[2][1] * k[i] + M[2][2] * l[i] - z[i];
+
+		if (residuals){
+			residuals[(3 * i) * stride] = r0;
+			residuals[(3 * i + 1) * stride] = r1;
+			residuals[(3 * i + 2) * stride] = r2;
+		}
+		fitness += r0 * r0 + r1 * r1 + r2 * r2;
+	}
+
+	return fitness;
+}
+
+/*
+ * out[3 * i + c] = (M.hkl)[c] of the i-th flagged reflection, spaced
+ * by stride.
+ */
+static void hkl_sample_packed_times_matrix(const HklSample *self,
+					   const HklMatrix *m,
+					   double *out, size_t stride)
+{
+	size_t i;
+	const size_t n = self->n_packed;
+	const double *h = self->packed;
+	const double *k = h + n;
+	const double *l = k + n;
+	const double (*M)[3] = m->data;
+
+	for(i=0; i<n; ++i){
+		out[(3 * i) * stride] = M[0][0] * h[i] + M[0][1] * k[i] + M[0][2] * l[i];
+		out[(3 * i + 1) * stride] = M[1][0] * h[i] + M[1][1] * k[i] + M[1][2] * l[i];
+		out[(3 * i + 2) * stride] = M[2][0] * h[i] + M[2][1] * k[i] + M[2][2] * l[i];
+	}
 }
 
 
+/* the generations of the UB matrices of all the samples */
+static volatile gint hkl_sample_gen;
+
 static void hkl_sample_sample_set(HklSample *self, const HklSample *src)
 {
 	if(self->name)
 		free(self->name);
 	self->name = strdup(src->name);
 
-	hkl_lattice_lattice_set(self->lattice, src->lattice);
-	self->U = src->U;
-	self->UB = src->UB;
-
-	hkl_parameter_init_copy(self->ux, src->ux, NULL);
-	hkl_parameter_init_copy(self->uy, src->uy, NULL);
-	hkl_parameter_init_copy(self->uz, src->uz, NULL);
+	hkl_sample_init_copy_UB(self, src);
 
 	/* copy all the reflections */
 	hkl_sample_clear_all_reflections(self);
@@ -114,6 +220,9 @@ static void hkl_sample_reflection_update(HklSampleReflection *self)
 	q = darray_item(self->geometry->holders, 0)->q;
 	hkl_quaternion_conjugate(&q);
 	hkl_vector_rotated_quaternion(&self->_hkl, &q);
+
+	if(self->sample)
+		self->sample->packed_valid = FALSE;
 }
 
 static void hkl_sample_compute_UxUyUz(HklSample *self)
@@ -137,6 +246,7 @@ static int hkl_sample_compute_UB(HklSample *self)
 
 	self->UB = self->U;
 	hkl_matrix_times_matrix(&self->UB, &B);
+	self->gen = g_atomic_int_add(&hkl_sample_gen, 1) + 1;
 
 	return TRUE;
 }
@@ -213,29 +323,12 @@ static double set_UB_fitness(const gsl_vector *x, void *params)
 
 static double mono_crystal_fitness(const gsl_vector *x, void *params)
 {
-	size_t i;
-	double fitness;
 	HklSample *sample = params;
-	HklSampleReflection *reflection;
 
 	if (!hkl_sample_init_from_gsl_vector(sample, x))
 		return GSL_NAN;
 
-	fitness = 0.;
-	list_for_each(&sample->reflections, reflection, list){
-		if(reflection->flag){
-			HklVector UBh;
-
-			UBh = reflection->hkl;
-			hkl_matrix_times_vector(&sample->UB, &UBh);
-
-			for(i=0; i<3; ++i) {
-				double tmp = UBh.data[i] - reflection->_hkl.data[i];
-				fitness += tmp * tmp;
-			}
-		}
-	}
-	return fitness;
+	return hkl_sample_packed_residuals(sample, &sample->UB, NULL, 0);
 }
 
 static int minimize(HklSample *sample,
@@ -393,12 +486,34 @@ HklSample *hkl_sample_new_copy(const HklSample *self)
 	dup->ux = hkl_parameter_new_copy(self->ux);
 	dup->uy = hkl_parameter_new_copy(self->uy);
 	dup->uz = hkl_parameter_new_copy(self->uz);
+	dup->gen = self->gen;
 
 	hkl_sample_copy_all_reflections(dup, self);
 
 	return dup;
 }
 
+/**
+ * hkl_sample_init_copy_UB: (skip)
+ * @self: the #HklSample to update
+ * @src: the #HklSample to copy
+ *
+ * copy the lattice and the orientation of src but not its
+ * reflections.
+ **/
+void hkl_sample_init_copy_UB(HklSample *self, const HklSample *src)
+{
+	hkl_lattice_lattice_set(self->lattice, src->lattice);
+	self->U = src->U;
+	self->UB = src->UB;
+
+	hkl_parameter_init_copy(self->ux, src->ux, NULL);
+	hkl_parameter_init_copy(self->uy, src->uy, NULL);
+	hkl_parameter_init_copy(self->uz, src->uz, NULL);
+
+	self->gen = src->gen;
+}
+
 /**
  * hkl_sample_free: (skip)
  * @self:
@@ -416,6 +531,7 @@ void hkl_sample_free(HklSample *self)
 	hkl_parameter_free(self->uy);
 	hkl_parameter_free(self->uz);
 	hkl_sample_clear_all_reflections(self);
+	free(self->packed);
 	free(self);
 }
 
@@ -706,7 +822,9 @@ void hkl_sample_add_reflection(HklSample *self,
 	}
 
 	list_add_tail(&self->reflections, &reflection->list);
+	reflection->sample = self;
 	self->n_reflections++;
+	self->packed_valid = FALSE;
 }
 
 /**
@@ -722,6 +840,7 @@ void hkl_sample_del_reflection(HklSample *self,
 	list_del(&reflection->list);
 	hkl_sample_reflection_free(reflection);
 	self->n_reflections--;
+	self->packed_valid = FALSE;
 }
 
 /**
@@ -777,19 +896,909 @@ int hkl_sample_compute_UB_busing_levy(HklSample *self,
 	return TRUE;
 }
 
+/*
+ * Kabsch: the rotation U which minimize the sum of w_i |U.p_i - q_i|^2
+ * over the idx reflections, p and q packed coordinate by coordinate.
+ * It is not defined if the p_i or the q_i are all colinear.
+ */
+static int kabsch(const double *p, const double *q, const double *w,
+		  size_t n, const size_t *idx, size_t n_idx, HklMatrix *U)
+{
+	size_t i, j, k;
+	double a[9] = {0};
+	double v[9];
+	double s[3];
+	double work[3];
+	double d;
+	gsl_matrix_view A = gsl_matrix_view_array(a, 3, 3);
+	gsl_matrix_view V = gsl_matrix_view_array(v, 3, 3);
+	gsl_vector_view S = gsl_vector_view_array(s, 3);
+	gsl_vector_view W = gsl_vector_view_array(work, 3);
+	HklMatrix MA, MV;
+
+	/* the weighted cross covariance sum w.p.q^T */
+	for(k=0; k<n_idx; ++k){
+		const size_t r = idx[k];
+		const double wr = w ? w[r] : 1.;
+
+		for(i=0; i<3; ++i)
+			for(j=0; j<3; ++j)
+				a[i * 3 + j] += wr * p[i * n + r] * q[j * n + r];
+	}
+
+	if (gsl_linalg_SV_decomp(&A.matrix, &V.matrix, &S.vector, &W.vector))
+		return FALSE;
+
+	/* the singular values are sorted in decreasing order */
+	if (!(s[1] > HKL_EPSILON * s[0]))
+		return FALSE;
+
+	/* U = V.diag(1, 1, d).A^T with d = +-1 to avoid the reflections */
+	for(i=0; i<3; ++i)
+		for(j=0; j<3; ++j){
+			MA.data[i][j] = a[i * 3 + j];
+			MV.data[i][j] = v[i * 3 + j];
+		}
+	d = hkl_matrix_det(&MA) * hkl_matrix_det(&MV) < 0 ? -1. : 1.;
+
+	for(i=0; i<3; ++i)
+		for(j=0; j<3; ++j)
+			U->data[i][j] = MV.data[i][0] * MA.data[j][0]
+				+ MV.data[i][1] * MA.data[j][1]
+				+ d * MV.data[i][2] * MA.data[j][2];
+
+	return TRUE;
+}
+
+/*
+ * the squared distance between U.p_i and q_i for all the reflections,
+ * the inliers are the one closer than the threshold.
+ *
+ * Returns: the number of inliers
+ */
+static size_t kabsch_inliers(const double *p, const double *q, size_t n,
+			     const HklMatrix *U, double threshold,
+			     size_t *inliers, double *sum)
+{
+	size_t i;
+	size_t n_inliers = 0;
+	const double (*M)[3] = U->data;
+	const double *px = p;
+	const double *py = px + n;
+	const double *pz = py + n;
+	const double *qx = q;
+	const double *qy = qx + n;
+	const double *qz = qy + n;
+
+	*sum = 0.;
+	for(i=0; i<n; ++i){
+		const double r0 = M[0][0] * px[i] + M[0][1] * py[i] + M[0][2] * pz[i] - qx[i];
+		const double r1 = M[1][0] * px[i] + M[1][1] * py[i] + M[1][2] * pz[i] - qy[i];
+		const double r2 = M[2][0] * px[i] + M[2][1] * py[i] + M[2][2] * pz[i] - qz[i];
+		const double d2 = r0 * r0 + r1 * r1 + r2 * r2;
+
+		if (d2 < threshold * threshold){
+			inliers[n_inliers++] = i;
+			*sum += d2;
+		}
+	}
+
+	return n_inliers;
+}
+
+/**
+ * hkl_sample_compute_UB_least_squares:
+ * @self: the this ptr
+ * @weights: (array length=n_weights) (allow-none): the non negative
+ * weight of each reflection of the sample, in the reflections order.
+ * @n_weights: the number of weights (0 or the number of reflections)
+ * @threshold: the distance between the computed and the measured
+ * scattering vectors above which a reflection is an outlier, 0 to
+ * keep all the reflections.
+ * @error: return location for a GError, or NULL
+ *
+ * compute the U matrix which best fit all the flagged reflections
+ * for the current lattice, using the Kabsch algorithm (singular
+ * value decomposition of the weighted cross covariance of the B.hkl
+ * and the measured scattering vectors).
+ *
+ * When a threshold is given, the outliers are first rejected with a
+ * RANSAC on the pairs of reflections and they are unflagged, so a
+ * following hkl_sample_affine do not use them either.
+ *
+ * Returns: TRUE on success, FALSE if an error occurred
+ **/
+int hkl_sample_compute_UB_least_squares(HklSample *self,
+					const double *weights, size_t n_weights,
+					double threshold,
+					GError **error)
+{
+	size_t i, c, n, n_idx;
+	double *p;
+	double *w = NULL;
+	size_t *idx;
+	HklMatrix B;
+	HklMatrix U;
+	HklSampleReflection *reflection;
+	int res = TRUE;
+
+	hkl_error (error == NULL || *error == NULL);
+
+	if (weights && n_weights != self->n_reflections){
+		g_set_error(error,
+			    HKL_SAMPLE_ERROR,
+			    HKL_SAMPLE_ERROR_COMPUTE_UB_LEAST_SQUARES,
+			    "%d weights given for %d reflections",
+			    (int)n_weights, (int)self->n_reflections);
+		return FALSE;
+	}
+
+	if (!hkl_lattice_get_B(self->lattice, &B)){
+		g_set_error(error,
+			    HKL_SAMPLE_ERROR,
+			    HKL_SAMPLE_ERROR_COMPUTE_UB_LEAST_SQUARES,
+			    "The lattice parameters are not valid");
+		return FALSE;
+	}
+
+	hkl_sample_packed_update(self);
+	n = self->n_packed;
+	if (n == 0){
+		g_set_error(error,
+			    HKL_SAMPLE_ERROR,
+			    HKL_SAMPLE_ERROR_COMPUTE_UB_LEAST_SQUARES,
+			    "There is no flagged reflection to compute the UB matrix");
+		return FALSE;
+	}
+
+	/* the B.hkl of the flagged reflections */
+	p = malloc(3 * n * sizeof(*p));
+	idx = malloc(n * sizeof(*idx));
+	for(i=0; i<n; ++i){
+		for(c=0; c<3; ++c)
+			p[c * n + i] = B.data[c][0] * self->packed[i]
+				+ B.data[c][1] * self->packed[n + i]
+				+ B.data[c][2] * self->packed[2 * n + i];
+		idx[i] = i;
+	}
+	n_idx = n;
+
+	if (weights){
+		w = malloc(n * sizeof(*w));
+		i = 0;
+		c = 0;
+		list_for_each(&self->reflections, reflection, list){
+			if(reflection->flag)
+				w[i++] = weights[c];
+			c++;
+		}
+	}
+
+	if (threshold > 0. && n > 2){
+		const size_t n_pairs = n * (n - 1) / 2;
+		GRand *rand = g_rand_new_with_seed(0);
+		size_t *inliers = malloc(n * sizeof(*inliers));
+		size_t best = 0;
+		double best_sum = 0.;
+		size_t iter;
+
+		/* all the pairs if there is not too many of them */
+		for(iter=0; iter<MIN(n_pairs, RANSAC_ITER_MAX); ++iter){
+			size_t pair[2];
+			size_t n_inliers;
+			double sum;
+
+			if (n_pairs <= RANSAC_ITER_MAX){
+				/* the iter-th pair (i, j) with i < j */
+				pair[1] = (size_t)((1. + sqrt(1. + 8. * iter)) / 2.);
+				while (pair[1] * (pair[1] - 1) / 2 > iter)
+					pair[1]--;
+				while ((pair[1] + 1) * pair[1] / 2 <= iter)
+					pair[1]++;
+				pair[0] = iter - pair[1] * (pair[1] - 1) / 2;
+			}else{
+				pair[0] = g_rand_int_range(rand, 0, n);
+				pair[1] = g_rand_int_range(rand, 0, n - 1);
+				if (pair[1] >= pair[0])
+					pair[1]++;
+			}
+
+			if (!kabsch(p, &self->packed[3 * n], NULL, n, pair, 2, &U))
+				continue;
+
+			n_inliers = kabsch_inliers(p, &self->packed[3 * n], n,
+						   &U, threshold, inliers, &sum);
+			if (n_inliers > best
+			    || (n_inliers == best && sum < best_sum)){
+				best = n_inliers;
+				best_sum = sum;
+				memcpy(idx, inliers, n_inliers * sizeof(*idx));
+			}
+		}
+		n_idx = best;
+
+		free(inliers);
+		g_rand_free(rand);
+	}
+
+	if (n_idx >= 2 && kabsch(p, &self->packed[3 * n], w, n, idx, n_idx, &U)){
+		/* unflag the outliers */
+		if (n_idx < n){
+			size_t k = 0;
+
+			i = 0;
+			list_for_each(&self->reflections, reflection, list){
+				if(reflection->flag){
+					if (k < n_idx && idx[k] == i)
+						k++;
+					else
+						reflection->flag = FALSE;
+					i++;
+				}
+			}
+			self->packed_valid = FALSE;
+		}
+
+		self->U = U;
+		hkl_sample_compute_UxUyUz(self);
+		hkl_sample_compute_UB(self);
+	}else{
+		g_set_error(error,
+			    HKL_SAMPLE_ERROR,
+			    HKL_SAMPLE_ERROR_COMPUTE_UB_LEAST_SQUARES,
+			    "It is not possible to compute the UB matrix when the given reflections are colinear");
+		res = FALSE;
+	}
+
+	free(w);
+	free(idx);
+	free(p);
+
+	return res;
+}
+
+/* a reciprocal lattice vector used to index the peaks */
+struct index_vector
+{
+	HklVector hkl;
+	HklVector g; /* B.hkl */
+	double norm;
+};
+
+/* a pair of reciprocal lattice vectors and their angle */
+struct index_pair
+{
+	double angle;
+	size_t v1;
+	size_t v2;
+};
+
+/* a peak used to find the candidates orientations */
+struct index_seed
+{
+	double norm;
+	size_t idx;
+};
+
+static int index_pair_cmp(const void *p1, const void *p2)
+{
+	const struct index_pair *pair1 = p1;
+	const struct index_pair *pair2 = p2;
+
+	if (pair1->angle < pair2->angle)
+		return -1;
+	if (pair1->angle > pair2->angle)
+		return 1;
+	return 0;
+}
+
+static int index_seed_cmp(const void *p1, const void *p2)
+{
+	const struct index_seed *seed1 = p1;
+	const struct index_seed *seed2 = p2;
+
+	if (seed1->norm < seed2->norm)
+		return -1;
+	if (seed1->norm > seed2->norm)
+		return 1;
+	return seed1->idx < seed2->idx ? -1 : seed1->idx > seed2->idx;
+}
+
+/*
+ * the nearest integer hkl of each peak for the U orientation, a peak
+ * is indexed (votes for U) if B.hkl rotated by U is within the
+ * tolerance of its scattering vector.
+ *
+ * Returns: the number of indexed peaks
+ */
+static size_t index_peaks(HklSampleReflection *const *peaks, size_t n,
+			  const HklMatrix *U, const HklMatrix *B,
+			  const HklMatrix *B_1, double tolerance,
+			  HklVector *hkl, int *indexed, double *sum)
+{
+	size_t i, c;
+	size_t n_indexed = 0;
+
+	*sum = 0.;
+	for(i=0; i<n; ++i){
+		const HklVector *q = &peaks[i]->_hkl;
+		HklVector h = *q;
+		HklVector g;
+		double d;
+
+		/* hkl = B^-1.U^T.q */
+		hkl_vector_times_matrix(&h, U);
+		hkl_matrix_times_vector(B_1, &h);
+		for(c=0; c<3; ++c)
+			h.data[c] = round(h.data[c]);
+
+		indexed[i] = FALSE;
+		if (hkl_vector_is_null(&h))
+			continue;
+
+		g = h;
+		hkl_matrix_times_vector(B, &g);
+		hkl_matrix_times_vector(U, &g);
+		hkl_vector_minus_vector(&g, q);
+		d = hkl_vector_norm2(&g);
+		if (d <= tolerance * hkl_vector_norm2(q)){
+			hkl[i] = h;
+			indexed[i] = TRUE;
+			*sum += d * d;
+			n_indexed++;
+		}
+	}
+
+	return n_indexed;
+}
+
+/*
+ * refine U with the Kabsch algorithm over the indexed peaks
+ */
+static int index_refine(HklSampleReflection *const *peaks, size_t n,
+			const HklMatrix *B, const HklVector *hkl,
+			const int *indexed, HklMatrix *U)
+{
+	size_t i, c;
+	size_t n_idx = 0;
+	double *p = malloc(6 * n * sizeof(*p));
+	double *q = &p[3 * n];
+	size_t *idx = malloc(n * sizeof(*idx));
+	int res;
+
+	for(i=0; i<n; ++i){
+		HklVector g = hkl[i];
+
+		if (!indexed[i])
+			continue;
+
+		hkl_matrix_times_vector(B, &g);
+		for(c=0; c<3; ++c){
+			p[c * n + i] = g.data[c];
+			q[c * n + i] = peaks[i]->_hkl.data[c];
+		}
+		idx[n_idx++] = i;
+	}
+
+	res = kabsch(p, q, NULL, n, idx, n_idx, U);
+
+	free(idx);
+	free(p);
+
+	return res;
+}
+
+/**
+ * hkl_sample_index_peaks:
+ * @self: the this ptr
+ * @geometries: (array length=n_geometries): the positions of the
+ * peaks.
+ * @n_geometries: the number of peaks
+ * @detector: the #HklDetector used to measure the peaks
+ * @tolerance: the relative tolerance on the scattering vectors
+ * @error: return location for a GError, or NULL
+ *
+ * index the peaks with the lattice of the sample and compute its U
+ * matrix. A table of the pairs of reciprocal lattice vectors, sorted
+ * by their angle, is matched against the pairs of the shortest
+ * measured scattering vectors. Each match gives an orientation, and
+ * the peaks vote for it when it indexes them. The orientation with
+ * the most votes is refined over its indexed peaks, which are then
+ * added to the sample as new reflections.
+ *
+ * The angles are compared with the angular tolerance of the
+ * scattering vectors, asin(@tolerance), a vector within the relative
+ * @tolerance of another one is at most at this angle from it.
+ *
+ * Returns: TRUE on success, FALSE if an error occurred
+ **/
+int hkl_sample_index_peaks(HklSample *self,
+			   const HklGeometry *const *geometries, size_t n_geometries,
+			   const HklDetector *detector, double tolerance,
+			   GError **error)
+{
+	size_t i, j, c;
+	size_t n_seeds = 0;
+	size_t n_pairs = 0;
+	size_t best = 0;
+	double best_sum = 0.;
+	const double angular_tolerance = asin(MIN(tolerance, 1.));
+	double q_max;
+	double sum;
+	int hkl_max[3];
+	int h, k, l;
+	HklMatrix B, B_1;
+	HklMatrix U;
+	HklMatrix U_best;
+	HklSampleReflection **peaks;
+	HklVector *hkl;
+	int *indexed;
+	struct index_seed *seeds;
+	struct index_pair *pairs = NULL;
+	darray(struct index_vector) vectors;
+	int res = TRUE;
+
+	hkl_error (error == NULL || *error == NULL);
+
+	if (n_geometries < 2){
+		g_set_error(error,
+			    HKL_SAMPLE_ERROR,
+			    HKL_SAMPLE_ERROR_INDEX_PEAKS,
+			    "At least two peaks are needed to index them");
+		return FALSE;
+	}
+
+	if (!hkl_lattice_get_B(self->lattice, &B)
+	    || !hkl_lattice_get_1_B(self->lattice, &B_1)){
+		g_set_error(error,
+			    HKL_SAMPLE_ERROR,
+			    HKL_SAMPLE_ERROR_INDEX_PEAKS,
+			    "The lattice parameters are not valid");
+		return FALSE;
+	}
+
+	/* the scattering vectors of the peaks */
+	peaks = malloc(n_geometries * sizeof(*peaks));
+	hkl = malloc(n_geometries * sizeof(*hkl));
+	indexed = malloc(n_geometries * sizeof(*indexed));
+	seeds = malloc(n_geometries * sizeof(*seeds));
+	for(i=0; i<n_geometries; ++i){
+		peaks[i] = hkl_sample_reflection_new(geometries[i], detector, 0, 0, 0, NULL);
+		if (hkl_vector_norm2(&peaks[i]->_hkl) > HKL_EPSILON){
+			seeds[n_seeds].norm = hkl_vector_norm2(&peaks[i]->_hkl);
+			seeds[n_seeds].idx = i;
+			n_seeds++;
+		}
+	}
+
+	/* the shortest scattering vectors are the easiest to match */
+	qsort(seeds, n_seeds, sizeof(*seeds), index_seed_cmp);
+	n_seeds = MIN(n_seeds, INDEX_SEEDS_MAX);
+	if (n_seeds < 2)
+		goto failed;
+
+	/* all the reciprocal lattice vectors up to the longest seed */
+	q_max = seeds[n_seeds - 1].norm * (1. + tolerance);
+	hkl_max[0] = floor(hkl_parameter_value_get(self->lattice->a, HKL_UNIT_DEFAULT) * q_max / HKL_TAU);
+	hkl_max[1] = floor(hkl_parameter_value_get(self->lattice->b, HKL_UNIT_DEFAULT) * q_max / HKL_TAU);
+	hkl_max[2] = floor(hkl_parameter_value_get(self->lattice->c, HKL_UNIT_DEFAULT) * q_max / HKL_TAU);
+
+	darray_init(vectors);
+	for(h=-hkl_max[0]; h<=hkl_max[0]; ++h)
+		for(k=-hkl_max[1]; k<=hkl_max[1]; ++k)
+			for(l=-hkl_max[2]; l<=hkl_max[2]; ++l){
+				struct index_vector v = {{{h, k, l}}};
+
+				if (!h && !k && !l)
+					continue;
+
+				v.g = v.hkl;
+				hkl_matrix_times_vector(&B, &v.g);
+				v.norm = hkl_vector_norm2(&v.g);
+				if (v.norm > q_max)
+					continue;
+
+				darray_append(vectors, v);
+				if (darray_size(vectors) > INDEX_VECTORS_MAX){
+					darray_free(vectors);
+					res = FALSE;
+					g_set_error(error,
+						    HKL_SAMPLE_ERROR,
+						    HKL_SAMPLE_ERROR_INDEX_PEAKS,
+						    "Too many reciprocal lattice vectors to index the peaks");
+					goto out;
+				}
+			}
+
+	/* the table of the non colinear pairs sorted by angle */
+	if (darray_size(vectors) > 1)
+		pairs = malloc(darray_size(vectors) * (darray_size(vectors) - 1) / 2 * sizeof(*pairs));
+	for(i=0; i<darray_size(vectors); ++i)
+		for(j=i+1; j<darray_size(vectors); ++j){
+			double angle = hkl_vector_angle(&darray_item(vectors, i).g,
+							&darray_item(vectors, j).g);
+
+			if (angle < angular_tolerance || angle > M_PI - angular_tolerance)
+				continue;
+
+			pairs[n_pairs].angle = angle;
+			pairs[n_pairs].v1 = i;
+			pairs[n_pairs].v2 = j;
+			n_pairs++;
+		}
+	qsort(pairs, n_pairs, sizeof(*pairs), index_pair_cmp);
+
+	/* match the pairs of seeds and vote for the orientations */
+	for(i=0; i<n_seeds && best < n_geometries; ++i)
+		for(j=i+1; j<n_seeds && best < n_geometries; ++j){
+			const HklVector *q1 = &peaks[seeds[i].idx]->_hkl;
+			const HklVector *q2 = &peaks[seeds[j].idx]->_hkl;
+			const double angle = hkl_vector_angle(q1, q2);
+			const double d_angle = 2. * angular_tolerance; /* q1 and q2 */
+			size_t lo = 0;
+			size_t hi = n_pairs;
+			size_t m;
+
+			if (angle < angular_tolerance || angle > M_PI - angular_tolerance)
+				continue;
+
+			/* first pair with an angle >= angle - d_angle */
+			while (lo < hi){
+				size_t mid = lo + (hi - lo) / 2;
+
+				if (pairs[mid].angle < angle - d_angle)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+
+			for(m=lo; m<n_pairs && pairs[m].angle <= angle + d_angle; ++m){
+				const struct index_vector *v[2] = {&darray_item(vectors, pairs[m].v1),
+								   &darray_item(vectors, pairs[m].v2)};
+
+				/* the two ways to assign the pair to the seeds */
+				for(c=0; c<2; ++c){
+					const struct index_vector *v1 = v[c];
+					const struct index_vector *v2 = v[1 - c];
+					HklMatrix Tc;
+					size_t n_indexed;
+
+					if (fabs(v1->norm - seeds[i].norm) > tolerance * seeds[i].norm
+					    || fabs(v2->norm - seeds[j].norm) > tolerance * seeds[j].norm)
+						continue;
+
+					/* same as hkl_sample_compute_UB_busing_levy */
+					hkl_matrix_init_from_two_vector(&Tc, &v1->g, &v2->g);
+					hkl_matrix_transpose(&Tc);
+					hkl_matrix_init_from_two_vector(&U, q1, q2);
+					hkl_matrix_times_matrix(&U, &Tc);
+
+					n_indexed = index_peaks(peaks, n_geometries, &U, &B, &B_1,
+								tolerance, hkl, indexed, &sum);
+					if (n_indexed > best
+					    || (n_indexed == best && sum < best_sum)){
+						best = n_indexed;
+						best_sum = sum;
+						U_best = U;
+					}
+				}
+			}
+		}
+	darray_free(vectors);
+
+	if (best < 2)
+		goto failed;
+
+	/* refine the orientation over the indexed peaks */
+	best = index_peaks(peaks, n_geometries, &U_best, &B, &B_1,
+			   tolerance, hkl, indexed, &sum);
+	for(i=0; i<2; ++i){
+		size_t n_indexed;
+
+		U = U_best;
+		if (!index_refine(peaks, n_geometries, &B, hkl, indexed, &U))
+			break;
+		n_indexed = index_peaks(peaks, n_geometries, &U, &B, &B_1,
+					tolerance, hkl, indexed, &sum);
+		if (n_indexed < best){
+			/* keep the previous indexation */
+			index_peaks(peaks, n_geometries, &U_best, &B, &B_1,
+				    tolerance, hkl, indexed, &sum);
+			break;
+		}
+		best = n_indexed;
+		U_best = U;
+	}
+
+	/* add the indexed peaks to the sample */
+	for(i=0; i<n_geometries; ++i)
+		if (indexed[i]){
+			peaks[i]->hkl = hkl[i];
+			hkl_sample_add_reflection(self, peaks[i]);
+			peaks[i] = NULL;
+		}
+
+	self->U = U_best;
+	hkl_sample_compute_UxUyUz(self);
+	hkl_sample_compute_UB(self);
+
+	goto out;
+
+failed:
+	res = FALSE;
+	g_set_error(error,
+		    HKL_SAMPLE_ERROR,
+		    HKL_SAMPLE_ERROR_INDEX_PEAKS,
+		    "It is not possible to index the given peaks");
+out:
+	for(i=0; i<n_geometries; ++i)
+		if (peaks[i])
+			hkl_sample_reflection_free(peaks[i]);
+	free(pairs);
+	free(seeds);
+	free(indexed);
+	free(hkl);
+	free(peaks);
+
+	return res;
+}
+
+/*
+ * this structure is used by the least squares gsl algorithm.
+ * in the affine method
+ */
+struct affine_t
+{
+	HklSample *sample;
+	double values[9]; /* ux, uy, uz, a, b, c, alpha, beta, gamma */
+	size_t idx[9]; /* index in values of the fitted parameters */
+	size_t p; /* number of fitted parameters */
+};
+
+static void affine_values_get(const struct affine_t *self,
+			      const gsl_vector *x, double values[9])
+{
+	size_t i;
+
+	memcpy(values, self->values, sizeof(self->values));
+	for(i=0; i<self->p; ++i)
+		values[self->idx[i]] = gsl_vector_get(x, i);
+}
+
+/* the residuals UB.hkl - _hkl of the flagged reflections */
+static int affine_f(const gsl_vector *x, void *params, gsl_vector *f)
+{
+	double values[9];
+	HklMatrix UB;
+	HklMatrix B;
+	struct affine_t *parameters = params;
+
+	affine_values_get(parameters, x, values);
+	hkl_matrix_init_from_euler(&UB, values[0], values[1], values[2]);
+	if (!hkl_lattice_compute_B(&values[3], &B, NULL))
+		return GSL_EDOM;
+	hkl_matrix_times_matrix(&UB, &B);
+
+	hkl_sample_packed_residuals(parameters->sample, &UB,
+				    gsl_vector_ptr(f, 0), f->stride);
+
+	return GSL_SUCCESS;
+}
+
+/* the analytic jacobian of the residuals, dU.B.hkl for the eulerian
+ * angles and U.dB.hkl for the lattice parameters */
+static int affine_df(const gsl_vector *x, void *params, gsl_matrix *J)
+{
+	size_t j;
+	double values[9];
+	HklMatrix U, dU[3];
+	HklMatrix B, dB[6];
+	struct affine_t *parameters = params;
+
+	affine_values_get(parameters, x, values);
+	hkl_matrix_init_from_euler(&U, values[0], values[1], values[2]);
+	hkl_matrix_init_from_euler_derivatives(dU, values[0], values[1], values[2]);
+	if (!hkl_lattice_compute_B(&values[3], &B, dB))
+		return GSL_EDOM;
+
+	for(j=0; j<parameters->p; ++j){
+		const size_t k = parameters->idx[j];
+		HklMatrix M;
+
+		if (k < 3){
+			M = dU[k];
+			hkl_matrix_times_matrix(&M, &B);
+		}else{
+			M = U;
+			hkl_matrix_times_matrix(&M, &dB[k - 3]);
+		}
+
+		hkl_sample_packed_times_matrix(parameters->sample, &M,
+					       gsl_matrix_ptr(J, 0, j), J->tda);
+	}
+
+	return GSL_SUCCESS;
+}
+
+/*
+ * Levenberg-Marquardt refinement of the fitted parameters, the
+ * sample is only modified on success.
+ */
+static int affine_least_squares(HklSample *self, double covariance[81],
+				GError **error)
+{
+	struct affine_t params;
+	const HklParameter *parameters[9];
+	gsl_multifit_nlinear_fdf fdf;
+	gsl_multifit_nlinear_parameters fdf_params;
+	gsl_multifit_nlinear_workspace *w;
+	gsl_vector *x;
+	size_t i, j;
+	size_t n;
+	int info;
+	int status;
+
+	hkl_error (error == NULL || *error == NULL);
+
+	parameters[0] = self->ux;
+	parameters[1] = self->uy;
+	parameters[2] = self->uz;
+	parameters[3] = self->lattice->a;
+	parameters[4] = self->lattice->b;
+	parameters[5] = self->lattice->c;
+	parameters[6] = self->lattice->alpha;
+	parameters[7] = self->lattice->beta;
+	parameters[8] = self->lattice->gamma;
+
+	params.sample = self;
+	params.p = 0;
+	for(i=0; i<9; ++i){
+		params.values[i] = hkl_parameter_value_get(parameters[i], HKL_UNIT_DEFAULT);
+		if (parameters[i]->fit)
+			params.idx[params.p++] = i;
+	}
+
+	hkl_sample_packed_update(self);
+	n = 3 * self->n_packed;
+	if (n == 0 || n < params.p){
+		g_set_error(error,
+			    HKL_SAMPLE_ERROR,
+			    HKL_SAMPLE_ERROR_MINIMIZED,
+			    "Not enough reflections to fit the %d parameters.",
+			    (int)params.p);
+		return FALSE;
+	}
+
+	if (covariance)
+		memset(covariance, 0, 81 * sizeof(*covariance));
+
+	if (params.p == 0)
+		return TRUE;
+
+	fdf.f = affine_f;
+	fdf.df = affine_df;
+	fdf.fvv = NULL;
+	fdf.n = n;
+	fdf.p = params.p;
+	fdf.params = &params;
+
+	fdf_params = gsl_multifit_nlinear_default_parameters();
+	fdf_params.trs = gsl_multifit_nlinear_trs_lm;
+
+	x = gsl_vector_alloc(params.p);
+	for(i=0; i<params.p; ++i)
+		gsl_vector_set(x, i, params.values[params.idx[i]]);
+
+	w = gsl_multifit_nlinear_alloc(gsl_multifit_nlinear_trust,
+				       &fdf_params, n, params.p);
+	gsl_set_error_handler_off();
+	status = gsl_multifit_nlinear_init(x, &fdf, w);
+	if (status == GSL_SUCCESS)
+		status = gsl_multifit_nlinear_driver(ITER_MAX,
+						     HKL_EPSILON * HKL_EPSILON,
+						     HKL_EPSILON * HKL_EPSILON,
+						     0., NULL, NULL, &info, w);
+#ifdef DEBUG
+	fprintf(stderr, "status driver: %d (%zu): %s\n",
+		status, gsl_multifit_nlinear_niter(w), gsl_strerror(status));
+#endif
+	if (status == GSL_SUCCESS){
+		double values[9];
+		gsl_vector_view v = gsl_vector_view_array(values, 9);
+
+		affine_values_get(&params, gsl_multifit_nlinear_position(w), values);
+
+		if (covariance){
+			const gsl_vector *f = gsl_multifit_nlinear_residual(w);
+			gsl_matrix *covar = gsl_matrix_alloc(params.p, params.p);
+			double scale = 0.;
+
+			/* scale by the variance of the residuals */
+			if (n > params.p){
+				for(i=0; i<n; ++i)
+					scale += gsl_vector_get(f, i) * gsl_vector_get(f, i);
+				scale /= n - params.p;
+			}else
+				scale = 1.;
+
+			status = gsl_multifit_nlinear_covar(gsl_multifit_nlinear_jac(w),
+							    0., covar);
+			for(i=0; i<params.p; ++i)
+				for(j=0; j<params.p; ++j)
+					covariance[params.idx[i] * 9 + params.idx[j]] = scale * gsl_matrix_get(covar, i, j);
+			gsl_matrix_free(covar);
+		}
+
+		if (status == GSL_SUCCESS){
+			/* save the sample state, it is restored if
+			 * the new parameters are only partly set */
+			HklSample *saved = hkl_sample_new_copy(self);
+
+			if (!hkl_sample_init_from_gsl_vector(self, &v.vector)){
+				hkl_sample_sample_set(self, saved); /* restore the saved sample */
+				status = GSL_EDOM;
+			}
+			hkl_sample_free(saved);
+		}
+	}
+	gsl_set_error_handler (NULL);
+	gsl_multifit_nlinear_free(w);
+	gsl_vector_free(x);
+
+	if (status != GSL_SUCCESS){
+		if (covariance)
+			memset(covariance, 0, 81 * sizeof(*covariance));
+		g_set_error(error,
+			    HKL_SAMPLE_ERROR,
+			    HKL_SAMPLE_ERROR_MINIMIZED,
+			    "Least squares refinement failed: %s.",
+			    gsl_strerror(status));
+		return FALSE;
+	}
+	g_assert (error == NULL || *error == NULL);
+
+	return TRUE;
+}
+
 /**
  * hkl_sample_affine:
  * @self: the this ptr
  *
- * affine the sample
+ * affine the sample. The fitted parameters are refined with a
+ * Levenberg-Marquardt least squares when there is enough reflections,
+ * otherwise (or if it fails) with a simplex minimization.
  *
  * Returns: the fitness of the affined #HklSample
  **/
 int hkl_sample_affine(HklSample *self, GError **error)
 {
+	/* also packs the reflections used by mono_crystal_fitness */
+	if (affine_least_squares(self, NULL, NULL))
+		return TRUE;
+
 	return minimize(self, mono_crystal_fitness, self, error);
 }
 
+/**
+ * hkl_sample_affine_covariance:
+ * @self: the this ptr
+ * @covariance: (out caller-allocates) (array fixed-size=81): the
+ * covariance matrix of the ux, uy, uz, a, b, c, alpha, beta, gamma
+ * parameters (row major, zero for the parameters not fitted)
+ * @error: return location for a GError, or NULL
+ *
+ * affine the sample with a Levenberg-Marquardt least squares and
+ * compute the covariance of the fitted parameters, scaled by the
+ * variance of the residuals.
+ *
+ * Returns: TRUE on success, FALSE if an error occurred
+ **/
+int hkl_sample_affine_covariance(HklSample *self, double covariance[81],
+				 GError **error)
+{
+	return affine_least_squares(self, covariance, error);
+}
+
 /**
  * hkl_sample_get_reflection_measured_angle:
  * @self: the this ptr
@@ -1017,6 +2026,9 @@ int hkl_sample_reflection_hkl_set(HklSampleReflection *self,
 	self->hkl.data[1] = k;
 	self->hkl.data[2] = l;
 
+	if(self->sample)
+		self->sample->packed_valid = FALSE;
+
 	return TRUE;
 }
 
@@ -1043,6 +2055,9 @@ int hkl_sample_reflection_flag_get(const HklSampleReflection *self)
 void hkl_sample_reflection_flag_set(HklSampleReflection *self, int flag)
 {
 	self->flag = flag;
+
+	if(self->sample)
+		self->sample->packed_valid = FALSE;
 }
 
 /**
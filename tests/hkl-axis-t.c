@@ -187,9 +187,48 @@ static void get_value_closest(void)
 	hkl_parameter_free(axis2);
 }
 
+static void values_set_fast(void)
+{
+	static HklVector v1 = {{1, 0, 0}};
+	static HklVector v2 = {{0, 2, 0}};
+	static double values[] = {-M_PI_2, M_PI / 3, 1.};
+	HklParameter *axes[3];
+	HklParameter *refs[2];
+	size_t i;
+
+	axes[0] = hkl_parameter_new_axis("omega", &v1, &hkl_unit_angle_deg);
+	axes[1] = hkl_parameter_new_axis("phi", &v2, &hkl_unit_angle_deg);
+	axes[2] = hkl_parameter_new("x", "a translation", -10, 0, 10,
+				    TRUE, FALSE,
+				    &hkl_unit_length_nm, &hkl_unit_length_nm);
+	refs[0] = hkl_parameter_new_axis("omega", &v1, &hkl_unit_angle_deg);
+	refs[1] = hkl_parameter_new_axis("phi", &v2, &hkl_unit_angle_deg);
+
+	/* same quaternions than the slow path */
+	hkl_axis_values_set_fast(axes, values, ARRAY_SIZE(axes));
+	for(i=0; i<ARRAY_SIZE(refs); ++i){
+		ok(TRUE == hkl_parameter_value_set(refs[i], values[i], HKL_UNIT_DEFAULT, NULL), __func__);
+		is_quaternion(hkl_parameter_quaternion_get(refs[i]),
+			      hkl_parameter_quaternion_get(axes[i]), __func__);
+	}
+	is_double(1., hkl_parameter_value_get(axes[2], HKL_UNIT_DEFAULT), HKL_EPSILON, __func__);
+
+	/* the unchanged axes are skipped */
+	axes[0]->changed = FALSE;
+	axes[1]->changed = FALSE;
+	values[1] = 0.;
+	hkl_axis_values_set_fast(axes, values, ARRAY_SIZE(axes));
+	ok(FALSE == axes[0]->changed && TRUE == axes[1]->changed, __func__);
+
+	for(i=0; i<ARRAY_SIZE(axes); ++i)
+		hkl_parameter_free(axes[i]);
+	for(i=0; i<ARRAY_SIZE(refs); ++i)
+		hkl_parameter_free(refs[i]);
+}
+
 int main(void)
 {
-	plan(53);
+	plan(59);
 
 	new();
 	get_quaternions();
@@ -197,6 +236,7 @@ int main(void)
 	is_valid();
 	set_value_smallest_in_range();
 	get_value_closest();
+	values_set_fast();
 
 	return 0;
 }
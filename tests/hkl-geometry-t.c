@@ -61,6 +61,7 @@ static void get_axis(void)
 	HklHolder *holder = NULL;
 	const HklParameter *axis0;
 	GError *error;
+	char name[] = "B";
 
 	g = hkl_geometry_new(NULL);
 
@@ -77,6 +78,9 @@ static void get_axis(void)
 	res &= DIAG(0 == !hkl_geometry_get_axis_by_name(g, "B"));
 	res &= DIAG(0 == !hkl_geometry_get_axis_by_name(g, "C"));
 	res &= DIAG(1 == !hkl_geometry_get_axis_by_name(g, "D"));
+	/* even with a name which is not the axis one */
+	res &= DIAG(hkl_geometry_get_axis_by_name(g, "B") == hkl_geometry_get_axis_by_name(g, name));
+	res &= DIAG(1 == hkl_geometry_get_axis_idx_by_name(g, name));
 
 	/* check the public API */
 	/* get */
@@ -144,6 +148,88 @@ static void update(void)
 	hkl_geometry_free(g);
 }
 
+static void update_partial(void)
+{
+	int res = TRUE;
+	HklGeometry *g = NULL;
+	HklHolder *holder = NULL;
+	static const HklQuaternion q0 = {{1, 0, 0, 0}};
+	static const HklQuaternion qx = {{1./sqrt(2), 1./sqrt(2), 0, 0}};
+	static const HklQuaternion qxx = {{0, 1, 0, 0}};
+
+	g = hkl_geometry_new(NULL);
+
+	holder = hkl_geometry_add_holder(g);
+	hkl_holder_add_rotation_axis(holder, "A", 1., 0., 0.);
+	hkl_holder_add_rotation_axis(holder, "B", 1., 0., 0.);
+
+	holder = hkl_geometry_add_holder(g);
+	hkl_holder_add_rotation_axis(holder, "C", 1., 0., 0.);
+
+	res &= DIAG(hkl_parameter_value_set(hkl_geometry_get_axis_by_name(g, "A"),
+					    M_PI_2, HKL_UNIT_DEFAULT, NULL));
+	hkl_geometry_update(g);
+	res &= DIAG(TRUE == hkl_quaternion_cmp(&qx, &darray_item(g->holders, 0)->q));
+
+	/* moving only C does not touch the first holder, so a
+	 * sentinel written in it survives the update */
+	darray_item(g->holders, 0)->q = q0;
+	res &= DIAG(hkl_parameter_value_set(hkl_geometry_get_axis_by_name(g, "C"),
+					    M_PI_2, HKL_UNIT_DEFAULT, NULL));
+	hkl_geometry_update(g);
+	res &= DIAG(TRUE == hkl_quaternion_cmp(&q0, &darray_item(g->holders, 0)->q));
+	res &= DIAG(TRUE == hkl_quaternion_cmp(&qx, &darray_item(g->holders, 1)->q));
+
+	/* moving B keeps the rotation of A */
+	res &= DIAG(hkl_parameter_value_set(hkl_geometry_get_axis_by_name(g, "B"),
+					    M_PI_2, HKL_UNIT_DEFAULT, NULL));
+	hkl_geometry_update(g);
+	res &= DIAG(TRUE == hkl_quaternion_cmp(&qxx, &darray_item(g->holders, 0)->q));
+
+	ok(res, __func__);
+
+	hkl_geometry_free(g);
+}
+
+static void axis_v_lab(void)
+{
+	int res = TRUE;
+	HklGeometry *g = NULL;
+	HklHolder *holder = NULL;
+	HklVector v;
+	HklVector z = {{0, 0, 1}};
+	HklVector y = {{0, 1, 0}};
+
+	g = hkl_geometry_new(NULL);
+
+	holder = hkl_geometry_add_holder(g);
+	hkl_holder_add_rotation_axis(holder, "A", 0., 0., 1.);
+	hkl_holder_add_rotation_axis(holder, "B", 1., 0., 0.);
+
+	holder = hkl_geometry_add_holder(g);
+	hkl_holder_add_rotation_axis(holder, "C", 1., 0., 0.);
+
+	res &= DIAG(hkl_parameter_value_set(hkl_geometry_get_axis_by_name(g, "A"),
+					    M_PI_2, HKL_UNIT_DEFAULT, NULL));
+	hkl_geometry_update(g);
+
+	/* the first axis is not moved by the others */
+	holder = darray_item(g->holders, 0);
+	res &= DIAG(hkl_holder_axis_v_lab(holder, hkl_geometry_get_axis_by_name(g, "A"), &v));
+	res &= DIAG(0 == hkl_vector_cmp(&z, &v));
+
+	/* x rotated by A of 90° around z */
+	res &= DIAG(hkl_holder_axis_v_lab(holder, hkl_geometry_get_axis_by_name(g, "B"), &v));
+	res &= DIAG(0 == hkl_vector_cmp(&y, &v));
+
+	/* C is not part of this holder */
+	res &= DIAG(FALSE == hkl_holder_axis_v_lab(holder, hkl_geometry_get_axis_by_name(g, "C"), &v));
+
+	ok(res, __func__);
+
+	hkl_geometry_free(g);
+}
+
 static void set(void)
 {
 	HklGeometry *g;
@@ -175,6 +261,62 @@ static void set(void)
 	hkl_geometry_free(g);
 }
 
+static void new_copy(void)
+{
+	int res = TRUE;
+	size_t i;
+	HklGeometry *g;
+	HklGeometry *copy;
+	HklHolder *holder;
+	HklAxis *axes;
+
+	g = hkl_geometry_new(NULL);
+	holder = hkl_geometry_add_holder(g);
+	hkl_holder_add_rotation_axis(holder, "A", 1., 0., 0.);
+	hkl_holder_add_rotation_axis(holder, "B", 0., 1., 0.);
+	holder = hkl_geometry_add_holder(g);
+	hkl_holder_add_rotation_axis(holder, "C", 0., 0., 1.);
+	res &= DIAG(hkl_parameter_value_set(darray_item(g->axes, 1),
+					    M_PI_2, HKL_UNIT_DEFAULT, NULL));
+	hkl_geometry_update(g);
+
+	copy = hkl_geometry_new_copy(g);
+
+	/* the axes of the copy are contiguous */
+	axes = container_of(darray_item(copy->axes, 0), HklAxis, parameter);
+	res &= DIAG(darray_size(g->axes) == darray_size(copy->axes));
+	for(i=0; i<darray_size(copy->axes); ++i){
+		res &= DIAG(&axes[i].parameter == darray_item(copy->axes, i));
+		res &= DIAG(darray_item(g->axes, i)->_value == axes[i].parameter._value);
+		res &= DIAG(0 == hkl_vector_cmp(&axes[i].axis_v,
+						&container_of(darray_item(g->axes, i),
+							      HklAxis, parameter)->axis_v));
+	}
+	for(i=0; i<darray_size(copy->holders); ++i){
+		res &= DIAG(copy == darray_item(copy->holders, i)->geometry);
+		res &= DIAG(TRUE == hkl_quaternion_cmp(&darray_item(g->holders, i)->q,
+						    &darray_item(copy->holders, i)->q));
+	}
+
+	/* the copy is independent */
+	res &= DIAG(hkl_parameter_value_set(darray_item(copy->axes, 0),
+					    M_PI_2, HKL_UNIT_DEFAULT, NULL));
+	hkl_geometry_update(copy);
+	res &= DIAG(0. == darray_item(g->axes, 0)->_value);
+
+	/* and can still be extended */
+	holder = hkl_geometry_add_holder(copy);
+	hkl_holder_add_rotation_axis(holder, "D", 1., 0., 0.);
+	res &= DIAG(4 == darray_size(copy->axes));
+	res &= DIAG(3 == darray_size(copy->holders));
+	res &= DIAG(M_PI_2 == darray_item(copy->axes, 1)->_value);
+
+	ok(res, __func__);
+
+	hkl_geometry_free(copy);
+	hkl_geometry_free(g);
+}
+
 static void axis_values_get_set(void)
 {
 	unsigned int i;
@@ -322,6 +464,73 @@ static void  xxx_rotation_get(void)
 	hkl_sample_free(sample);
 }
 
+static void move_time(void)
+{
+	int res = TRUE;
+	HklGeometry *g;
+	HklGeometry *ref;
+	HklGeometryList *list;
+	HklHolder *holder;
+	double velocity, acceleration;
+
+	g = hkl_geometry_new(NULL);
+	holder = hkl_geometry_add_holder(g);
+	hkl_holder_add_rotation_axis(holder, "A", 1., 0., 0.);
+	hkl_holder_add_rotation_axis(holder, "B", 0., 1., 0.);
+
+	/* A is 10 times faster than B */
+	res &= DIAG(hkl_geometry_axis_kinematics_set(g, "A", 10., 0., HKL_UNIT_USER, NULL));
+	res &= DIAG(hkl_geometry_axis_kinematics_set(g, "B", 1., 0., HKL_UNIT_USER, NULL));
+	res &= DIAG(FALSE == hkl_geometry_axis_kinematics_set(g, "C", 1., 0., HKL_UNIT_USER, NULL));
+	res &= DIAG(FALSE == hkl_geometry_axis_kinematics_set(g, "A", -1., 0., HKL_UNIT_USER, NULL));
+	res &= DIAG(hkl_geometry_axis_kinematics_get(g, "A", &velocity, &acceleration,
+						     HKL_UNIT_USER, NULL));
+	is_double(10., velocity, HKL_EPSILON, __func__);
+	res &= DIAG(hkl_geometry_axis_kinematics_get(g, "A", &velocity, &acceleration,
+						     HKL_UNIT_DEFAULT, NULL));
+	is_double(10. * HKL_DEGTORAD, velocity, HKL_EPSILON, __func__);
+
+	ref = hkl_geometry_new_copy(g);
+	res &= DIAG(hkl_geometry_set_values_v(ref, HKL_UNIT_USER, NULL, 0., 0.));
+	res &= DIAG(hkl_geometry_set_values_v(g, HKL_UNIT_USER, NULL, 30., 2.));
+
+	/* 3s for A and 2s for B */
+	res &= DIAG(HKL_GEOMETRY_MOTION_SIMULTANEOUS == hkl_geometry_motion_get(g));
+	is_double(3., hkl_geometry_move_time(g, ref), HKL_EPSILON, __func__);
+	hkl_geometry_motion_set(g, HKL_GEOMETRY_MOTION_SEQUENTIAL);
+	is_double(5., hkl_geometry_move_time(g, ref), HKL_EPSILON, __func__);
+	hkl_geometry_motion_set(g, HKL_GEOMETRY_MOTION_SIMULTANEOUS);
+
+	/* with an acceleration, B reaches its velocity after 1s */
+	res &= DIAG(hkl_geometry_axis_kinematics_set(g, "B", 1., 1., HKL_UNIT_USER, NULL));
+	is_double(3., hkl_geometry_move_time(g, ref), HKL_EPSILON, __func__);
+	res &= DIAG(hkl_geometry_set_values_v(g, HKL_UNIT_USER, NULL, 0., 0.5));
+	is_double(2. * sqrt(.5), hkl_geometry_move_time(g, ref), HKL_EPSILON, __func__);
+
+	/* the farthest solution is the fastest one */
+	list = hkl_geometry_list_new();
+	res &= DIAG(hkl_geometry_set_values_v(g, HKL_UNIT_USER, NULL, 0., 5.));
+	hkl_geometry_list_add(list, g);
+	res &= DIAG(hkl_geometry_set_values_v(g, HKL_UNIT_USER, NULL, 20., 0.));
+	hkl_geometry_list_add(list, g);
+
+	hkl_geometry_list_sort(list, ref);
+	is_double(0., hkl_parameter_value_get(darray_item(hkl_geometry_list_items_first_get(list)->geometry->axes, 0),
+					      HKL_UNIT_USER),
+		  HKL_EPSILON, __func__);
+	list->ranking = HKL_ENGINE_LIST_RANKING_MOVE_TIME;
+	hkl_geometry_list_sort(list, ref);
+	is_double(20., hkl_parameter_value_get(darray_item(hkl_geometry_list_items_first_get(list)->geometry->axes, 0),
+					       HKL_UNIT_USER),
+		  HKL_EPSILON, __func__);
+
+	ok(res, __func__);
+
+	hkl_geometry_list_free(list);
+	hkl_geometry_free(ref);
+	hkl_geometry_free(g);
+}
+
 static void list(void)
 {
 	int i = 0;
@@ -369,6 +578,160 @@ static void list(void)
 	hkl_geometry_list_free(list);
 }
 
+static void list_sort_max(void)
+{
+	int i = 0;
+	int res = TRUE;
+	HklGeometry *g;
+	HklGeometryList *list;
+	const HklGeometryListItem *item;
+	HklHolder *holder;
+	static double values[] = {50., 10. + 1e-9 * HKL_RADTODEG, -10., 30., 5.};
+	static double expected[] = {5., 10., -10.};
+
+	g = hkl_geometry_new(NULL);
+	holder = hkl_geometry_add_holder(g);
+	hkl_holder_add_rotation_axis(holder, "A", 1., 0., 0.);
+
+	list = hkl_geometry_list_new();
+	for(i=0; i<ARRAY_SIZE(values); ++i){
+		res &= DIAG(hkl_geometry_set_values_v(g, HKL_UNIT_USER, NULL, values[i]));
+		hkl_geometry_list_add(list, g);
+	}
+
+	/* only the 3 closest are kept and the distances equal up to
+	 * HKL_EPSILON keep the order of the list */
+	list->n_items_max = ARRAY_SIZE(expected);
+	res &= DIAG(hkl_geometry_set_values_v(g, HKL_UNIT_USER, NULL, 0.));
+	hkl_geometry_list_sort(list, g);
+	is_int(ARRAY_SIZE(expected), hkl_geometry_list_n_items_get(list), __func__);
+
+	i = 0;
+	HKL_GEOMETRY_LIST_FOREACH(item, list){
+		is_double(expected[i++],
+			  hkl_parameter_value_get(darray_item(item->geometry->axes, 0), HKL_UNIT_USER),
+			  HKL_EPSILON, __func__);
+	}
+
+	ok(res, __func__);
+
+	hkl_geometry_free(g);
+	hkl_geometry_list_free(list);
+}
+
+static void list_hash(void)
+{
+	int i;
+	int res = TRUE;
+	HklGeometry *g;
+	HklGeometryList *list;
+	HklHolder *holder;
+	const double h = 2 * M_PI / (1 << 16);
+
+	g = hkl_geometry_new(NULL);
+	holder = hkl_geometry_add_holder(g);
+	hkl_holder_add_rotation_axis(holder, "A", 1., 0., 0.);
+	hkl_holder_add_rotation_axis(holder, "B", 0., 1., 0.);
+
+	list = hkl_geometry_list_new();
+	for(i=0; i<100; ++i){
+		res &= DIAG(hkl_geometry_set_values_v(g, HKL_UNIT_DEFAULT, NULL,
+						      i * HKL_DEGTORAD, -i * HKL_DEGTORAD));
+		hkl_geometry_list_add(list, g);
+	}
+	res &= DIAG(100 == hkl_geometry_list_n_items_get(list));
+
+	/* the duplicates modulo 2*pi or closer than HKL_EPSILON */
+	for(i=0; i<100; ++i){
+		res &= DIAG(hkl_geometry_set_values_v(g, HKL_UNIT_DEFAULT, NULL,
+						      i * HKL_DEGTORAD + 2 * M_PI,
+						      -i * HKL_DEGTORAD + HKL_EPSILON / 10));
+		hkl_geometry_list_add(list, g);
+	}
+	res &= DIAG(100 == hkl_geometry_list_n_items_get(list));
+
+	/* even across a boundary of the hash cells */
+	res &= DIAG(hkl_geometry_set_values_v(g, HKL_UNIT_DEFAULT, NULL,
+					      1000 * h - HKL_EPSILON / 4, M_PI));
+	hkl_geometry_list_add(list, g);
+	res &= DIAG(hkl_geometry_set_values_v(g, HKL_UNIT_DEFAULT, NULL,
+					      1000 * h + HKL_EPSILON / 4, -M_PI));
+	hkl_geometry_list_add(list, g);
+	res &= DIAG(101 == hkl_geometry_list_n_items_get(list));
+
+	/* the index follows the removed items */
+	hkl_geometry_list_remove_invalid(list);
+	hkl_geometry_list_add(list, g);
+	res &= DIAG(101 == hkl_geometry_list_n_items_get(list));
+
+	ok(res, __func__);
+
+	hkl_geometry_list_free(list);
+	hkl_geometry_free(g);
+}
+
+static void list_arena(void)
+{
+	int i;
+	int res = TRUE;
+	HklGeometry *g;
+	HklGeometry *other;
+	HklGeometryList *list;
+	HklGeometryList *copy;
+	const HklGeometryListItem *item;
+	const HklGeometryListItem *first;
+	HklHolder *holder;
+
+	g = hkl_geometry_new(NULL);
+	holder = hkl_geometry_add_holder(g);
+	hkl_holder_add_rotation_axis(holder, "A", 1., 0., 0.);
+	hkl_holder_add_rotation_axis(holder, "B", 0., 1., 0.);
+
+	other = hkl_geometry_new(NULL);
+	holder = hkl_geometry_add_holder(other);
+	hkl_holder_add_rotation_axis(holder, "A", 1., 0., 0.);
+
+	/* more items than the first chunk */
+	list = hkl_geometry_list_new();
+	for(i=0; i<20; ++i){
+		res &= DIAG(hkl_geometry_set_values_v(g, HKL_UNIT_DEFAULT, NULL,
+						      i * HKL_DEGTORAD, 1.));
+		hkl_geometry_list_add(list, g);
+	}
+	/* a geometry with an other shape is also accepted */
+	hkl_geometry_list_append(list, other);
+	res &= DIAG(21 == hkl_geometry_list_n_items_get(list));
+
+	copy = hkl_geometry_list_new_copy(list);
+	res &= DIAG(21 == hkl_geometry_list_n_items_get(copy));
+	i = 0;
+	HKL_GEOMETRY_LIST_FOREACH(item, copy){
+		if(i < 20){
+			res &= DIAG(fabs(i * HKL_DEGTORAD - darray_item(item->geometry->axes, 0)->_value) < HKL_EPSILON);
+			res &= DIAG(item->geometry->holders.item[0]->geometry == item->geometry);
+		}
+		++i;
+	}
+
+	/* the slots are recycled after a reset */
+	first = hkl_geometry_list_items_first_get(list);
+	hkl_geometry_list_reset(list);
+	hkl_geometry_list_add(list, g);
+	item = hkl_geometry_list_items_first_get(list);
+	res &= DIAG(first == item);
+	hkl_geometry_update(g);
+	hkl_geometry_update(item->geometry);
+	res &= DIAG(TRUE == hkl_quaternion_cmp(&darray_item(g->holders, 0)->q,
+					       &darray_item(item->geometry->holders, 0)->q));
+
+	ok(res, __func__);
+
+	hkl_geometry_list_free(copy);
+	hkl_geometry_list_free(list);
+	hkl_geometry_free(other);
+	hkl_geometry_free(g);
+}
+
 static void  list_multiply_from_range(void)
 {
 	int res = TRUE;
@@ -397,12 +760,135 @@ static void  list_multiply_from_range(void)
 					      185. * HKL_DEGTORAD, -185. * HKL_DEGTORAD, 190. * HKL_DEGTORAD));
 	hkl_geometry_list_add(list, g);
 
-	hkl_geometry_list_multiply_from_range(list);
+	hkl_geometry_list_multiply_from_range(list, g);
+
+	ok(res, __func__);
+
+	hkl_geometry_free(g);
+	hkl_geometry_list_free(list);
+}
+
+static void  list_variants(void)
+{
+	int res = TRUE;
+	HklGeometry *g;
+	HklGeometryList *list;
+	HklGeometryList *lazy;
+	HklGeometryVariants *variants;
+	const HklGeometry *variant;
+	const HklGeometryListItem *item;
+	HklHolder *holder;
+	HklParameter **axis;
+	double distance = 0.;
+	size_t n;
+
+	g = hkl_geometry_new(NULL);
+	holder = hkl_geometry_add_holder(g);
+	hkl_holder_add_rotation_axis(holder, "A", 1., 0., 0.);
+	hkl_holder_add_rotation_axis(holder, "B", 1., 0., 0.);
+	hkl_holder_add_rotation_axis(holder, "C", 1., 0., 0.);
+
+	darray_foreach(axis, g->axes){
+		res &= DIAG(hkl_parameter_min_max_set(*axis, -190, 190, HKL_UNIT_USER, NULL));
+	}
+	res &= DIAG(hkl_geometry_set_values_v(g, HKL_UNIT_DEFAULT, NULL,
+					      185. * HKL_DEGTORAD, -185. * HKL_DEGTORAD, 190. * HKL_DEGTORAD));
+
+	/* the eager multiplication */
+	list = hkl_geometry_list_new();
+	hkl_geometry_list_add(list, g);
+	hkl_geometry_list_multiply_from_range(list, g);
+	hkl_geometry_list_remove_invalid(list);
+
+	/* the lazy one keeps only one variant in range */
+	lazy = hkl_geometry_list_new();
+	lazy->variants_lazy = TRUE;
+	hkl_geometry_list_add(lazy, g);
+	hkl_geometry_list_multiply_from_range(lazy, g);
+	hkl_geometry_list_remove_invalid(lazy);
+	res &= DIAG(1 == hkl_geometry_list_n_items_get(lazy));
+
+	/* and enumerate the same variants closest first */
+	item = hkl_geometry_list_items_first_get(lazy);
+	variants = hkl_geometry_variants_new(item->geometry, g);
+	res &= DIAG(hkl_geometry_list_n_items_get(list) == hkl_geometry_variants_n_get(variants));
+	n = 0;
+	while((variant = hkl_geometry_variants_next(variants))){
+		const HklGeometryListItem *found = NULL;
+		const double d = hkl_geometry_distance(variant, g);
+
+		res &= DIAG(hkl_geometry_is_valid_range(variant));
+		res &= DIAG(d >= distance);
+		distance = d;
+
+		HKL_GEOMETRY_LIST_FOREACH(item, list){
+			if(hkl_geometry_distance(variant, item->geometry) < HKL_EPSILON)
+				found = item;
+		}
+		res &= DIAG(NULL != found);
+		++n;
+	}
+	res &= DIAG(n == hkl_geometry_variants_n_get(variants));
 
 	ok(res, __func__);
 
+	hkl_geometry_variants_free(variants);
+	hkl_geometry_list_free(lazy);
+	hkl_geometry_list_free(list);
 	hkl_geometry_free(g);
+}
+
+static void  list_variants_lazy_first(void)
+{
+	int res = TRUE;
+	HklGeometry *g;
+	HklGeometry *ref;
+	HklGeometryList *list;
+	HklGeometryList *lazy;
+	HklHolder *holder;
+	HklParameter **axis;
+
+	g = hkl_geometry_new(NULL);
+	holder = hkl_geometry_add_holder(g);
+	hkl_holder_add_rotation_axis(holder, "A", 1., 0., 0.);
+	hkl_holder_add_rotation_axis(holder, "B", 1., 0., 0.);
+	hkl_holder_add_rotation_axis(holder, "C", 1., 0., 0.);
+
+	darray_foreach(axis, g->axes){
+		res &= DIAG(hkl_parameter_min_max_set(*axis, -190, 190, HKL_UNIT_USER, NULL));
+	}
+
+	/* the smallest variants in range are not the closest ones */
+	ref = hkl_geometry_new_copy(g);
+	res &= DIAG(hkl_geometry_set_values_v(ref, HKL_UNIT_DEFAULT, NULL,
+					      -170. * HKL_DEGTORAD, 170. * HKL_DEGTORAD, -170. * HKL_DEGTORAD));
+	res &= DIAG(hkl_geometry_set_values_v(g, HKL_UNIT_DEFAULT, NULL,
+					      185. * HKL_DEGTORAD, -185. * HKL_DEGTORAD, 190. * HKL_DEGTORAD));
+
+	list = hkl_geometry_list_new();
+	hkl_geometry_list_add(list, g);
+	hkl_geometry_list_multiply_from_range(list, ref);
+	hkl_geometry_list_remove_invalid(list);
+	hkl_geometry_list_sort(list, ref);
+
+	lazy = hkl_geometry_list_new();
+	lazy->variants_lazy = TRUE;
+	hkl_geometry_list_add(lazy, g);
+	hkl_geometry_list_multiply_from_range(lazy, ref);
+	hkl_geometry_list_remove_invalid(lazy);
+	hkl_geometry_list_sort(lazy, ref);
+
+	/* the first solutions of the eager and of the lazy lists are the same */
+	res &= DIAG(1 == hkl_geometry_list_n_items_get(lazy));
+	res &= DIAG(hkl_geometry_distance(hkl_geometry_list_items_first_get(list)->geometry,
+					  hkl_geometry_list_items_first_get(lazy)->geometry) < HKL_EPSILON);
+
+	ok(res, __func__);
+
+	hkl_geometry_list_free(lazy);
 	hkl_geometry_list_free(list);
+	hkl_geometry_free(ref);
+	hkl_geometry_free(g);
 }
 
 static void  list_remove_invalid(void)
@@ -459,20 +945,29 @@ static void  list_remove_invalid(void)
 
 int main(void)
 {
-	plan(51);
+	plan(72);
 
 	add_holder();
 	get_axis();
 	update();
+	update_partial();
+	axis_v_lab();
 	set();
+	new_copy();
 	axis_values_get_set();
 	distance();
 	is_valid();
 	wavelength();
 	xxx_rotation_get();
 
+	move_time();
 	list();
+	list_sort_max();
+	list_hash();
+	list_arena();
 	list_multiply_from_range();
+	list_variants();
+	list_variants_lazy_first();
 	list_remove_invalid();
 
 	return 0;
@@ -24,6 +24,11 @@
 #include <tap/float.h>
 #include <tap/hkl-tap.h>
 
+#include <string.h>
+
+#include "hkl-lattice-private.h" /* we will check also the private API */
+#include "hkl-matrix-private.h"
+
 #define CHECK_PARAM(_lattice, _param, _value)				\
 	is_double((_value),						\
 		  hkl_parameter_value_get(hkl_lattice_## _param ##_get(_lattice), \
@@ -345,9 +350,40 @@ static void get_1_B(void)
 	hkl_matrix_free(I_ref);
 }
 
+static void compute_B_derivatives(void)
+{
+	static const double values[6] = {1.3, 2.1, 3.7, 1.4, 1.7, 1.9};
+	const double h = 1e-6;
+	HklMatrix B, dB[6];
+	size_t k, i, j;
+
+	ok(TRUE == hkl_lattice_compute_B(values, &B, dB), __func__);
+
+	/* compare with the central finite differences */
+	for(k=0; k<6; ++k){
+		double plus[6], minus[6];
+		HklMatrix B_plus, B_minus;
+		int res;
+
+		memcpy(plus, values, sizeof(values));
+		memcpy(minus, values, sizeof(values));
+		plus[k] += h;
+		minus[k] -= h;
+		res = hkl_lattice_compute_B(plus, &B_plus, NULL);
+		res &= hkl_lattice_compute_B(minus, &B_minus, NULL);
+		for(i=0; i<3; ++i)
+			for(j=0; j<3; ++j){
+				double num = (B_plus.data[i][j] - B_minus.data[i][j]) / (2 * h);
+
+				res &= fabs(num - dB[k].data[i][j]) < HKL_EPSILON;
+			}
+		ok(TRUE == res, __func__);
+	}
+}
+
 int main(void)
 {
-	plan(139);
+	plan(146);
 
 	new();
 	new_copy();
@@ -356,6 +392,7 @@ int main(void)
 	volume();
 	get_B();
 	get_1_B();
+	compute_B_derivatives();
 
 	return 0;
 }
@@ -90,6 +90,36 @@ static void init_from_euler(void)
 	ok(TRUE == hkl_matrix_cmp(&m_ref, &m), __func__);
 }
 
+static void init_from_euler_derivatives(void)
+{
+	static const double euler[3] = {.3, -.7, 1.1};
+	const double h = 1e-6;
+	HklMatrix dm[3];
+	size_t k, i, j;
+
+	hkl_matrix_init_from_euler_derivatives(dm, euler[0], euler[1], euler[2]);
+
+	/* compare with the central finite differences */
+	for(k=0; k<3; ++k){
+		double plus[3] = {euler[0], euler[1], euler[2]};
+		double minus[3] = {euler[0], euler[1], euler[2]};
+		HklMatrix m_plus, m_minus;
+		int res = TRUE;
+
+		plus[k] += h;
+		minus[k] -= h;
+		hkl_matrix_init_from_euler(&m_plus, plus[0], plus[1], plus[2]);
+		hkl_matrix_init_from_euler(&m_minus, minus[0], minus[1], minus[2]);
+		for(i=0; i<3; ++i)
+			for(j=0; j<3; ++j){
+				double num = (m_plus.data[i][j] - m_minus.data[i][j]) / (2 * h);
+
+				res &= fabs(num - dm[k].data[i][j]) < HKL_EPSILON;
+			}
+		ok(TRUE == res, __func__);
+	}
+}
+
 static void init_from_two_vector(void)
 {
 	HklVector v1 = {{0.0, 1.0, 2.0}};
@@ -151,13 +181,14 @@ static void transpose(void)
 
 int main(void)
 {
-	plan(18);
+	plan(21);
 
 	init();
 	cmp();
 	dup();
 	assignement();
 	init_from_euler();
+	init_from_euler_derivatives();
 	init_from_two_vector();
 	times_vector();
 	times_matrix();
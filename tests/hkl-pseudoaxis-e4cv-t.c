@@ -20,6 +20,11 @@
  * Authors: Picca Frédéric-Emmanuel <picca@synchrotron-soleil.fr>
  */
 #include "hkl.h"
+#include <math.h>                       // for fabs
+#include <stdlib.h>                     // for free
+#include <string.h>                     // for memcpy
+#include "hkl-pseudoaxis-auto-private.h" /* temporary */
+#undef ARRAY_SIZE /* the tap one */
 #include <tap/basic.h>
 #include <tap/hkl-tap.h>
 
@@ -364,9 +369,827 @@ static void hkl_psi_constant_vertical(void)
 	hkl_geometry_free(geometry);
 }
 
+static void trajectory(void)
+{
+	int res = TRUE;
+	HklEngineList *engines;
+	HklEngine *engine;
+	const HklFactory *factory;
+	HklGeometry *geometry;
+	HklGeometryList **branches;
+	HklDetector *detector;
+	HklSample *sample;
+	size_t n_branches;
+	size_t i, j;
+	double values[11][3];
+
+	factory = hkl_factory_get_by_name("E4CV", NULL);
+	geometry = hkl_factory_create_new_geometry(factory);
+	sample = hkl_sample_new("test");
+
+	detector = hkl_detector_factory_new(HKL_DETECTOR_TYPE_0D);
+
+	engines = hkl_factory_create_new_engine_list(factory);
+	hkl_engine_list_init(engines, geometry, detector, sample);
+
+	engine = hkl_engine_list_engine_get_by_name(engines, "hkl", NULL);
+	res &= DIAG(hkl_engine_current_mode_set(engine, "bissector", NULL));
+
+	/* 0 0 0.5 -> 0 0 1.5 */
+	for(i=0; i<ARRAY_SIZE(values); ++i){
+		values[i][0] = 0;
+		values[i][1] = 0;
+		values[i][2] = 0.5 + i * .1;
+	}
+
+	branches = hkl_engine_pseudo_axis_values_set_trajectory(engine, &values[0][0], 3,
+								ARRAY_SIZE(values),
+								HKL_UNIT_DEFAULT,
+								&n_branches, NULL);
+	res &= DIAG(NULL != branches);
+	res &= DIAG(n_branches > 0);
+	for(j=0; j<n_branches; ++j){
+		const HklGeometryListItem *item;
+		double previous[4];
+
+		res &= DIAG(ARRAY_SIZE(values) == hkl_geometry_list_n_items_get(branches[j]));
+		i = 0;
+		HKL_GEOMETRY_LIST_FOREACH(item, branches[j]){
+			double current[4];
+			size_t k;
+
+			hkl_geometry_set(geometry,
+					 hkl_geometry_list_item_geometry_get(item));
+			res &= DIAG(check_pseudoaxes(engine, values[i], 3));
+
+			/* the branch must be continuous */
+			hkl_geometry_axis_values_get(geometry, current, 4, HKL_UNIT_DEFAULT);
+			if(i > 0)
+				for(k=0; k<4; ++k){
+					double delta = fmod(fabs(current[k] - previous[k]), 2 * M_PI);
+
+					if(delta > M_PI)
+						delta = 2 * M_PI - delta;
+					res &= DIAG(delta < 10 * HKL_DEGTORAD);
+				}
+			memcpy(previous, current, sizeof(current));
+			++i;
+		}
+		hkl_geometry_list_free(branches[j]);
+	}
+	free(branches);
+
+	ok(res == TRUE, "trajectory");
+
+	hkl_engine_list_free(engines);
+	hkl_detector_free(detector);
+	hkl_sample_free(sample);
+	hkl_geometry_free(geometry);
+}
+
+static void batch(void)
+{
+	int res = TRUE;
+	HklEngineList *engines;
+	HklEngine *engine;
+	const HklFactory *factory;
+	HklGeometry *geometry;
+	HklGeometry *start;
+	HklGeometryList **results;
+	HklDetector *detector;
+	HklSample *sample;
+	size_t i;
+	static double hkl2[] = {1, 1, 0};
+	double values[8][3];
+
+	factory = hkl_factory_get_by_name("E4CV", NULL);
+	geometry = hkl_factory_create_new_geometry(factory);
+	sample = hkl_sample_new("test");
+
+	detector = hkl_detector_factory_new(HKL_DETECTOR_TYPE_0D);
+
+	engines = hkl_factory_create_new_engine_list(factory);
+	hkl_engine_list_init(engines, geometry, detector, sample);
+
+	engine = hkl_engine_list_engine_get_by_name(engines, "hkl", NULL);
+
+	/* an initialized mode, the workers must share its state */
+	res &= DIAG(hkl_engine_current_mode_set(engine, "psi_constant", NULL));
+	res &= DIAG(hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 30., 0., 0., 60.));
+	res &= DIAG(hkl_engine_parameters_values_set(engine, hkl2, ARRAY_SIZE(hkl2), HKL_UNIT_DEFAULT, NULL));
+	res &= DIAG(hkl_engine_initialized_set(engine, TRUE, NULL));
+	start = hkl_geometry_new_copy(geometry);
+
+	/* 1 0 0.5 -> 1 0 1.2 */
+	for(i=0; i<ARRAY_SIZE(values); ++i){
+		values[i][0] = 1;
+		values[i][1] = 0;
+		values[i][2] = 0.5 + i * .1;
+	}
+
+	results = hkl_engine_pseudo_axis_values_set_batch(engine, &values[0][0], 3,
+							  ARRAY_SIZE(values),
+							  HKL_UNIT_DEFAULT,
+							  3, NULL);
+	res &= DIAG(NULL != results);
+	for(i=0; results && i<ARRAY_SIZE(values); ++i){
+		HklGeometryList *geometries;
+		const HklGeometryListItem *item;
+
+		/* same solutions than the sequential computation */
+		hkl_geometry_set(geometry, start);
+		geometries = hkl_engine_pseudo_axis_values_set(engine, values[i], 3,
+							       HKL_UNIT_DEFAULT, NULL);
+		res &= DIAG((NULL == geometries) == (NULL == results[i]));
+		if(geometries && results[i]){
+			res &= DIAG(hkl_geometry_list_n_items_get(geometries)
+				    == hkl_geometry_list_n_items_get(results[i]));
+			HKL_GEOMETRY_LIST_FOREACH(item, results[i]){
+				hkl_geometry_set(geometry,
+						 hkl_geometry_list_item_geometry_get(item));
+				res &= DIAG(check_pseudoaxes(engine, values[i], 3));
+			}
+		}
+		if(geometries)
+			hkl_geometry_list_free(geometries);
+		if(results[i])
+			hkl_geometry_list_free(results[i]);
+	}
+	free(results);
+	hkl_geometry_free(start);
+
+	ok(res == TRUE, "batch");
+
+	hkl_engine_list_free(engines);
+	hkl_detector_free(detector);
+	hkl_sample_free(sample);
+	hkl_geometry_free(geometry);
+}
+
+static void batch_get(void)
+{
+	int res = TRUE;
+	HklEngineList *engines;
+	HklEngine *engine;
+	const HklFactory *factory;
+	HklGeometry *geometry;
+	HklDetector *detector;
+	HklSample *sample;
+	size_t i, j;
+	const size_t n = 2500;
+	double *axes;
+	double *values;
+
+	factory = hkl_factory_get_by_name("E4CV", NULL);
+	geometry = hkl_factory_create_new_geometry(factory);
+	sample = hkl_sample_new("test");
+
+	detector = hkl_detector_factory_new(HKL_DETECTOR_TYPE_0D);
+
+	engines = hkl_factory_create_new_engine_list(factory);
+	hkl_engine_list_init(engines, geometry, detector, sample);
+
+	engine = hkl_engine_list_engine_get_by_name(engines, "hkl", NULL);
+
+	/* a scan of omega and tth, one axis after the other */
+	axes = malloc(4 * n * sizeof(*axes));
+	values = malloc(3 * n * sizeof(*values));
+	for(i=0; i<n; ++i){
+		axes[0 * n + i] = 10. + i * 0.01;
+		axes[1 * n + i] = 5.;
+		axes[2 * n + i] = 3.;
+		axes[3 * n + i] = 20. + i * 0.02;
+	}
+
+	res &= DIAG(FALSE == hkl_engine_pseudo_axis_values_get_batch(engine, axes, 3, n,
+								    values, 3,
+								    HKL_UNIT_USER, 3, NULL));
+	res &= DIAG(hkl_engine_pseudo_axis_values_get_batch(engine, axes, 4, n,
+							    values, 3,
+							    HKL_UNIT_USER, 3, NULL));
+
+	/* same values than the sequential computation */
+	for(i=0; i<n; i+=97){
+		double refs[3];
+
+		res &= DIAG(hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL,
+						      axes[0 * n + i], axes[1 * n + i],
+						      axes[2 * n + i], axes[3 * n + i]));
+		res &= DIAG(hkl_engine_pseudo_axis_values_get(engine, refs, 3,
+							      HKL_UNIT_USER, NULL));
+		for(j=0; j<3; ++j)
+			res &= DIAG(fabs(refs[j] - values[j * n + i]) < HKL_EPSILON);
+	}
+
+	ok(res == TRUE, "batch get");
+
+	free(values);
+	free(axes);
+	hkl_engine_list_free(engines);
+	hkl_detector_free(detector);
+	hkl_sample_free(sample);
+	hkl_geometry_free(geometry);
+}
+
+static void reachable_reflections(void)
+{
+	int res = TRUE;
+	HklEngineList *engines;
+	HklEngine *engine;
+	const HklFactory *factory;
+	HklGeometry *geometry;
+	HklGeometry **geometries;
+	HklDetector *detector;
+	HklSample *sample;
+	double *hkl;
+	size_t i, n, n_bissector;
+	double norm = 0.;
+
+	factory = hkl_factory_get_by_name("E4CV", NULL);
+	geometry = hkl_factory_create_new_geometry(factory);
+	sample = hkl_sample_new("test");
+
+	detector = hkl_detector_factory_new(HKL_DETECTOR_TYPE_0D);
+
+	engines = hkl_factory_create_new_engine_list(factory);
+	hkl_engine_list_init(engines, geometry, detector, sample);
+
+	/* only for the hkl engine */
+	engine = hkl_engine_list_engine_get_by_name(engines, "psi", NULL);
+	res &= DIAG(NULL == hkl_engine_reachable_reflections(engine, 0., NULL,
+							      &hkl, &n, 3, NULL));
+
+	engine = hkl_engine_list_engine_get_by_name(engines, "hkl", NULL);
+	res &= DIAG(NULL == hkl_engine_reachable_reflections(engine, 0., "unknown",
+							      &hkl, &n, 3, NULL));
+
+	/* the six 1 0 0 of the default cubic lattice */
+	geometries = hkl_engine_reachable_reflections(engine, 1.01 * HKL_TAU / 1.54, NULL,
+						      &hkl, &n, 3, NULL);
+	res &= DIAG(NULL != geometries);
+	res &= DIAG(6 == n);
+	for(i=0; i<n; ++i){
+		res &= DIAG(fabs(fabs(hkl[3 * i]) + fabs(hkl[3 * i + 1]) + fabs(hkl[3 * i + 2]) - 1) < HKL_EPSILON);
+		hkl_geometry_free(geometries[i]);
+	}
+	free(geometries);
+	free(hkl);
+
+	/* all the reflections inside the limiting sphere, |hkl|^2 <= 4 */
+	geometries = hkl_engine_reachable_reflections(engine, 0., "bissector",
+						      &hkl, &n, 3, NULL);
+	res &= DIAG(NULL != geometries);
+	res &= DIAG(n >= 6 && n <= 32);
+	for(i=0; i<n; ++i){
+		double n2 = hkl[3 * i] * hkl[3 * i]
+			+ hkl[3 * i + 1] * hkl[3 * i + 1]
+			+ hkl[3 * i + 2] * hkl[3 * i + 2];
+
+		/* sorted by |Q| and reached by the first solution */
+		res &= DIAG(n2 >= norm && n2 <= 4 + HKL_EPSILON);
+		norm = n2;
+		hkl_geometry_set(geometry, geometries[i]);
+		res &= DIAG(check_pseudoaxes(engine, &hkl[3 * i], 3));
+		hkl_geometry_free(geometries[i]);
+	}
+	free(geometries);
+	free(hkl);
+	n_bissector = n;
+
+	/* bissector is the default mode */
+	geometries = hkl_engine_reachable_reflections(engine, 0., NULL,
+						      &hkl, &n, 0, NULL);
+	res &= DIAG(n_bissector == n);
+	for(i=0; i<n; ++i)
+		hkl_geometry_free(geometries[i]);
+	free(geometries);
+	free(hkl);
+
+	ok(res == TRUE, "reachable reflections");
+
+	hkl_engine_list_free(engines);
+	hkl_detector_free(detector);
+	hkl_sample_free(sample);
+	hkl_geometry_free(geometry);
+}
+
+static void random_seed(void)
+{
+	int res = TRUE;
+	HklEngineList *engines;
+	HklEngine *engine;
+	const HklFactory *factory;
+	HklGeometry *geometry;
+	HklGeometry *start;
+	HklGeometryList *geometries[2];
+	HklDetector *detector;
+	HklSample *sample;
+	HklModeAutoWorkspace *ws;
+	size_t i;
+	static double hkl[] = {1, 0, 1};
+
+	factory = hkl_factory_get_by_name("E4CV", NULL);
+	geometry = hkl_factory_create_new_geometry(factory);
+	sample = hkl_sample_new("test");
+
+	detector = hkl_detector_factory_new(HKL_DETECTOR_TYPE_0D);
+
+	engines = hkl_factory_create_new_engine_list(factory);
+	hkl_engine_list_init(engines, geometry, detector, sample);
+
+	/* with chi at zero omega and phi are parallel, this mode is
+	 * then solved numerically */
+	engine = hkl_engine_list_engine_get_by_name(engines, "hkl", NULL);
+	res &= DIAG(hkl_engine_current_mode_set(engine, "constant_chi", NULL));
+
+	/* start far from the solutions to trigger the restarts */
+	res &= DIAG(hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 0., 0., 0., 0.));
+	start = hkl_geometry_new_copy(geometry);
+
+	/* the same seed gives the same solutions */
+	for(i=0; i<ARRAY_SIZE(geometries); ++i){
+		hkl_geometry_set(geometry, start);
+		hkl_engine_random_seed_set(engine, 42);
+		geometries[i] = hkl_engine_pseudo_axis_values_set(engine, hkl, ARRAY_SIZE(hkl),
+								  HKL_UNIT_DEFAULT, NULL);
+		res &= DIAG(NULL != geometries[i]);
+	}
+
+	/* the numerical solver did run */
+	ws = hkl_mode_auto_workspace_get(engine->mode);
+	res &= DIAG(NULL != ws->fdfsolver || NULL != ws->fsolvers[ws->len - 1]);
+
+	if(geometries[0] && geometries[1]){
+		const HklGeometryListItem *item0;
+		const HklGeometryListItem *item1;
+		double v0[4];
+		double v1[4];
+		size_t k;
+
+		res &= DIAG(hkl_geometry_list_n_items_get(geometries[0])
+			    == hkl_geometry_list_n_items_get(geometries[1]));
+
+		item0 = hkl_geometry_list_items_first_get(geometries[0]);
+		item1 = hkl_geometry_list_items_first_get(geometries[1]);
+		hkl_geometry_axis_values_get(hkl_geometry_list_item_geometry_get(item0),
+					     v0, 4, HKL_UNIT_DEFAULT);
+		hkl_geometry_axis_values_get(hkl_geometry_list_item_geometry_get(item1),
+					     v1, 4, HKL_UNIT_DEFAULT);
+		for(k=0; k<4; ++k)
+			res &= DIAG(v0[k] == v1[k]);
+	}
+
+	for(i=0; i<ARRAY_SIZE(geometries); ++i)
+		if(geometries[i])
+			hkl_geometry_list_free(geometries[i]);
+
+	ok(res == TRUE, "random seed");
+
+	hkl_engine_list_free(engines);
+	hkl_detector_free(detector);
+	hkl_sample_free(sample);
+	hkl_geometry_free(geometry);
+	hkl_geometry_free(start);
+}
+
+static void parallel_starts(void)
+{
+	int res = TRUE;
+	HklEngineList *engines;
+	HklEngine *engine;
+	const HklFactory *factory;
+	HklGeometry *geometry;
+	HklGeometry *start;
+	HklGeometryList *geometries[2];
+	HklDetector *detector;
+	HklSample *sample;
+	GError *error = NULL;
+	size_t i;
+	static const int n_starts[] = {1, 4};
+	static double hkl[] = {1, 0, 1};
+	static double unreachable[] = {10, 10, 10};
+
+	factory = hkl_factory_get_by_name("E4CV", NULL);
+	geometry = hkl_factory_create_new_geometry(factory);
+	sample = hkl_sample_new("test");
+
+	detector = hkl_detector_factory_new(HKL_DETECTOR_TYPE_0D);
+
+	engines = hkl_factory_create_new_engine_list(factory);
+	hkl_engine_list_init(engines, geometry, detector, sample);
+
+	/* with chi at zero omega and phi are parallel, this mode is
+	 * then solved numerically */
+	engine = hkl_engine_list_engine_get_by_name(engines, "hkl", NULL);
+	res &= DIAG(hkl_engine_current_mode_set(engine, "constant_chi", NULL));
+
+	/* start far from the solutions to trigger the restarts */
+	res &= DIAG(hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 0., 0., 0., 0.));
+	start = hkl_geometry_new_copy(geometry);
+
+	/* the racing restarts find the same solutions than the serial ones */
+	for(i=0; i<ARRAY_SIZE(geometries); ++i){
+		hkl_geometry_set(geometry, start);
+		hkl_engine_random_seed_set(engine, 42);
+		hkl_engine_parallel_starts_set(engine, n_starts[i]);
+		geometries[i] = hkl_engine_pseudo_axis_values_set(engine, hkl, ARRAY_SIZE(hkl),
+								  HKL_UNIT_DEFAULT, NULL);
+		res &= DIAG(NULL != geometries[i]);
+	}
+
+	/* the restarts did race */
+	res &= DIAG(NULL != hkl_mode_auto_workspace_get(engine->mode)->race_workers);
+
+	if(geometries[0] && geometries[1]){
+		const HklGeometryListItem *item;
+
+		const HklGeometry *first[2];
+
+		for(i=0; i<ARRAY_SIZE(first); ++i)
+			first[i] = hkl_geometry_list_item_geometry_get(hkl_geometry_list_items_first_get(geometries[i]));
+		res &= DIAG(hkl_geometry_distance(first[0], first[1]) < HKL_EPSILON);
+		res &= DIAG(check_geometry_lists(geometries[0], geometries[1]));
+
+		HKL_GEOMETRY_LIST_FOREACH(item, geometries[1]){
+			hkl_geometry_set(geometry,
+					 hkl_geometry_list_item_geometry_get(item));
+			res &= DIAG(check_pseudoaxes(engine, hkl, ARRAY_SIZE(hkl)));
+		}
+	}
+
+	for(i=0; i<ARRAY_SIZE(geometries); ++i)
+		if(geometries[i])
+			hkl_geometry_list_free(geometries[i]);
+
+	/* all the racing restarts fail on an unreachable hkl */
+	hkl_geometry_set(geometry, start);
+	geometries[0] = hkl_engine_pseudo_axis_values_set(engine, unreachable, ARRAY_SIZE(unreachable),
+							  HKL_UNIT_DEFAULT, &error);
+	res &= DIAG(NULL == geometries[0]);
+	res &= DIAG(NULL != error);
+	g_clear_error(&error);
+	if(geometries[0])
+		hkl_geometry_list_free(geometries[0]);
+
+	ok(res == TRUE, "parallel starts");
+
+	hkl_engine_list_free(engines);
+	hkl_detector_free(detector);
+	hkl_sample_free(sample);
+	hkl_geometry_free(geometry);
+	hkl_geometry_free(start);
+}
+
+static void analytic(void)
+{
+	int res = TRUE;
+	HklEngineList *engines;
+	HklEngine *engine;
+	const HklFactory *factory;
+	HklGeometry *geometry;
+	HklGeometry *start;
+	HklDetector *detector;
+	HklSample *sample;
+	size_t i, j;
+	static const char *modes[] = {"bissector", "constant_omega", "constant_chi", "constant_phi"};
+	static double hkls[][3] = {{1, 0, 0}, {0, 1, 1}, {1, 1, 1}, {-1, 0, 1}};
+
+	factory = hkl_factory_get_by_name("E4CV", NULL);
+	geometry = hkl_factory_create_new_geometry(factory);
+	sample = hkl_sample_new("test");
+
+	detector = hkl_detector_factory_new(HKL_DETECTOR_TYPE_0D);
+
+	engines = hkl_factory_create_new_engine_list(factory);
+	hkl_engine_list_init(engines, geometry, detector, sample);
+
+	engine = hkl_engine_list_engine_get_by_name(engines, "hkl", NULL);
+
+	res &= DIAG(hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 30., 10., 20., 60.));
+	start = hkl_geometry_new_copy(geometry);
+
+	for(i=0; i<ARRAY_SIZE(modes); ++i){
+		res &= DIAG(hkl_engine_current_mode_set(engine, modes[i], NULL));
+		for(j=0; j<ARRAY_SIZE(hkls); ++j){
+			HklGeometryList *geometries;
+
+			hkl_geometry_set(geometry, start);
+			geometries = hkl_engine_pseudo_axis_values_set(engine, hkls[j], ARRAY_SIZE(hkls[j]),
+								       HKL_UNIT_DEFAULT, NULL);
+			/* the bissector mode can reach all the hkl */
+			if(i == 0)
+				res &= DIAG(NULL != geometries);
+			if(geometries){
+				const HklGeometryListItem *item;
+
+				HKL_GEOMETRY_LIST_FOREACH(item, geometries){
+					double v[4];
+
+					hkl_geometry_set(geometry,
+							 hkl_geometry_list_item_geometry_get(item));
+					res &= DIAG(check_pseudoaxes(engine, hkls[j], ARRAY_SIZE(hkls[j])));
+
+					/* the frozen axes did not move, the bissector
+					 * solutions are only checked on their pseudo
+					 * axes, omega = tth / 2 + pi is also valid */
+					hkl_geometry_axis_values_get(geometry, v, ARRAY_SIZE(v), HKL_UNIT_USER);
+					switch(i){
+					case 1:
+						res &= DIAG(fabs(v[0] - 30.) < HKL_EPSILON);
+						break;
+					case 2:
+						res &= DIAG(fabs(v[1] - 10.) < HKL_EPSILON);
+						break;
+					case 3:
+						res &= DIAG(fabs(v[2] - 20.) < HKL_EPSILON);
+						break;
+					}
+				}
+				hkl_geometry_list_free(geometries);
+			}
+		}
+	}
+
+	ok(res == TRUE, "analytic");
+
+	hkl_engine_list_free(engines);
+	hkl_detector_free(detector);
+	hkl_sample_free(sample);
+	hkl_geometry_free(geometry);
+	hkl_geometry_free(start);
+}
+
+/* the memory of an auto mode workspace */
+struct workspace_memory {
+	const HklModeAutoWorkspace *ws;
+	HklModeAutoWorkspace fields;
+	gsl_multiroot_fsolver *fsolvers[4];
+	gsl_vector *x[4];
+};
+
+static void workspace_memory_init(struct workspace_memory *self,
+				  const HklModeAutoWorkspace *ws)
+{
+	self->ws = ws;
+	memcpy(&self->fields, ws, sizeof(*ws));
+	memcpy(self->fsolvers, ws->fsolvers, ws->len * sizeof(*ws->fsolvers));
+	memcpy(self->x, ws->x, ws->len * sizeof(*ws->x));
+}
+
+/* nothing was reallocated since the memory was recorded */
+static int workspace_memory_same(const struct workspace_memory *self,
+				 const HklModeAutoWorkspace *ws)
+{
+	int res = TRUE;
+	size_t i;
+
+	res &= DIAG(self->ws == ws);
+	res &= DIAG(self->fields.fdfsolver == ws->fdfsolver);
+	res &= DIAG(self->fields._x == ws->_x);
+	res &= DIAG(self->fields._f == ws->_f);
+	res &= DIAG(self->fields.J == ws->J);
+	res &= DIAG(self->fields.axes == ws->axes);
+	res &= DIAG(self->fields.race_workers == ws->race_workers);
+	for(i=0; i<ARRAY_SIZE(ws->sectors); ++i){
+		res &= DIAG(self->fields.sectors[i].item == ws->sectors[i].item);
+		res &= DIAG(self->fields.v[i].item == ws->v[i].item);
+	}
+	for(i=0; i<ws->len; ++i){
+		res &= DIAG(self->fsolvers[i] == ws->fsolvers[i]);
+		res &= DIAG(self->x[i] == ws->x[i]);
+	}
+
+	return res;
+}
+
+static void workspace(void)
+{
+	int res = TRUE;
+	HklEngineList *engines;
+	HklEngine *engine;
+	const darray_string *modes;
+	const char **mode;
+	const HklFactory *factory;
+	HklGeometry *geometry;
+	HklGeometry *start;
+	HklDetector *detector;
+	HklSample *sample;
+	static double hkl[] = {1, 0, 1};
+
+	factory = hkl_factory_get_by_name("E4CV", NULL);
+	geometry = hkl_factory_create_new_geometry(factory);
+	sample = hkl_sample_new("test");
+
+	detector = hkl_detector_factory_new(HKL_DETECTOR_TYPE_0D);
+
+	engines = hkl_factory_create_new_engine_list(factory);
+	hkl_engine_list_init(engines, geometry, detector, sample);
+
+	engine = hkl_engine_list_engine_get_by_name(engines, "hkl", NULL);
+	modes = hkl_engine_modes_names_get(engine);
+
+	res &= DIAG(hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 30., 0., 0., 60.));
+	start = hkl_geometry_new_copy(geometry);
+
+	/* the solvers memory is reused from one set to the other */
+	darray_foreach(mode, *modes){
+		HklGeometryList *geometries[2];
+		size_t i;
+
+		struct workspace_memory memory;
+		int is_auto;
+
+		res &= DIAG(hkl_engine_current_mode_set(engine, *mode, NULL));
+		is_auto = engine->mode->ops->set_local == hkl_mode_auto_set_local_real;
+		for(i=0; i<ARRAY_SIZE(geometries); ++i){
+			hkl_geometry_set(geometry, start);
+			hkl_engine_random_seed_set(engine, 0);
+			geometries[i] = hkl_engine_pseudo_axis_values_set(engine, hkl, ARRAY_SIZE(hkl),
+									  HKL_UNIT_DEFAULT, NULL);
+
+			/* and it is not reallocated */
+			if(is_auto){
+				HklModeAutoWorkspace *ws = hkl_mode_auto_workspace_get(engine->mode);
+
+				if(i == 0){
+					is_auto = DIAG(ws->len <= ARRAY_SIZE(memory.fsolvers));
+					res &= is_auto;
+					if(is_auto)
+						workspace_memory_init(&memory, ws);
+				}else
+					res &= DIAG(workspace_memory_same(&memory, ws));
+			}
+		}
+
+		res &= DIAG((NULL == geometries[0]) == (NULL == geometries[1]));
+		if(geometries[0] && geometries[1]){
+			double v0[4];
+			double v1[4];
+			size_t k;
+
+			res &= DIAG(hkl_geometry_list_n_items_get(geometries[0])
+				    == hkl_geometry_list_n_items_get(geometries[1]));
+			hkl_geometry_axis_values_get(hkl_geometry_list_item_geometry_get(hkl_geometry_list_items_first_get(geometries[0])),
+						     v0, ARRAY_SIZE(v0), HKL_UNIT_DEFAULT);
+			hkl_geometry_axis_values_get(hkl_geometry_list_item_geometry_get(hkl_geometry_list_items_first_get(geometries[1])),
+						     v1, ARRAY_SIZE(v1), HKL_UNIT_DEFAULT);
+			for(k=0; k<ARRAY_SIZE(v0); ++k)
+				res &= DIAG(fabs(v0[k] - v1[k]) < HKL_EPSILON);
+		}
+
+		for(i=0; i<ARRAY_SIZE(geometries); ++i)
+			if(geometries[i])
+				hkl_geometry_list_free(geometries[i]);
+	}
+
+	ok(res == TRUE, "workspace");
+
+	hkl_engine_list_free(engines);
+	hkl_detector_free(detector);
+	hkl_sample_free(sample);
+	hkl_geometry_free(geometry);
+	hkl_geometry_free(start);
+}
+
+static void sample_sync(void)
+{
+	int res = TRUE;
+	HklEngineList *engines;
+	HklEngine *engine;
+	const HklFactory *factory;
+	HklGeometry *geometry;
+	HklDetector *detector;
+	HklSample *sample;
+	HklLattice *lattice;
+	size_t i;
+	static double hkl[] = {0, 0, 1};
+
+	factory = hkl_factory_get_by_name("E4CV", NULL);
+	geometry = hkl_factory_create_new_geometry(factory);
+	sample = hkl_sample_new("test");
+
+	detector = hkl_detector_factory_new(HKL_DETECTOR_TYPE_0D);
+
+	engines = hkl_factory_create_new_engine_list(factory);
+	hkl_engine_list_init(engines, geometry, detector, sample);
+
+	engine = hkl_engine_list_engine_get_by_name(engines, "hkl", NULL);
+	res &= DIAG(hkl_engine_current_mode_set(engine, "bissector", NULL));
+
+	/* the engines follow the sample changes after the init */
+	for(i=0; i<2; ++i){
+		HklGeometryList *geometries;
+		double values[4];
+
+		lattice = hkl_lattice_new(1.54 * (i + 1), 1.54 * (i + 1), 1.54 * (i + 1),
+					  90 * HKL_DEGTORAD, 90 * HKL_DEGTORAD, 90 * HKL_DEGTORAD,
+					  NULL);
+		hkl_sample_lattice_set(sample, lattice);
+		hkl_lattice_free(lattice);
+
+		geometries = hkl_engine_pseudo_axis_values_set(engine, hkl, ARRAY_SIZE(hkl),
+							       HKL_UNIT_DEFAULT, NULL);
+		res &= DIAG(NULL != geometries);
+		if(geometries){
+			hkl_geometry_set(geometry,
+					 hkl_geometry_list_item_geometry_get(hkl_geometry_list_items_first_get(geometries)));
+			res &= DIAG(check_pseudoaxes(engine, hkl, ARRAY_SIZE(hkl)));
+
+			/* with a = lambda, tth = 60 then 2 * asin(1 / 4) */
+			hkl_geometry_axis_values_get(geometry, values, ARRAY_SIZE(values), HKL_UNIT_DEFAULT);
+			res &= DIAG(fabs(fabs(values[3]) - 2 * asin(.5 / (i + 1))) < HKL_EPSILON);
+			hkl_geometry_list_free(geometries);
+		}
+	}
+
+	ok(res == TRUE, "sample sync");
+
+	hkl_engine_list_free(engines);
+	hkl_detector_free(detector);
+	hkl_sample_free(sample);
+	hkl_geometry_free(geometry);
+}
+
+static void solutions_max(void)
+{
+	int res = TRUE;
+	HklEngineList *engines;
+	HklEngine *engine;
+	const HklFactory *factory;
+	HklGeometry *geometry;
+	HklGeometryList *all;
+	HklDetector *detector;
+	HklSample *sample;
+	size_t n;
+	static double hkl[] = {0, 0, 1};
+
+	factory = hkl_factory_get_by_name("E4CV", NULL);
+	geometry = hkl_factory_create_new_geometry(factory);
+	sample = hkl_sample_new("test");
+
+	detector = hkl_detector_factory_new(HKL_DETECTOR_TYPE_0D);
+
+	engines = hkl_factory_create_new_engine_list(factory);
+	hkl_engine_list_init(engines, geometry, detector, sample);
+
+	engine = hkl_engine_list_engine_get_by_name(engines, "hkl", NULL);
+	res &= DIAG(hkl_engine_current_mode_set(engine, "bissector", NULL));
+	res &= DIAG(0 == hkl_engine_list_solutions_max_get(engines));
+
+	hkl_engine_random_seed_set(engine, 42);
+	all = hkl_engine_pseudo_axis_values_set(engine, hkl, ARRAY_SIZE(hkl),
+						HKL_UNIT_DEFAULT, NULL);
+	res &= DIAG(NULL != all);
+	if(all){
+		res &= DIAG(hkl_geometry_list_n_items_get(all) > 1);
+
+		/* only the closest solutions are kept, in the same order */
+		for(n=1; n<=2; ++n){
+			HklGeometryList *geometries;
+			const HklGeometryListItem *item;
+			const HklGeometryListItem *ref;
+
+			hkl_engine_list_solutions_max_set(engines, n);
+			res &= DIAG(n == hkl_engine_list_solutions_max_get(engines));
+
+			hkl_engine_random_seed_set(engine, 42);
+			geometries = hkl_engine_pseudo_axis_values_set(engine, hkl, ARRAY_SIZE(hkl),
+								       HKL_UNIT_DEFAULT, NULL);
+			res &= DIAG(NULL != geometries);
+			if(!geometries)
+				continue;
+
+			res &= DIAG(n == hkl_geometry_list_n_items_get(geometries));
+			ref = hkl_geometry_list_items_first_get(all);
+			HKL_GEOMETRY_LIST_FOREACH(item, geometries){
+				double values[4];
+				double refs[4];
+				size_t i;
+
+				hkl_geometry_axis_values_get(hkl_geometry_list_item_geometry_get(item),
+							     values, ARRAY_SIZE(values), HKL_UNIT_DEFAULT);
+				hkl_geometry_axis_values_get(hkl_geometry_list_item_geometry_get(ref),
+							     refs, ARRAY_SIZE(refs), HKL_UNIT_DEFAULT);
+				for(i=0; i<ARRAY_SIZE(values); ++i)
+					res &= DIAG(fabs(values[i] - refs[i]) < HKL_EPSILON);
+				ref = hkl_geometry_list_items_next_get(all, ref);
+			}
+			hkl_geometry_list_free(geometries);
+		}
+		hkl_geometry_list_free(all);
+	}
+
+	ok(res == TRUE, "solutions max");
+
+	hkl_engine_list_free(engines);
+	hkl_detector_free(detector);
+	hkl_sample_free(sample);
+	hkl_geometry_free(geometry);
+}
+
 int main(void)
 {
-	plan(6);
+	plan(16);
 
 	getter();
 	degenerated();
@@ -374,6 +1197,16 @@ int main(void)
 	psi_setter();
 	q();
 	hkl_psi_constant_vertical();
+	trajectory();
+	batch();
+	batch_get();
+	reachable_reflections();
+	random_seed();
+	parallel_starts();
+	analytic();
+	workspace();
+	sample_sync();
+	solutions_max();
 
 	return 0;
 }
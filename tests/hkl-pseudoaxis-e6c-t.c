@@ -497,15 +497,78 @@ static void petra3_2(void)
 	hkl_geometry_free(geometry);
 }
 
+static void constant_mu_horizontal(void)
+{
+	int res = TRUE;
+	HklEngineList *engines;
+	HklEngine *engine;
+	const HklFactory *factory;
+	HklGeometry *geometry;
+	HklGeometry *start;
+	HklDetector *detector;
+	HklSample *sample;
+	size_t i;
+	static double hkls[][3] = {{1, 0, 0}, {0, 1, 1}, {1, 1, 1}};
+
+	factory = hkl_factory_get_by_name("E6C", NULL);
+	geometry = hkl_factory_create_new_geometry(factory);
+	sample = hkl_sample_new("test");
+
+	detector = hkl_detector_factory_new(HKL_DETECTOR_TYPE_0D);
+
+	engines = hkl_factory_create_new_engine_list(factory);
+	hkl_engine_list_init(engines, geometry, detector, sample);
+
+	engine = hkl_engine_list_engine_get_by_name(engines, "hkl", NULL);
+	res &= DIAG(hkl_engine_current_mode_set(engine, "constant_mu_horizontal", NULL));
+
+	res &= DIAG(hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 5., 10., 20., 30., 40., 0.));
+	start = hkl_geometry_new_copy(geometry);
+
+	/* solved in closed form, mu omega and delta do not move */
+	for(i=0; i<ARRAY_SIZE(hkls); ++i){
+		HklGeometryList *geometries;
+
+		hkl_geometry_set(geometry, start);
+		geometries = hkl_engine_pseudo_axis_values_set(engine, hkls[i], ARRAY_SIZE(hkls[i]),
+							       HKL_UNIT_DEFAULT, NULL);
+		res &= DIAG(NULL != geometries);
+		if(geometries){
+			const HklGeometryListItem *item;
+
+			HKL_GEOMETRY_LIST_FOREACH(item, geometries){
+				const HklGeometry *solution = hkl_geometry_list_item_geometry_get(item);
+
+				res &= DIAG(CHECK_AXIS_VALUE(solution, "mu", 5. * HKL_DEGTORAD));
+				res &= DIAG(CHECK_AXIS_VALUE(solution, "omega", 10. * HKL_DEGTORAD));
+				res &= DIAG(CHECK_AXIS_VALUE(solution, "delta", 0.));
+
+				hkl_geometry_set(geometry, solution);
+				res &= DIAG(check_pseudoaxes(engine, hkls[i], ARRAY_SIZE(hkls[i])));
+			}
+			hkl_geometry_list_free(geometries);
+		}
+	}
+
+	ok(res == TRUE, "constant_mu_horizontal");
+
+	hkl_engine_list_free(engines);
+	hkl_detector_free(detector);
+	hkl_sample_free(sample);
+	hkl_geometry_free(geometry);
+	hkl_geometry_free(start);
+}
+
 int main(void)
 {
-	plan(5);
+	plan(6);
 
 	getter();
 	degenerated();
 	q2();
 	petra3();
 	petra3_2();
+	constant_mu_horizontal();
 
 	return 0;
 }
@@ -20,6 +20,8 @@
  * Authors: Picca Frédéric-Emmanuel <picca@synchrotron-soleil.fr>
  */
 #include "hkl.h"
+#include "hkl-pseudoaxis-auto-private.h" /* temporary */
+#undef ARRAY_SIZE /* the tap one */
 #include <tap/basic.h>
 #include <tap/hkl-tap.h>
 
@@ -274,14 +276,139 @@ static void m15110(void)
 	ok(res == TRUE, "m15110");
 }
 
+static void sectors(void)
+{
+	int res = TRUE;
+	int solved = FALSE;
+	HklEngineList *engines;
+	HklEngine *engine;
+	const darray_string *modes;
+	const char **mode;
+	const HklFactory *factory;
+	HklGeometry *geometry;
+	HklGeometry *start;
+	HklDetector *detector;
+	HklSample *sample;
+	static double hkl[] = {1, 1, 0};
+
+	factory = hkl_factory_get_by_name("K6C", NULL);
+	geometry = hkl_factory_create_new_geometry(factory);
+	sample = hkl_sample_new("test");
+
+	detector = hkl_detector_factory_new(HKL_DETECTOR_TYPE_0D);
+
+	engines = hkl_factory_create_new_engine_list(factory);
+	hkl_engine_list_init(engines, geometry, detector, sample);
+
+	engine = hkl_engine_list_engine_get_by_name(engines, "hkl", NULL);
+	modes = hkl_engine_modes_names_get(engine);
+
+	res &= DIAG(hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 1., 30., 10., 20., 2., 60.));
+	start = hkl_geometry_new_copy(geometry);
+
+	/* all the sectors of the solutions are valid */
+	darray_foreach(mode, *modes){
+		HklGeometryList *geometries;
+
+		hkl_geometry_set(geometry, start);
+		res &= DIAG(hkl_engine_current_mode_set(engine, *mode, NULL));
+		geometries = hkl_engine_pseudo_axis_values_set(engine,
+							       hkl, ARRAY_SIZE(hkl),
+							       HKL_UNIT_DEFAULT, NULL);
+		if (geometries){
+			const HklGeometryListItem *item;
+
+			solved = TRUE;
+			HKL_GEOMETRY_LIST_FOREACH(item, geometries){
+				hkl_geometry_set(geometry, hkl_geometry_list_item_geometry_get(item));
+				res &= DIAG(check_pseudoaxes(engine, hkl, ARRAY_SIZE(hkl)));
+			}
+			hkl_geometry_list_free(geometries);
+		}
+	}
+	res &= DIAG(solved);
+
+	ok(res == TRUE, "sectors");
+
+	hkl_engine_list_free(engines);
+	hkl_detector_free(detector);
+	hkl_sample_free(sample);
+	hkl_geometry_free(geometry);
+	hkl_geometry_free(start);
+}
+
+static void sectors_perm_r(void)
+{
+	int res = TRUE;
+	HklEngineList *engines;
+	HklEngine *engine;
+	const darray_string *modes;
+	const char **mode;
+	const HklFactory *factory;
+	HklGeometry *geometry;
+	HklGeometry *start;
+	HklDetector *detector;
+	HklSample *sample;
+	static double hkl[] = {1, 1, 0};
+
+	factory = hkl_factory_get_by_name("K6C", NULL);
+	geometry = hkl_factory_create_new_geometry(factory);
+	sample = hkl_sample_new("test");
+
+	detector = hkl_detector_factory_new(HKL_DETECTOR_TYPE_0D);
+
+	engines = hkl_factory_create_new_engine_list(factory);
+	hkl_engine_list_init(engines, geometry, detector, sample);
+
+	engine = hkl_engine_list_engine_get_by_name(engines, "hkl", NULL);
+	modes = hkl_engine_modes_names_get(engine);
+
+	res &= DIAG(hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 1., 30., 10., 20., 2., 60.));
+	start = hkl_geometry_new_copy(geometry);
+
+	/* the holders enumeration gives the same solutions than perm_r */
+	darray_foreach(mode, *modes){
+		HklGeometryList *geometries[2];
+		HklModeAutoWorkspace *ws;
+		size_t i;
+
+		res &= DIAG(hkl_engine_current_mode_set(engine, *mode, NULL));
+		ws = hkl_mode_auto_workspace_get(engine->mode);
+		for(i=0; i<ARRAY_SIZE(geometries); ++i){
+			hkl_geometry_set(geometry, start);
+			hkl_engine_random_seed_set(engine, 42);
+			ws->perm_r = i;
+			geometries[i] = hkl_engine_pseudo_axis_values_set(engine,
+									  hkl, ARRAY_SIZE(hkl),
+									  HKL_UNIT_DEFAULT, NULL);
+		}
+		ws->perm_r = FALSE;
+
+		res &= DIAG(check_geometry_lists(geometries[0], geometries[1]));
+		for(i=0; i<ARRAY_SIZE(geometries); ++i)
+			if(geometries[i])
+				hkl_geometry_list_free(geometries[i]);
+	}
+
+	ok(res == TRUE, "sectors perm_r");
+
+	hkl_engine_list_free(engines);
+	hkl_detector_free(detector);
+	hkl_sample_free(sample);
+	hkl_geometry_free(geometry);
+	hkl_geometry_free(start);
+}
+
 int main(void)
 {
-	plan(4);
+	plan(6);
 
 	degenerated();
 	eulerians();
 	q2();
 	m15110();
+	sectors();
+	sectors_perm_r();
 
 	return 0;
 }
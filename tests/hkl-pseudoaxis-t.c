@@ -20,8 +20,11 @@
  * Authors: Picca Frédéric-Emmanuel <picca@synchrotron-soleil.fr>
  */
 #include <alloca.h>
+#include <gsl/gsl_machine.h>            // for GSL_SQRT_DBL_EPSILON
 #include <string.h>
 #include "hkl.h"
+#include "hkl-pseudoaxis-auto-private.h" /* temporary */
+#undef ARRAY_SIZE /* the tap one */
 #include <tap/basic.h>
 #include <tap/hkl-tap.h>
 
@@ -531,11 +534,228 @@ static void depends(void)
 	ok(TRUE == TEST_FOREACH_ENGINE(1, _depends), __func__);
 }
 
+static int _stale(HklEngine *engine, HklEngineList *engine_list, UNUSED unsigned int n)
+{
+	int res = TRUE;
+	HklGeometry *geometry = hkl_engine_list_geometry_get(engine_list);
+	const unsigned int depends = hkl_engine_dependencies_get(engine);
+	const size_t n_pseudo_axes = darray_size(*hkl_engine_pseudo_axis_names_get(engine));
+	const size_t n_parameters = darray_size(*hkl_engine_parameters_names_get(engine));
+	const double wavelength = hkl_geometry_wavelength_get(geometry, HKL_UNIT_DEFAULT);
+	double values[n_pseudo_axes];
+	double parameters[n_parameters];
+
+	hkl_geometry_randomize(geometry);
+	if(HKL_ENGINE_CAPABILITIES_INITIALIZABLE & hkl_engine_capabilities_get(engine))
+		res &= DIAG(hkl_engine_initialized_set(engine, TRUE, NULL));
+	res &= DIAG(TRUE == hkl_engine_stale_get(engine));
+
+	/* the pseudo axes values are computed only once */
+	res &= DIAG(hkl_engine_pseudo_axis_values_get(engine, values, n_pseudo_axes,
+						      HKL_UNIT_DEFAULT, NULL));
+	res &= DIAG(FALSE == hkl_engine_stale_get(engine));
+	hkl_engine_list_get(engine_list);
+	res &= DIAG(FALSE == hkl_engine_stale_get(engine));
+
+	/* only if one of its dependencies changed */
+	res &= DIAG(hkl_geometry_wavelength_set(geometry, wavelength + 0.1,
+						HKL_UNIT_DEFAULT, NULL));
+	res &= DIAG(!hkl_engine_stale_get(engine) == !(depends & HKL_ENGINE_DEPENDENCIES_ENERGY));
+	hkl_engine_list_get(engine_list);
+	res &= DIAG(FALSE == hkl_engine_stale_get(engine));
+
+	hkl_geometry_randomize(geometry);
+	res &= DIAG(!hkl_engine_stale_get(engine) == !(depends & HKL_ENGINE_DEPENDENCIES_AXES));
+	hkl_engine_list_get(engine_list);
+	res &= DIAG(FALSE == hkl_engine_stale_get(engine));
+
+	/* or if the engine parameters were modified */
+	hkl_engine_parameters_values_get(engine, parameters, n_parameters,
+					 HKL_UNIT_DEFAULT);
+	res &= DIAG(hkl_engine_parameters_values_set(engine, parameters, n_parameters,
+						     HKL_UNIT_DEFAULT, NULL));
+	res &= DIAG(TRUE == hkl_engine_stale_get(engine));
+
+	res &= DIAG(hkl_geometry_wavelength_set(geometry, wavelength,
+						HKL_UNIT_DEFAULT, NULL));
+
+	return res;
+}
+
+static void stale(void)
+{
+	ok(TRUE == TEST_FOREACH_MODE(1, _stale), __func__);
+}
+
+static int _jacobian(HklEngine *engine, HklEngineList *engine_list, UNUSED unsigned int n)
+{
+	int res = TRUE;
+	HklGeometry *geometry = hkl_engine_list_geometry_get(engine_list);
+	const size_t n_pseudo_axes = darray_size(engine->pseudo_axes);
+	double targets[n_pseudo_axes];
+	const HklModeAutoInfo *auto_info;
+	const HklFunction **function;
+	HklParameter **axis;
+
+	/* only the auto modes have functions */
+	if(engine->mode->ops->set_local != hkl_mode_auto_set_local_real)
+		return TRUE;
+	auto_info = container_of(engine->mode->info, HklModeAutoInfo, info);
+
+	hkl_geometry_randomize(geometry);
+	hkl_tap_engine_pseudo_axes_randomize(engine,
+					     targets, n_pseudo_axes,
+					     HKL_UNIT_DEFAULT);
+	hkl_tap_engine_parameters_randomize(engine);
+	res &= DIAG(hkl_engine_initialized_set(engine, TRUE, NULL));
+	hkl_engine_prepare_internal(engine);
+
+	darray_foreach(axis, engine->axes)
+		if(!*axis)
+			return res;
+
+	/* the analytic jacobian is the finite differences one */
+	darray_foreach(function, auto_info->functions){
+		const size_t len = (*function)->size;
+		gsl_multiroot_function f = {
+			.f = (*function)->function,
+			.n = len,
+			.params = engine,
+		};
+		gsl_vector *x;
+		gsl_vector *fx;
+		gsl_matrix *J;
+		gsl_matrix *J_fd;
+		size_t i, j;
+
+		if(!(*function)->df)
+			continue;
+
+		x = gsl_vector_alloc(len);
+		fx = gsl_vector_alloc(len);
+		J = gsl_matrix_alloc(len, len);
+		J_fd = gsl_matrix_alloc(len, len);
+
+		i = 0;
+		darray_foreach(axis, engine->axes)
+			gsl_vector_set(x, i++, (*axis)->_value);
+
+		(*function)->function(x, engine, fx);
+		gsl_multiroot_fdjacobian(&f, x, fx, GSL_SQRT_DBL_EPSILON, J_fd);
+		(*function)->df(x, engine, J);
+
+		for(i=0; i<len; ++i)
+			for(j=0; j<len; ++j){
+				const double expected = gsl_matrix_get(J_fd, i, j);
+
+				res &= DIAG(fabs(gsl_matrix_get(J, i, j) - expected)
+					    < 1e-5 * (1. + fabs(expected)));
+			}
+
+		gsl_matrix_free(J_fd);
+		gsl_matrix_free(J);
+		gsl_vector_free(fx);
+		gsl_vector_free(x);
+	}
+
+	return res;
+}
+
+static void jacobian(int nb_iter)
+{
+	ok(TRUE == TEST_FOREACH_MODE(nb_iter, _jacobian), __func__);
+}
+
+static void analytic(void)
+{
+	int res = TRUE;
+	size_t i, j, k;
+	static struct {
+		const char *factory;
+		double start[6];
+		const char *modes[6];
+	} geometries[] = {
+		{"E4CV", {30., 10., 20., 60.},
+		 {"bissector", "constant_omega", "constant_chi", "constant_phi"}},
+		{"E4CH", {30., 10., 20., 60.},
+		 {"bissector", "constant_omega", "constant_chi", "constant_phi"}},
+		{"E6C", {0., 30., 10., 20., 0., 60.},
+		 {"bissector_vertical", "constant_omega_vertical",
+		  "constant_chi_vertical", "constant_phi_vertical",
+		  "bissector_horizontal", "constant_mu_horizontal"}},
+	};
+	static double hkls[][3] = {{1, 0, 0}, {0, 1, 1}, {1, 1, 1}, {-1, 0, 1}};
+
+	/* the closed form solutions are the numerical ones */
+	for(i=0; i<ARRAY_SIZE(geometries); ++i){
+		const HklFactory *factory = hkl_factory_get_by_name(geometries[i].factory, NULL);
+		HklGeometry *geometry = hkl_factory_create_new_geometry(factory);
+		HklDetector *detector = hkl_detector_factory_new(HKL_DETECTOR_TYPE_0D);
+		HklSample *sample = hkl_sample_new("test");
+		HklEngineList *engines = hkl_factory_create_new_engine_list(factory);
+		HklEngine *engine;
+		HklGeometry *start;
+
+		hkl_engine_list_init(engines, geometry, detector, sample);
+		engine = hkl_engine_list_engine_get_by_name(engines, "hkl", NULL);
+
+		res &= DIAG(hkl_geometry_axis_values_set(geometry,
+							 geometries[i].start,
+							 darray_size(geometry->axes),
+							 HKL_UNIT_USER, NULL));
+		start = hkl_geometry_new_copy(geometry);
+
+		for(j=0; j<ARRAY_SIZE(geometries[i].modes) && geometries[i].modes[j]; ++j){
+			HklModeAutoWorkspace *ws;
+			int solved = FALSE;
+
+			res &= DIAG(hkl_engine_current_mode_set(engine, geometries[i].modes[j], NULL));
+			ws = hkl_mode_auto_workspace_get(engine->mode);
+			for(k=0; k<ARRAY_SIZE(hkls); ++k){
+				HklGeometryList *solutions[2];
+				int same;
+				size_t n;
+
+				for(n=0; n<ARRAY_SIZE(solutions); ++n){
+					hkl_geometry_set(geometry, start);
+					hkl_engine_random_seed_set(engine, 42);
+					ws->numerical = n;
+					solutions[n] = hkl_engine_pseudo_axis_values_set(engine,
+											 hkls[k], ARRAY_SIZE(hkls[k]),
+											 HKL_UNIT_DEFAULT, NULL);
+				}
+				ws->numerical = FALSE;
+
+				same = check_geometry_lists(solutions[0], solutions[1]);
+				if(!same)
+					diag("failed at factory: \"%s\" mode: \"%s\" hkl: %f %f %f",
+					     geometries[i].factory, geometries[i].modes[j],
+					     hkls[k][0], hkls[k][1], hkls[k][2]);
+				res &= same;
+				solved |= NULL != solutions[0];
+
+				for(n=0; n<ARRAY_SIZE(solutions); ++n)
+					if(solutions[n])
+						hkl_geometry_list_free(solutions[n]);
+			}
+			res &= DIAG(solved);
+		}
+
+		hkl_geometry_free(start);
+		hkl_engine_list_free(engines);
+		hkl_sample_free(sample);
+		hkl_detector_free(detector);
+		hkl_geometry_free(geometry);
+	}
+
+	ok(res == TRUE, __func__);
+}
+
 int main(int argc, char** argv)
 {
 	double n;
 
-	plan(10);
+	plan(13);
 
 	if (argc > 1)
 		n = atoi(argv[1]);
@@ -552,6 +772,9 @@ int main(int argc, char** argv)
 	axis_names();
 	parameters();
 	depends();
+	stale();
+	jacobian(n);
+	analytic();
 
 	return 0;
 }
@@ -291,6 +291,213 @@ static void compute_UB_busing_levy(void)
 	hkl_matrix_free(m_I);
 }
 
+static void compute_UB_least_squares(void)
+{
+	GError *error;
+	const HklFactory *factory;
+	HklDetector *detector;
+	HklGeometry *geometry;
+	HklSample *sample;
+	HklLattice *lattice;
+	HklSampleReflection *ref;
+	HklSampleReflection *outlier;
+	HklMatrix *m_I = hkl_matrix_new_full(1., 0., 0.,
+					     0., 1., 0.,
+					     0., 0., 1.);
+	const double weights[] = {1., 1., 1., 1., 1., 0.};
+	size_t n_flagged;
+	int res;
+
+	factory = hkl_factory_get_by_name("E4CV", NULL);
+	geometry = hkl_factory_create_new_geometry(factory);
+
+	detector = hkl_detector_factory_new(HKL_DETECTOR_TYPE_0D);
+
+	sample = hkl_sample_new("test");
+	lattice = hkl_lattice_new(1.54, 1.54, 1.54,
+				  90 * HKL_DEGTORAD,
+				  90 * HKL_DEGTORAD,
+				  90 * HKL_DEGTORAD,
+				  NULL);
+	hkl_sample_lattice_set(sample, lattice);
+	hkl_lattice_free(lattice);
+
+	res = hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 30., 0., 90., 60.);
+	ref = hkl_sample_reflection_new(geometry, detector, 1, 0, 0, NULL);
+	hkl_sample_add_reflection(sample, ref);
+
+	/* one reflection is not enough */
+	error = NULL;
+	ok(FALSE == hkl_sample_compute_UB_least_squares(sample, NULL, 0, 0., &error), __func__);
+	ok(error != NULL, __func__);
+	g_clear_error(&error);
+
+	res &= hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 30., 90., 0., 60.);
+	ref = hkl_sample_reflection_new(geometry, detector, 0, 1, 0, NULL);
+	hkl_sample_add_reflection(sample, ref);
+
+	res &= hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 30., 0., 0., 60.);
+	ref = hkl_sample_reflection_new(geometry, detector, 0, 0, 1, NULL);
+	hkl_sample_add_reflection(sample, ref);
+
+	res &= hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 60., 60., 60., 60.);
+	ref = hkl_sample_reflection_new(geometry, detector, .625, .75, -.216506350946, NULL);
+	hkl_sample_add_reflection(sample, ref);
+
+	res &= hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 45., 45., 45., 60.);
+	ref = hkl_sample_reflection_new(geometry, detector, .665975615037, .683012701892, .299950211252, NULL);
+	hkl_sample_add_reflection(sample, ref);
+	ok(TRUE == res, __func__);
+
+	ok(TRUE == hkl_sample_compute_UB_least_squares(sample, NULL, 0, 0., &error), __func__);
+	ok(error == NULL, __func__);
+	is_matrix(m_I, hkl_sample_U_get(sample), __func__);
+	CHECK_UX_UY_UZ(sample, 0., 0., 0.);
+
+	/* an outlier measured at the position of the (1, 0, 0) */
+	res = hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 30., 0., 90., 60.);
+	outlier = hkl_sample_reflection_new(geometry, detector, 0, 1, 0, NULL);
+	hkl_sample_add_reflection(sample, outlier);
+	ok(TRUE == res, __func__);
+
+	/* the weights must match the reflections */
+	ok(FALSE == hkl_sample_compute_UB_least_squares(sample, weights, 5, 0., &error), __func__);
+	ok(error != NULL, __func__);
+	g_clear_error(&error);
+
+	/* ignored with a null weight */
+	ok(TRUE == hkl_sample_compute_UB_least_squares(sample, weights, 6, 0., NULL), __func__);
+	is_matrix(m_I, hkl_sample_U_get(sample), __func__);
+
+	/* rejected and unflagged by the RANSAC */
+	ok(TRUE == hkl_sample_compute_UB_least_squares(sample, NULL, 0, .1, NULL), __func__);
+	is_matrix(m_I, hkl_sample_U_get(sample), __func__);
+	ok(FALSE == hkl_sample_reflection_flag_get(outlier), __func__);
+	n_flagged = 0;
+	for(ref = hkl_sample_reflections_first_get(sample);
+	    ref;
+	    ref = hkl_sample_reflections_next_get(sample, ref))
+		n_flagged += hkl_sample_reflection_flag_get(ref);
+	ok(5 == n_flagged, __func__);
+
+	hkl_sample_free(sample);
+	hkl_detector_free(detector);
+	hkl_geometry_free(geometry);
+	hkl_matrix_free(m_I);
+}
+
+static void index_peaks(void)
+{
+	GError *error;
+	double a, b, c, alpha, beta, gamma;
+	const HklFactory *factory;
+	HklDetector *detector;
+	HklGeometry *geometries[5];
+	HklSample *sample;
+	HklLattice *lattice;
+	HklSampleReflection *r0;
+	HklSampleReflection *ref;
+	static const double positions[][4] = {
+		{30., 0., 90., 60.}, /* 1 0 0 */
+		{30., 90., 0., 60.}, /* 0 1 0 */
+		{30., 0., 0., 60.}, /* 0 0 1 */
+		{45., 0., 45., 90.}, /* 1 0 1 */
+		{60., 60., 60., 60.}, /* not a node of the lattice */
+	};
+	static const double hkls[][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {1, 0, 1}};
+	const HklMatrix *U;
+	size_t i, j, k;
+	int res = TRUE;
+
+	factory = hkl_factory_get_by_name("E4CV", NULL);
+	detector = hkl_detector_factory_new(HKL_DETECTOR_TYPE_0D);
+	for(i=0; i<ARRAY_SIZE(positions); ++i){
+		geometries[i] = hkl_factory_create_new_geometry(factory);
+		res &= hkl_geometry_set_values_v(geometries[i], HKL_UNIT_USER, NULL,
+						 positions[i][0], positions[i][1],
+						 positions[i][2], positions[i][3]);
+	}
+	ok(TRUE == res, __func__);
+
+	sample = hkl_sample_new("test");
+	lattice = hkl_lattice_new(1.54, 1.54, 1.54,
+				  90 * HKL_DEGTORAD,
+				  90 * HKL_DEGTORAD,
+				  90 * HKL_DEGTORAD,
+				  NULL);
+	hkl_sample_lattice_set(sample, lattice);
+	hkl_lattice_free(lattice);
+
+	/* one peak is not enough */
+	error = NULL;
+	ok(FALSE == hkl_sample_index_peaks(sample, (const HklGeometry *const *)geometries, 1,
+					   detector, .01, &error), __func__);
+	ok(error != NULL, __func__);
+	g_clear_error(&error);
+	ok(0 == hkl_sample_n_reflections_get(sample), __func__);
+
+	ok(TRUE == hkl_sample_index_peaks(sample, (const HklGeometry *const *)geometries,
+					  ARRAY_SIZE(geometries), detector, .01, &error), __func__);
+	ok(error == NULL, __func__);
+	ok(4 == hkl_sample_n_reflections_get(sample), __func__);
+
+	/* the hkl are consistent with the measured positions */
+	r0 = hkl_sample_reflections_first_get(sample);
+	for(ref = hkl_sample_reflections_next_get(sample, r0);
+	    ref;
+	    ref = hkl_sample_reflections_next_get(sample, ref))
+		is_double(hkl_sample_get_reflection_measured_angle(sample, r0, ref),
+			  hkl_sample_get_reflection_theoretical_angle(sample, r0, ref),
+			  HKL_EPSILON, __func__);
+
+	/* the lattice is cubic, so U is the identity up to a rotation
+	 * of the cube, a signed permutation S^T, and the hkl are the
+	 * expected ones rotated by S */
+	U = hkl_sample_U_get(sample);
+	for(i=0; i<3; ++i){
+		int n_ones = 0;
+
+		for(j=0; j<3; ++j){
+			const double u = fabs(hkl_matrix_get(U, i, j));
+
+			if (fabs(u - 1.) < HKL_EPSILON)
+				n_ones++;
+			else
+				res &= DIAG(u < HKL_EPSILON);
+		}
+		res &= DIAG(1 == n_ones);
+	}
+
+	i = 0;
+	for(ref = r0; ref && i < ARRAY_SIZE(hkls); ref = hkl_sample_reflections_next_get(sample, ref)){
+		double hkl[3];
+
+		hkl_sample_reflection_hkl_get(ref, &hkl[0], &hkl[1], &hkl[2]);
+		for(j=0; j<3; ++j){
+			double expected = 0.;
+
+			for(k=0; k<3; ++k)
+				expected += hkl_matrix_get(U, k, j) * hkls[i][k];
+			res &= DIAG(fabs(expected - hkl[j]) < HKL_EPSILON);
+		}
+		i++;
+	}
+	ok(TRUE == res, __func__);
+
+	/* and with the computed orientation */
+	ok(TRUE == hkl_sample_affine(sample, NULL), __func__);
+	hkl_lattice_get(hkl_sample_lattice_get(sample),
+			&a, &b, &c, &alpha, &beta, &gamma, HKL_UNIT_DEFAULT);
+	is_double(1.54, a, HKL_EPSILON, __func__);
+	is_double(1.54, b, HKL_EPSILON, __func__);
+	is_double(1.54, c, HKL_EPSILON, __func__);
+
+	hkl_sample_free(sample);
+	for(i=0; i<ARRAY_SIZE(geometries); ++i)
+		hkl_geometry_free(geometries[i]);
+	hkl_detector_free(detector);
+}
+
 static void affine(void)
 {
 	GError *error;
@@ -364,6 +571,168 @@ static void affine(void)
 	hkl_matrix_free(m_ref);
 }
 
+static void affine_covariance(void)
+{
+	GError *error;
+	double a, b, c, alpha, beta, gamma;
+	double covariance[81];
+	const HklFactory *factory;
+	HklDetector *detector;
+	HklGeometry *geometry;
+	HklSample *sample;
+	HklLattice *lattice;
+	HklParameter *parameter;
+	HklSampleReflection *ref;
+	size_t i, j;
+	int res;
+
+	factory = hkl_factory_get_by_name("E4CV", NULL);
+	geometry = hkl_factory_create_new_geometry(factory);
+
+	detector = hkl_detector_factory_new(HKL_DETECTOR_TYPE_0D);
+
+	sample = hkl_sample_new("test");
+
+	/* keep the right angles of the lattice */
+	lattice = hkl_lattice_new(1, 5, 4,
+				  90 * HKL_DEGTORAD,
+				  90 * HKL_DEGTORAD,
+				  90 * HKL_DEGTORAD,
+				  NULL);
+	parameter = hkl_parameter_new_copy(hkl_lattice_alpha_get(lattice));
+	hkl_parameter_fit_set(parameter, FALSE);
+	res = hkl_lattice_alpha_set(lattice, parameter, NULL);
+	res &= hkl_lattice_beta_set(lattice, parameter, NULL);
+	res &= hkl_lattice_gamma_set(lattice, parameter, NULL);
+	ok(TRUE == res, __func__);
+	hkl_parameter_free(parameter);
+	hkl_sample_lattice_set(sample, lattice);
+	hkl_lattice_free(lattice);
+
+	res = hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 30., 0., 90., 60.);
+	ref = hkl_sample_reflection_new(geometry, detector, 1, 0, 0, NULL);
+	hkl_sample_add_reflection(sample, ref);
+
+	/* not enough reflections for the six fitted parameters */
+	error = NULL;
+	ok(FALSE == hkl_sample_affine_covariance(sample, covariance, &error), __func__);
+	ok(error != NULL, __func__);
+	g_clear_error(&error);
+
+	res &= hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 30., 90., 0., 60.);
+	ref = hkl_sample_reflection_new(geometry, detector, 0, 1, 0, NULL);
+	hkl_sample_add_reflection(sample, ref);
+
+	res &= hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 30., 0., 0., 60.);
+	ref = hkl_sample_reflection_new(geometry, detector, 0, 0, 1, NULL);
+	hkl_sample_add_reflection(sample, ref);
+	ok(TRUE == res, __func__);
+
+	ok(TRUE == hkl_sample_affine_covariance(sample, covariance, &error), __func__);
+	ok(error == NULL, __func__);
+
+	hkl_lattice_get(hkl_sample_lattice_get(sample),
+			&a, &b, &c, &alpha, &beta, &gamma, HKL_UNIT_DEFAULT);
+
+	is_double(1.54, a, HKL_EPSILON, __func__);
+	is_double(1.54, b, HKL_EPSILON, __func__);
+	is_double(1.54, c, HKL_EPSILON, __func__);
+	is_double(90 * HKL_DEGTORAD, alpha, HKL_EPSILON, __func__);
+	is_double(90 * HKL_DEGTORAD, beta, HKL_EPSILON, __func__);
+	is_double(90 * HKL_DEGTORAD, gamma, HKL_EPSILON, __func__);
+	CHECK_UX_UY_UZ(sample, 0., 0., 0.);
+
+	/* symmetric, and nothing for the angles which are not fitted */
+	res = TRUE;
+	for(i=0; i<9; ++i)
+		for(j=0; j<9; ++j){
+			res &= fabs(covariance[i * 9 + j] - covariance[j * 9 + i]) < HKL_EPSILON;
+			if (i >= 6 || j >= 6)
+				res &= covariance[i * 9 + j] == 0.;
+		}
+	ok(TRUE == res, __func__);
+
+	hkl_sample_free(sample);
+	hkl_detector_free(detector);
+	hkl_geometry_free(geometry);
+}
+
+static void affine_reflections_changed(void)
+{
+	double a, b, c, alpha, beta, gamma;
+	double covariance[81];
+	const HklFactory *factory;
+	HklDetector *detector;
+	HklGeometry *geometry;
+	HklSample *sample;
+	HklLattice *lattice;
+	HklSampleReflection *ref;
+	HklSampleReflection *wrong;
+	int res;
+
+	factory = hkl_factory_get_by_name("E4CV", NULL);
+	geometry = hkl_factory_create_new_geometry(factory);
+
+	detector = hkl_detector_factory_new(HKL_DETECTOR_TYPE_0D);
+
+	sample = hkl_sample_new("test");
+	lattice = hkl_lattice_new(1, 5, 4,
+				  90 * HKL_DEGTORAD,
+				  90 * HKL_DEGTORAD,
+				  90 * HKL_DEGTORAD,
+				  NULL);
+	hkl_sample_lattice_set(sample, lattice);
+	hkl_lattice_free(lattice);
+
+	res = hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 30., 0., 90., 60.);
+	ref = hkl_sample_reflection_new(geometry, detector, 1, 0, 0, NULL);
+	hkl_sample_add_reflection(sample, ref);
+
+	/* a wrong reflection measured at the same position */
+	wrong = hkl_sample_reflection_new(geometry, detector, 0, 1, 0, NULL);
+	hkl_sample_add_reflection(sample, wrong);
+
+	res &= hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 30., 90., 0., 60.);
+	ref = hkl_sample_reflection_new(geometry, detector, 0, 1, 0, NULL);
+	hkl_sample_add_reflection(sample, ref);
+
+	res &= hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 30., 0., 0., 60.);
+	ref = hkl_sample_reflection_new(geometry, detector, 0, 0, 1, NULL);
+	hkl_sample_add_reflection(sample, ref);
+
+	res &= hkl_geometry_set_values_v(geometry, HKL_UNIT_USER, NULL, 60., 60., 60., 60.);
+	ref = hkl_sample_reflection_new(geometry, detector, .625, .75, -.216506350946, NULL);
+	hkl_sample_add_reflection(sample, ref);
+	ok(TRUE == res, __func__);
+
+	/* the wrong reflection is not used once unflagged */
+	hkl_sample_reflection_flag_set(wrong, FALSE);
+	ok(TRUE == hkl_sample_affine_covariance(sample, covariance, NULL), __func__);
+	hkl_lattice_get(hkl_sample_lattice_get(sample),
+			&a, &b, &c, &alpha, &beta, &gamma, HKL_UNIT_DEFAULT);
+	is_double(1.54, a, HKL_EPSILON, __func__);
+
+	/* but it is used again when flagged */
+	hkl_sample_reflection_flag_set(wrong, TRUE);
+	ok(TRUE == hkl_sample_affine_covariance(sample, covariance, NULL), __func__);
+	hkl_lattice_get(hkl_sample_lattice_get(sample),
+			&a, &b, &c, &alpha, &beta, &gamma, HKL_UNIT_DEFAULT);
+	ok(fabs(a - 1.54) > HKL_EPSILON || fabs(b - 1.54) > HKL_EPSILON, __func__);
+
+	/* and it agrees with the others once corrected */
+	ok(TRUE == hkl_sample_reflection_hkl_set(wrong, 1, 0, 0, NULL), __func__);
+	ok(TRUE == hkl_sample_affine_covariance(sample, covariance, NULL), __func__);
+	hkl_lattice_get(hkl_sample_lattice_get(sample),
+			&a, &b, &c, &alpha, &beta, &gamma, HKL_UNIT_DEFAULT);
+	is_double(1.54, a, HKL_EPSILON, __func__);
+	is_double(1.54, b, HKL_EPSILON, __func__);
+	is_double(1.54, c, HKL_EPSILON, __func__);
+
+	hkl_sample_free(sample);
+	hkl_detector_free(detector);
+	hkl_geometry_free(geometry);
+}
+
 static void get_reflections_xxx_angle(void)
 {
 	HklDetector *detector;
@@ -497,7 +866,7 @@ static void reflection_set_geometry(void)
 
 int main(void)
 {
-	plan(114);
+	plan(173);
 
 	new();
 	add_reflection();
@@ -506,7 +875,11 @@ int main(void)
 	set_ux_uy_uz();
 	set_UB();
 	compute_UB_busing_levy();
+	compute_UB_least_squares();
+	index_peaks();
 	affine();
+	affine_covariance();
+	affine_reflections_changed();
 	get_reflections_xxx_angle();
 
 	reflection_set_geometry();
@@ -104,6 +104,48 @@ int check_pseudoaxes(HklEngine *engine,
 	return res;
 }
 
+/* every geometry of a has a geometry of b at the same position */
+static int geometry_list_included(const HklGeometryList *a,
+				  const HklGeometryList *b)
+{
+	const HklGeometryListItem *item_a;
+	const HklGeometryListItem *item_b;
+
+	HKL_GEOMETRY_LIST_FOREACH(item_a, a){
+		int found = FALSE;
+
+		HKL_GEOMETRY_LIST_FOREACH(item_b, b)
+			if(hkl_geometry_distance(item_a->geometry, item_b->geometry) < HKL_EPSILON){
+				found = TRUE;
+				break;
+			}
+		if(!found)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * check_geometry_lists: (skip)
+ * @geometries1: (allow-none): the first solutions
+ * @geometries2: (allow-none): the second solutions
+ *
+ * check that two solvers found the same solutions, in any order.
+ *
+ * Returns: TRUE if both lists are NULL or contain the same geometries.
+ **/
+int check_geometry_lists(const HklGeometryList *geometries1,
+			 const HklGeometryList *geometries2)
+{
+	if(!geometries1 || !geometries2)
+		return !geometries1 == !geometries2;
+
+	return hkl_geometry_list_n_items_get(geometries1) == hkl_geometry_list_n_items_get(geometries2)
+		&& geometry_list_included(geometries1, geometries2)
+		&& geometry_list_included(geometries2, geometries1);
+}
+
 /**
  * hkl_engine_set_values_v: (skip)
  * @self: the Engine
@@ -140,6 +182,7 @@ void hkl_tap_engine_pseudo_axes_randomize(HklEngine *self,
 {
 	size_t i;
 
+	hkl_engine_stale_set(self);
 	for(i=0; i<n_values; ++i){
 		HklParameter *parameter = darray_item(self->pseudo_axes, i);
 		hkl_parameter_randomize(parameter);
@@ -157,6 +200,7 @@ void hkl_tap_engine_parameters_randomize(HklEngine *self)
 {
 	HklParameter **parameter;
 
+	hkl_engine_stale_set(self);
 	darray_foreach(parameter, self->mode->parameters){
 		hkl_parameter_randomize(*parameter);
 	}
@@ -48,6 +48,9 @@ extern int check_pseudoaxes_v(HklEngine *engine, ...);
 extern int check_pseudoaxes(HklEngine *engine,
 			    double expected[], uint len);
 
+extern int check_geometry_lists(const HklGeometryList *geometries1,
+				const HklGeometryList *geometries2);
+
 extern  void hkl_tap_engine_pseudo_axes_randomize(HklEngine *self,
 						  double values[], size_t n_values,
 						  HklUnitEnum unit_type) HKL_ARG_NONNULL(1, 2);